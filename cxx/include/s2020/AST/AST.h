@@ -3,8 +3,11 @@
 
 #include "s2020/AST/ASTContext.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/SMLoc.h"
+#include "llvm/Support/TrailingObjects.h"
 
 namespace llvm {
 class raw_ostream;
@@ -64,6 +67,12 @@ class Node {
     setSourceRange(src->getSourceRange());
   }
 
+  /// \return the hashDatum() of a node which was hash-consed by
+  ///     ASTContext::intern(), or 0 for other nodes.
+  unsigned getInternedHash() const {
+    return hash_;
+  }
+
   // Allow allocation of AST nodes by using the Context allocator or by a
   // placement new.
 
@@ -91,7 +100,17 @@ class Node {
   }
 
  private:
+  friend class ASTContext;
+
   NodeKind kind_;
+
+ protected:
+  /// A few bits which subclasses can use, in what would otherwise be padding.
+  uint8_t subclassData_ = 0;
+
+ private:
+  /// Set by ASTContext::intern(), in what would otherwise be padding too.
+  unsigned hash_ = 0;
   SMRange sourceRange_;
 };
 
@@ -125,13 +144,78 @@ using SymbolNode = SimpleNode<NodeKind::Symbol, Identifier>;
 using NumberNode = SimpleNode<NodeKind::Number, Number>;
 using NullNode = BaseNode<NodeKind::Null>;
 
-// FIXME: implement these.
-using BytevectorNode = BaseNode<NodeKind::Bytevector>;
-using VectorNode = BaseNode<NodeKind::Vector>;
+/// A bytevector. The bytes are stored right after the node.
+class BytevectorNode final
+    : public BaseNode<NodeKind::Bytevector>,
+      private llvm::TrailingObjects<BytevectorNode, uint8_t> {
+  friend TrailingObjects;
+
+ public:
+  /// Allocate a new BytevectorNode containing a copy of \p bytes.
+  static BytevectorNode *create(ASTContext &ctx, llvm::ArrayRef<uint8_t> bytes);
+
+  size_t size() const {
+    return size_;
+  }
+  llvm::ArrayRef<uint8_t> getBytes() const {
+    return {getTrailingObjects<uint8_t>(), size_};
+  }
+
+ private:
+  explicit BytevectorNode(size_t size) : size_(size) {}
+
+  size_t size_;
+};
+
+/// A vector. The elements are stored in an array right after the node, so
+/// they can be indexed in constant time.
+class VectorNode final : public BaseNode<NodeKind::Vector>,
+                         private llvm::TrailingObjects<VectorNode, Node *> {
+  friend TrailingObjects;
 
-class PairNode : public BaseNode<NodeKind::Pair> {
  public:
-  explicit PairNode(Node *car, Node *cdr) : car_(car), cdr_(cdr) {}
+  /// Allocate a new VectorNode containing a copy of \p elements.
+  static VectorNode *create(ASTContext &ctx, llvm::ArrayRef<Node *> elements);
+
+  size_t size() const {
+    return size_;
+  }
+  llvm::ArrayRef<Node *> getElements() const {
+    return {getTrailingObjects<Node *>(), size_};
+  }
+  Node *getElement(size_t index) const {
+    assert(index < size_ && "vector index out of range");
+    return getTrailingObjects<Node *>()[index];
+  }
+  void setElement(size_t index, Node *element) {
+    assert(index < size_ && "vector index out of range");
+    getTrailingObjects<Node *>()[index] = element;
+  }
+
+ private:
+  explicit VectorNode(size_t size) : size_(size) {}
+
+  size_t size_;
+};
+
+/// A pair. Lists are CDR-coded: the pairs of a list can be allocated together,
+/// followed by the empty list which ends it, and then the cdr of each pair is
+/// the node right after it instead of a pointer. Other pairs store their cdr
+/// after the node.
+class PairNode final : public BaseNode<NodeKind::Pair>,
+                       private llvm::TrailingObjects<PairNode, Node *> {
+  friend TrailingObjects;
+
+ public:
+  /// Allocate a new PairNode with a stored cdr.
+  static PairNode *create(ASTContext &ctx, Node *car, Node *cdr);
+
+  /// Allocate the CDR-coded list of \p elements, which must not be empty. The
+  /// last pair stores \p tail as its cdr, or if there is no tail, is followed
+  /// by a new empty list.
+  /// \return the first pair.
+  static PairNode *
+  createList(ASTContext &ctx, llvm::ArrayRef<Node *> elements, Node *tail);
 
   Node *getCar() const {
     return car_;
@@ -140,15 +224,30 @@ class PairNode : public BaseNode<NodeKind::Pair> {
     car_ = car;
   }
   Node *getCdr() const {
-    return cdr_;
+    if (isCdrCoded())
+      return reinterpret_cast<Node *>(const_cast<PairNode *>(this) + 1);
+    return *getTrailingObjects<Node *>();
   }
+  /// Change the stored cdr. The cdr of a CDR-coded pair is the node after it
+  /// and can't be changed, so this is a fatal error even in release builds.
+  /// Build a list with cons() if its cdrs need to change.
   void setCdr(Node *cdr) {
-    cdr_ = cdr;
+    if (LLVM_UNLIKELY(isCdrCoded()))
+      llvm::report_fatal_error("the cdr of a CDR-coded pair can't be changed");
+    *getTrailingObjects<Node *>() = cdr;
+  }
+
+  /// \return true if the cdr is the node right after this one.
+  bool isCdrCoded() const {
+    return subclassData_;
   }
 
  private:
+  explicit PairNode(Node *car, bool cdrCoded) : car_(car) {
+    subclassData_ = cdrCoded;
+  }
+
   Node *car_;
-  Node *cdr_;
 };
 
 /// Allocate a new PairNode.
@@ -163,10 +262,20 @@ inline Node *list(ASTContext &ctx, Node *first, Args... args) {
   return cons(ctx, first, list(ctx, args...));
 }
 
-/// Compare the two ASTs (ignoring source coordinates).
+/// Compare the two ASTs (ignoring source coordinates). They may share nodes
+/// or be cyclic, and are equal if they unfold to the same, possibly infinite,
+/// trees. The stack use is bounded, however deep the ASTs are.
 bool deepEqual(const Node *a, const Node *b);
 
-/// Print the AST recursively.
+/// \return a hash of the AST (ignoring source coordinates), which is the same
+///     for ASTs which are deepEqual(). It is computed in constant time for
+///     nodes which have been hash-consed.
+unsigned hashDatum(const Node *node);
+
+/// Print the AST. Pairs and vectors which are reached more than once,
+/// including cyclic ones, are printed once with datum labels. The stack use
+/// doesn't depend on the depth of the AST, and the output to an unbuffered
+/// stream is buffered.
 void dump(llvm::raw_ostream &OS, const Node *node);
 
 } // namespace ast
@@ -2,25 +2,79 @@
 #define SCHEME2020_AST_ASTCONTEXT_H
 
 #include "s2020/AST/Number.h"
+#include "s2020/Support/Arena.h"
 #include "s2020/Support/SourceErrorManager.h"
 #include "s2020/Support/StringTable.h"
 
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/Support/Allocator.h"
 
+#include <vector>
+
 namespace s2020 {
 namespace ast {
 
 using Allocator = llvm::BumpPtrAllocator;
 
+class Node;
+
 class ASTContext {
  public:
   SourceErrorManager sm;
+  /// Holds everything which lives as long as the context, other than strings.
   Allocator allocator;
-  StringTable stringTable{allocator};
+  /// Holds the interned strings, and nothing else, so it can be rewound
+  /// together with the string table.
+  Arena stringArena;
+  StringTable stringTable{stringArena};
+
+  /// A position in the node and string arenas, which they can be rewound to.
+  struct Checkpoint {
+    Arena::Checkpoint nodes;
+    Arena::Checkpoint strings;
+    size_t numStrings;
+    size_t numInterned;
+  };
+
+  /// Nodes which are allocated once with the context and shared by all
+  /// datums, instead of being allocated for every use. They have no location
+  /// and are not freed with the other nodes.
+  struct SharedNodes {
+    /// The symbols which the abbreviations 'x, `x, ,x and ,@x expand to.
+    Node *quote;
+    Node *quasiquote;
+    Node *unquote;
+    Node *unquoteSplicing;
+    /// An empty list.
+    Node *null;
+  };
 
   ASTContext();
   ~ASTContext();
 
+  const SharedNodes &getSharedNodes() const {
+    return sharedNodes_;
+  }
+
+  /// Turn hash-consing of the datums read by the parser on or off. While it
+  /// is on, the parser passes every datum it reads to intern(), so equal
+  /// datums are the same nodes, stored once, and can be compared as pointers.
+  void setHashConsing(bool on) {
+    hashConsing_ = on;
+  }
+  bool isHashConsing() const {
+    return hashConsing_;
+  }
+
+  /// Hash-cons \p node, whose children must have been interned already: the
+  /// elements of a vector and the cars and the last cdr of a list. Otherwise
+  /// \p node is returned as is, and not interned.
+  ///
+  /// Interned nodes are shared, so they must not be modified, and their
+  /// location is that of the first one. The shared nodes are interned too.
+  /// \return an interned node equal to \p node, or \p node after interning it.
+  Node *intern(Node *node);
+
   Number makeExactNumber(ExactNumberT exact) {
     return Number{exact};
   }
@@ -29,14 +83,106 @@ class ASTContext {
   }
 
   /// Allocates AST nodes. Should not be used for non-AST data because
-  /// the memory may be freed during parsing.
+  /// the memory is released by freeNodes().
   template <typename T>
   T *allocateNode(size_t num = 1) {
-    return allocator.template Allocate<T>(num);
+    return nodeArena_.template Allocate<T>(num);
   }
   void *allocateNode(size_t size, size_t alignment) {
-    return allocator.Allocate(size, alignment);
+    return nodeArena_.Allocate(size, alignment);
+  }
+
+  /// Free all AST nodes, which must no longer be used. The memory is kept for
+  /// the nodes allocated next, so a reader which frees the nodes of each datum
+  /// after processing it runs in constant memory.
+  void freeNodes() {
+    truncateInterned(numSharedInterned_);
+    nodeArena_.reset();
+  }
+
+  /// \return the number of bytes held by the AST nodes.
+  size_t getNodeMemory() const {
+    return nodeArena_.getTotalMemory();
+  }
+
+  /// Take over the AST nodes of \p other, so they live as long as this
+  /// context, or until it is rewound to a checkpoint taken before. Its
+  /// interned nodes are interned here too, unless there are equal ones.
+  void adoptNodes(ASTContext &other);
+
+  /// \return the current position of the arenas, which can be passed to
+  ///     rewindNodes() or rewind().
+  Checkpoint checkpoint() const {
+    return Checkpoint{
+        nodeArena_.checkpoint(),
+        stringArena.checkpoint(),
+        stringTable.size(),
+        internOrder_.size()};
   }
+
+  /// Free the AST nodes allocated since \p cp was taken, which must no longer
+  /// be used.
+  void rewindNodes(const Checkpoint &cp) {
+    truncateInterned(cp.numInterned);
+    nodeArena_.rewind(cp.nodes);
+  }
+
+  /// Free the AST nodes and the strings allocated since \p cp was taken. No
+  /// node, Identifier or token created since then may be used. In particular,
+  /// a lexer must not be rewound past its current token.
+  void rewind(const Checkpoint &cp) {
+    truncateInterned(cp.numInterned);
+    nodeArena_.rewind(cp.nodes);
+    stringTable.truncate(cp.numStrings);
+    stringArena.rewind(cp.strings);
+  }
+
+ private:
+  /// A separate arena for the AST nodes, so they can be freed without
+  /// affecting the strings they refer to.
+  Arena nodeArena_;
+
+  SharedNodes sharedNodes_;
+
+  /// A key of the interned nodes: a node and its hash. Keeping the hash in
+  /// the key means that probing compares hashes before touching the nodes.
+  struct InternKey {
+    Node *node;
+    unsigned hash;
+  };
+  /// Compares interned nodes by their contents.
+  struct InternKeyInfo {
+    static InternKey getEmptyKey() {
+      return InternKey{nullptr, 0};
+    }
+    static InternKey getTombstoneKey() {
+      return InternKey{nullptr, 1};
+    }
+    static unsigned getHashValue(const InternKey &key) {
+      return key.hash;
+    }
+    static bool isEqual(const InternKey &a, const InternKey &b) {
+      if (a.hash != b.hash)
+        return false;
+      if (a.node == b.node)
+        return true;
+      return a.node && b.node && equalContents(a.node, b.node);
+    }
+    /// \return whether the interned nodes \p a and \p b, which have the
+    ///     same hash, are equal.
+    static bool equalContents(const Node *a, const Node *b);
+  };
+
+  /// Remove all interned nodes but the first \p size ones, before they are
+  /// freed.
+  void truncateInterned(size_t size);
+
+  bool hashConsing_ = false;
+  /// The interned nodes, and the same in the order they were interned.
+  llvm::DenseSet<InternKey, InternKeyInfo> interned_{};
+  std::vector<Node *> internOrder_{};
+  /// The number of shared nodes, which are interned first.
+  size_t numSharedInterned_ = 0;
 };
 
 } // namespace ast
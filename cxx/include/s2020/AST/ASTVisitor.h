@@ -0,0 +1,160 @@
+#ifndef SCHEME2020_AST_ASTVISITOR_H
+#define SCHEME2020_AST_ASTVISITOR_H
+
+#include "s2020/AST/AST.h"
+
+#include "llvm/ADT/PointerIntPair.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <type_traits>
+
+namespace s2020 {
+namespace ast {
+
+/// Calls the method of \p Derived for the kind of a node: visit() calls
+/// visitPair() for a pair, visitSymbol() for a symbol, and so on, with the
+/// node cast to its class and \p ParamTys passed along. The dispatch is a
+/// switch resolved at compile time, with no virtual calls, so it inlines like
+/// a hand-written switch over NodeKinds.def.
+///
+/// The methods which \p Derived doesn't define call visitNode(), which returns
+/// a default constructed \p RetTy.
+///
+/// Use ASTVisitor for mutable nodes and ConstASTVisitor for const ones.
+template <
+    typename Derived,
+    bool IsConst,
+    typename RetTy = void,
+    typename... ParamTys>
+class ASTVisitorBase {
+ public:
+  /// A pointer to a node of class \p T, which is const if the visitor is.
+  template <typename T>
+  using Ptr = typename std::conditional<IsConst, const T *, T *>::type;
+
+  RetTy visit(Ptr<Node> node, ParamTys... params) {
+    switch (node->getKind()) {
+#define S2020_AST_NODE(name) \
+  case NodeKind::name:       \
+    return derived().visit##name(llvm::cast<name##Node>(node), params...);
+#include "s2020/AST/NodeKinds.def"
+      case NodeKind::_end:
+        break;
+    }
+    llvm_unreachable("invalid node kind");
+  }
+
+#define S2020_AST_NODE(name)                                    \
+  RetTy visit##name(Ptr<name##Node> node, ParamTys... params) { \
+    return derived().visitNode(node, params...);                \
+  }
+#include "s2020/AST/NodeKinds.def"
+
+  RetTy visitNode(Ptr<Node>, ParamTys...) {
+    return RetTy();
+  }
+
+ protected:
+  Derived &derived() {
+    return *static_cast<Derived *>(this);
+  }
+};
+
+template <typename Derived, typename RetTy = void, typename... ParamTys>
+using ASTVisitor = ASTVisitorBase<Derived, false, RetTy, ParamTys...>;
+template <typename Derived, typename RetTy = void, typename... ParamTys>
+using ConstASTVisitor = ASTVisitorBase<Derived, true, RetTy, ParamTys...>;
+
+/// Walks an AST depth first, left to right, without recursing, and calls the
+/// methods of \p Derived on the nodes it reaches:
+///   - shouldTraverse(node) before anything else. If it returns false, the
+///     node and its parts are skipped.
+///   - visitPair(), visitSymbol() and so on, or visitNode(), in pre-order.
+///   - postVisit(node) after the parts of a pair or a vector, in post-order,
+///     only if shouldTraversePostOrder() returns true.
+/// All of them return false to stop the walk, except shouldTraverse(). The
+/// defaults return true.
+///
+/// The walk follows the car and then the cdr of a pair, and the elements of a
+/// vector. Like the tree which an AST unfolds to, a node which is reached
+/// more than once is visited every time, so \p Derived must skip them with
+/// shouldTraverse() if the data may be cyclic.
+template <typename Derived, bool IsConst>
+class RecursiveASTVisitorBase : public ASTVisitorBase<Derived, IsConst, bool> {
+  using Base = ASTVisitorBase<Derived, IsConst, bool>;
+
+ public:
+  template <typename T>
+  using Ptr = typename Base::template Ptr<T>;
+
+  /// Walk \p root.
+  /// \return false if a method of \p Derived stopped the walk.
+  bool traverse(Ptr<Node> root);
+
+  bool shouldTraverse(Ptr<Node>) {
+    return true;
+  }
+  bool visitNode(Ptr<Node>) {
+    return true;
+  }
+  bool shouldTraversePostOrder() const {
+    return false;
+  }
+  bool postVisit(Ptr<Node>) {
+    return true;
+  }
+
+ private:
+  /// A node to walk, or when the flag is set, a pair or vector whose parts
+  /// have been walked. The flag is in the pointer to keep the stack small.
+  using Item = llvm::PointerIntPair<Ptr<Node>, 1, bool>;
+};
+
+template <typename Derived, bool IsConst>
+bool RecursiveASTVisitorBase<Derived, IsConst>::traverse(Ptr<Node> root) {
+  Derived &self = this->derived();
+  bool postOrder = self.shouldTraversePostOrder();
+  // The items which remain, the next one last.
+  llvm::SmallVector<Item, 32> stack{Item{root, false}};
+  while (!stack.empty()) {
+    Item item = stack.pop_back_val();
+    Ptr<Node> node = item.getPointer();
+    // Testing postOrder first lets the compiler drop the test of the flag
+    // from the walks which don't use it.
+    if (postOrder && item.getInt()) {
+      if (!self.postVisit(node))
+        return false;
+      continue;
+    }
+
+    if (!self.shouldTraverse(node))
+      continue;
+    if (!self.visit(node))
+      return false;
+
+    if (auto *pair = llvm::dyn_cast<PairNode>(node)) {
+      if (postOrder)
+        stack.push_back(Item{node, true});
+      stack.push_back(Item{pair->getCdr(), false});
+      stack.push_back(Item{pair->getCar(), false});
+    } else if (auto *vec = llvm::dyn_cast<VectorNode>(node)) {
+      if (postOrder)
+        stack.push_back(Item{node, true});
+      auto elements = vec->getElements();
+      for (size_t i = elements.size(); i-- != 0;)
+        stack.push_back(Item{elements[i], false});
+    }
+  }
+  return true;
+}
+
+template <typename Derived>
+using RecursiveASTVisitor = RecursiveASTVisitorBase<Derived, false>;
+template <typename Derived>
+using ConstRecursiveASTVisitor = RecursiveASTVisitorBase<Derived, true>;
+
+} // namespace ast
+} // namespace s2020
+
+#endif // SCHEME2020_AST_ASTVISITOR_H
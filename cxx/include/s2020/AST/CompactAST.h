@@ -0,0 +1,243 @@
+#ifndef SCHEME2020_AST_COMPACTAST_H
+#define SCHEME2020_AST_COMPACTAST_H
+
+#include "s2020/AST/AST.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/ErrorOr.h"
+
+#include <vector>
+
+namespace s2020 {
+namespace ast {
+
+/// A compact, read-only encoding of datums, about half the size of the nodes
+/// they are encoded from, for keeping large amounts of data in memory.
+///
+/// All nodes are stored in one array of 32-bit words and refer to each other
+/// by their offset in it, so a traversal doesn't chase full pointers and
+/// touches fewer cache lines. Source ranges are stored as an offset from the
+/// start of the buffer plus a length, so all datums must come from the same
+/// buffer.
+///
+/// Every node starts with three words: the kind in the low 8 bits and a small
+/// value in the others, the start offset of the source range and its length.
+/// The rest depends on the kind:
+///   - Boolean, Character: nothing, the value is in the first word.
+///   - Number: an exact number which fits in 32 bits, or the index of the
+///     number in a side table, as told by the first word.
+///   - String, Symbol: the index of the identifier in a side table.
+///   - Null: nothing.
+///   - Pair: the car and the cdr.
+///   - Vector: the size and the elements.
+///   - Bytevector: the size and the bytes, padded to a word.
+///
+/// Pairs and vectors which are reached more than once, including cyclic ones,
+/// are encoded once, so sharing is preserved.
+///
+/// Since nothing in the words is a pointer, write() can save the encoding to
+/// a cache file as a versioned image, which load() uses in place once it is
+/// mapped back into memory: a later run can start from the image instead of
+/// parsing the source again. The image is the words, then the datums which
+/// were encoded, then the side tables, with the strings stored as
+/// zero-terminated bytes and the numbers as their bits. It is in host byte
+/// order.
+class CompactAST {
+ public:
+  /// The offset of an encoded node.
+  using NodeRef = uint32_t;
+
+  /// The version of the images written by write(). It must be bumped
+  /// whenever the layout of the image or the encoding of the nodes changes.
+  static constexpr uint32_t kImageVersion = 1;
+
+  /// \param bufferStart the start of the buffer which the source ranges of
+  ///     all encoded nodes point into.
+  explicit CompactAST(const char *bufferStart) : bufferStart_(bufferStart) {}
+
+  CompactAST(CompactAST &&) = default;
+  CompactAST &operator=(CompactAST &&) = default;
+
+  /// Use an image written by write() in place, without copying or decoding
+  /// it. The whole image is checked in one linear pass, so a corrupted cache
+  /// file is rejected instead of making the accessors read out of bounds.
+  ///
+  /// \param image the image, aligned to 4 bytes. It must outlive the result.
+  /// \param source the buffer which the image was written for, which the
+  ///     source ranges point into.
+  /// \return the loaded encoding, or an error if the image is truncated or
+  ///     malformed (illegal_byte_sequence), was written by another version
+  ///     (not_supported), or was written for another source
+  ///     (invalid_argument).
+  static llvm::ErrorOr<CompactAST> load(
+      llvm::StringRef image,
+      llvm::StringRef source);
+
+  /// Encode \p node and everything reachable from it. This is not allowed on
+  /// a loaded image.
+  /// \return the encoded node.
+  NodeRef encode(const Node *node);
+
+  /// Write an image of everything encoded so far, which load() can use in
+  /// place, to \p OS.
+  /// \param source the buffer which the source ranges point into.
+  void write(llvm::raw_ostream &OS, llvm::StringRef source) const;
+
+  /// \return the datums which were encoded, in order.
+  llvm::ArrayRef<NodeRef> getRoots() const {
+    return roots_;
+  }
+
+  /// Decode \p ref into new nodes allocated in \p context, sharing the same
+  /// nodes as the original.
+  Node *decode(ASTContext &context, NodeRef ref) const;
+
+  /// \return the number of bytes used by the encoded nodes and the side
+  ///     tables.
+  size_t getMemorySize() const;
+
+  NodeKind getKind(NodeRef ref) const {
+    return (NodeKind)(words_[ref] & 0xff);
+  }
+  SMRange getSourceRange(NodeRef ref) const;
+
+  bool getBoolean(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Boolean);
+    return getValue(ref);
+  }
+  char32_t getCharacter(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Character);
+    return getValue(ref);
+  }
+  Number getNumber(NodeRef ref) const;
+  /// \return the value of a String or Symbol. This is not allowed on a
+  ///     loaded image, which has no Identifiers: use getString() instead.
+  Identifier getIdentifier(NodeRef ref) const {
+    assert(
+        getKind(ref) == NodeKind::String || getKind(ref) == NodeKind::Symbol);
+    assert(!image_ && "a loaded image has no identifiers");
+    return identifiers_[words_[ref + kHeaderSize]];
+  }
+  /// \return the characters of a String or Symbol, which are followed by a
+  ///     zero.
+  llvm::StringRef getString(NodeRef ref) const {
+    assert(
+        getKind(ref) == NodeKind::String || getKind(ref) == NodeKind::Symbol);
+    uint32_t index = words_[ref + kHeaderSize];
+    if (!image_)
+      return identifiers_[index].str();
+    return {strings_ + stringOffsets_[index],
+            stringOffsets_[index + 1] - stringOffsets_[index] - 1};
+  }
+
+  NodeRef getCar(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Pair);
+    return words_[ref + kHeaderSize];
+  }
+  NodeRef getCdr(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Pair);
+    return words_[ref + kHeaderSize + 1];
+  }
+
+  /// \return the number of elements of a Vector or bytes of a Bytevector.
+  uint32_t getSize(NodeRef ref) const {
+    assert(
+        getKind(ref) == NodeKind::Vector ||
+        getKind(ref) == NodeKind::Bytevector);
+    return words_[ref + kHeaderSize];
+  }
+  llvm::ArrayRef<NodeRef> getElements(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Vector);
+    return {words_.data() + ref + kHeaderSize + 1, getSize(ref)};
+  }
+  llvm::ArrayRef<uint8_t> getBytes(NodeRef ref) const {
+    assert(getKind(ref) == NodeKind::Bytevector);
+    const uint32_t *start = words_.data() + ref + kHeaderSize + 1;
+    return {reinterpret_cast<const uint8_t *>(start), getSize(ref)};
+  }
+
+ private:
+  /// The number of words before the contents of every node.
+  static constexpr unsigned kHeaderSize = 3;
+  /// The start offset of a node without a location.
+  static constexpr uint32_t kNoLocation = UINT32_MAX;
+  /// Set in the value of a Number whose contents is an index into numbers_.
+  static constexpr uint32_t kBoxedNumber = 1;
+  /// The first word of an image.
+  static constexpr uint32_t kImageMagic = 0x54534132; // "2AST"
+
+  /// The header of an image, which is followed by the words, the roots, the
+  /// offsets of the strings, the numbers and the strings.
+  struct ImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    /// The size of the source, and its hashString().
+    uint32_t sourceSize;
+    uint32_t sourceHash;
+    uint32_t numWords;
+    uint32_t numRoots;
+    uint32_t numStrings;
+    uint32_t numNumbers;
+    /// The size of the strings, including their terminators.
+    uint32_t stringBytes;
+  };
+  /// A number in an image: its NumberKind and its bits.
+  struct ImageNumber {
+    uint32_t kind;
+    uint32_t bits[2];
+  };
+
+  CompactAST(const CompactAST &) = delete;
+  CompactAST &operator=(const CompactAST &) = delete;
+
+  /// \return the value stored with the kind.
+  uint32_t getValue(NodeRef ref) const {
+    return words_[ref] >> 8;
+  }
+
+  /// Append the header of \p node and room for \p size more words.
+  /// \return the new node.
+  NodeRef allocate(const Node *node, uint32_t value, size_t size);
+
+  /// \return the index of \p ident in identifiers_, adding it if needed.
+  uint32_t addIdentifier(Identifier ident);
+
+  /// \return the number of words of \p ref after its header.
+  uint64_t getContentSize(NodeRef ref) const;
+
+  /// Check that the nodes and the tables of a loaded image are consistent, so
+  /// the accessors stay in bounds. The sizes come from the image header.
+  bool checkImage(
+      uint32_t sourceSize,
+      uint32_t numStrings,
+      uint32_t numNumbers) const;
+
+  const char *bufferStart_;
+  /// The encoded nodes, in ownedWords_ or in the loaded image.
+  llvm::ArrayRef<uint32_t> words_{};
+  std::vector<uint32_t> ownedWords_{};
+  std::vector<NodeRef> ownedRoots_{};
+  llvm::ArrayRef<NodeRef> roots_{};
+
+  std::vector<Identifier> identifiers_{};
+  /// The index of every identifier in identifiers_.
+  llvm::DenseMap<Identifier, uint32_t> identifierIndex_{};
+  /// The numbers which don't fit in a word.
+  std::vector<Number> numbers_{};
+
+  /// The loaded image, or null if the nodes were encoded here. The side
+  /// tables below point into it.
+  const char *image_ = nullptr;
+  size_t imageSize_ = 0;
+  /// The offsets of the strings in strings_, followed by the size of
+  /// strings_.
+  const uint32_t *stringOffsets_ = nullptr;
+  const char *strings_ = nullptr;
+  const ImageNumber *imageNumbers_ = nullptr;
+};
+
+} // namespace ast
+} // namespace s2020
+
+#endif // SCHEME2020_AST_COMPACTAST_H
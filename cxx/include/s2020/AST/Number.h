@@ -13,6 +13,7 @@ namespace s2020 {
 namespace ast {
 
 class ASTContext;
+class CompactAST;
 
 enum class NumberKind : uint8_t {
   exact,
@@ -70,6 +71,7 @@ class Number {
 
  private:
   friend class ASTContext;
+  friend class CompactAST;
   explicit Number(ExactNumberT exact)
       : kind_(NumberKind::exact), exact_(exact) {}
   explicit Number(InexactNumberT inexact)
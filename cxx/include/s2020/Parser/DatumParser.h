@@ -4,7 +4,9 @@
 #include "s2020/AST/AST.h"
 
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
 
+#include <memory>
 #include <vector>
 
 namespace s2020 {
@@ -16,6 +18,97 @@ llvm::Optional<std::vector<ast::Node *>> parseDatums(
     ast::ASTContext &context,
     const llvm::MemoryBuffer &input);
 
+class TokenStream;
+
+/// Parse datums from a buffer which has already been tokenized by
+/// tokenizeAll(). Lexical errors have already been reported by then, unless
+/// they were deferred, so this only reports syntax errors and the deferred
+/// errors, but it still fails if there were any.
+llvm::Optional<std::vector<ast::Node *>> parseDatums(
+    ast::ASTContext &context,
+    const TokenStream &stream);
+
+/// Parse datums from a token stream like parseDatums(), using up to
+/// \p numThreads threads. The datums, the reported errors and their order
+/// are the same as those of parseDatums().
+///
+/// A quick scan of the token kinds splits the stream between top level datums,
+/// outside of any list or datum comment. The regions are parsed in parallel,
+/// each thread allocating nodes in a private arena which is then moved to
+/// \p context. The errors are reported when the regions are joined in order.
+///
+/// Small streams, and all streams when \p numThreads is 1 or \p context is
+/// hash-consing, are simply passed to parseDatums().
+llvm::Optional<std::vector<ast::Node *>> parseDatumsParallel(
+    ast::ASTContext &context,
+    const TokenStream &stream,
+    unsigned numThreads);
+
+/// Tokenize \p input with tokenizeAllParallel() and parse it with
+/// parseDatumsParallel(). The lexical errors are deferred while tokenizing,
+/// so all errors are reported in the same order as by parseDatums() from the
+/// buffer.
+llvm::Optional<std::vector<ast::Node *>> parseDatumsParallel(
+    ast::ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    unsigned numThreads);
+
+/// Reads the top level datums of an input one at a time, so they can be
+/// processed and freed as soon as each is complete, instead of keeping all of
+/// them until the end like parseDatums().
+///
+/// Errors are reported as by parseDatums(), and reading continues after them,
+/// so the datums read after an error may be the result of error recovery.
+class DatumReader {
+ public:
+  /// Read from \p input, lexing it on demand.
+  DatumReader(ast::ASTContext &context, const llvm::MemoryBuffer &input);
+  /// Read from a buffer which has already been tokenized by tokenizeAll().
+  DatumReader(ast::ASTContext &context, const TokenStream &stream);
+  ~DatumReader();
+
+  /// Parse the next top level datum. The reader keeps no references to the
+  /// nodes of the datums it has returned, so the caller is free to call
+  /// ASTContext::freeNodes() or rewindNodes() between the calls.
+  /// \return the datum, or nullptr at EOF.
+  ast::Node *next();
+
+  /// Free the nodes allocated since \p cp, which must have been taken before
+  /// the reader was created, and when reading from \p input, the strings too.
+  /// Unlike ASTContext::rewind(), this keeps the token the reader has already
+  /// looked at past the last datum, so reading can continue.
+  void rewind(const ast::ASTContext::Checkpoint &cp);
+
+  /// \return whether any errors were reported while reading, including
+  ///     lexical errors reported by tokenizeAll().
+  bool hasErrors() const;
+
+  class Impl;
+
+ private:
+  ast::ASTContext &context_;
+  /// The error count when reading started, before the first token is lexed.
+  unsigned startErrors_;
+  /// Whether the token stream being read had errors.
+  bool streamErrors_ = false;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Parse the datums of \p input, passing each top level datum to \p callback
+/// as soon as it is complete. Reading stops early if \p callback returns
+/// false.
+///
+/// \param freeNodes whether to free the AST nodes and the strings of each
+///     datum after calling \p callback, so that an input of any size is read
+///     in memory proportional to its largest datum. The Identifiers of the
+///     datum must not be used after \p callback returns either.
+/// \return true if there were no errors.
+bool readDatums(
+    ast::ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    llvm::function_ref<bool(ast::Node *)> callback,
+    bool freeNodes = false);
+
 } // namespace parser
 } // namespace s2020
 
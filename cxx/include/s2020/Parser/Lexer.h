@@ -3,6 +3,11 @@
 
 #include "s2020/AST/ASTContext.h"
 
+#include "llvm/ADT/SmallString.h"
+
+#include <string>
+#include <vector>
+
 namespace s2020 {
 namespace parser {
 
@@ -66,6 +71,25 @@ class Token {
     return ident_;
   }
 
+  char32_t getCharacter() const {
+    assert(getKind() == TokenKind::character);
+    return char_;
+  }
+
+  /// \return the decoded contents of a string literal.
+  Identifier getString() const {
+    assert(getKind() == TokenKind::string);
+    return ident_;
+  }
+
+  /// \return the number of a datum label definition "#n=" or reference
+  ///     "#n#".
+  uint32_t getLabel() const {
+    assert(
+        getKind() == TokenKind::label_def || getKind() == TokenKind::label_ref);
+    return label_;
+  }
+
  private:
   void setStart(const char *start) {
     range_.Start = SMLoc::getFromPointer(start);
@@ -77,10 +101,22 @@ class Token {
     kind_ = TokenKind::identifier;
     ident_ = ident;
   }
+  void setString(Identifier str) {
+    kind_ = TokenKind::string;
+    ident_ = str;
+  }
+  void setCharacter(char32_t ch) {
+    kind_ = TokenKind::character;
+    char_ = ch;
+  }
   void setNumber(const Number &n) {
     kind_ = TokenKind::number;
     number_ = n;
   }
+  void setLabel(TokenKind kind, uint32_t label) {
+    kind_ = kind;
+    label_ = label;
+  }
   void setKind(TokenKind kind) {
     kind_ = kind;
   }
@@ -91,15 +127,29 @@ class Token {
   union {
     Identifier ident_;
     Number number_;
+    char32_t char_;
+    uint32_t label_;
   };
 };
 
+/// An error recorded by a Lexer in deferred mode instead of being reported.
+struct DeferredLexerError {
+  SMLoc loc;
+  SMRange range;
+  std::string msg;
+};
+
 class Lexer {
  public:
   /// The last scanned token.
   Token token{};
 
   explicit Lexer(ASTContext &context, const llvm::MemoryBuffer &input);
+
+  /// Scan the range [start, end), which must be zero terminated at \p end.
+  /// The range doesn't have to be registered with the SourceErrorManager, but
+  /// then errors must be deferred with setDeferredErrors().
+  explicit Lexer(ASTContext &context, const char *start, const char *end);
   ~Lexer();
 
   ASTContext &getContext() const {
@@ -111,6 +161,45 @@ class Lexer {
     curCharPtr_ = bufferEnd_;
   }
 
+  /// \return the location where scanning of the next token will start.
+  SMLoc getCurLoc() const {
+    return SMLoc::getFromPointer(curCharPtr_);
+  }
+
+  /// Continue scanning from \p loc, which must be in the input buffer. The
+  /// lexer has no other state, so seeking to the end of a token produced by
+  /// another lexer continues exactly where that lexer would.
+  void seek(SMLoc loc) {
+    assert(
+        loc.getPointer() >= bufferStart_ && loc.getPointer() <= bufferEnd_ &&
+        "seeking outside of the buffer");
+    curCharPtr_ = loc.getPointer();
+  }
+
+  /// Continue scanning at \p start in the new range [start, end), which must
+  /// be zero terminated at \p end. This is used when the input moves in
+  /// memory.
+  void setInput(const char *start, const char *end) {
+    assert(*end == 0 && "input is not zero terminated");
+    bufferStart_ = start;
+    bufferEnd_ = end;
+    curCharPtr_ = start;
+  }
+
+  /// Append errors to \p errors instead of reporting them, or report them
+  /// again if \p errors is null. Deferred errors don't count towards the
+  /// error limit.
+  void setDeferredErrors(std::vector<DeferredLexerError> *errors) {
+    deferredErrors_ = errors;
+  }
+
+  /// In deferred mode, act as if the error limit were reached by the \p n-th
+  /// deferred error, forcing an EOF there. 0 means no limit. This reproduces
+  /// where a lexer reporting the errors would have stopped.
+  void setDeferredErrorLimit(unsigned n) {
+    deferredErrorLimit_ = n;
+  }
+
   /// Consume the current token and scan the next one, which becomes the new
   /// current token.
   void advance();
@@ -118,6 +207,10 @@ class Lexer {
   Identifier getIdentifier(StringRef name) {
     return context_.stringTable.getIdentifier(name);
   }
+  /// Intern \p name, whose hashString() is \p hash.
+  Identifier getIdentifier(StringRef name, unsigned hash) {
+    return context_.stringTable.getIdentifier(name, hash);
+  }
 
   /// Report an error for the range from startLoc to curCharPtr.
   bool errorRange(SMLoc startLoc, const llvm::Twine &msg) {
@@ -161,18 +254,65 @@ class Lexer {
   void _skipUntilDelimiterSlowPath(bool errorReported);
 
   void skipLineComment(const char *start);
+
+  /// Skip a possibly nested block comment.
+  /// \param start points to the '#' of the opening "#|".
+  void skipBlockComment(const char *start);
+
+  /// Parse a character literal.
+  /// \param start points to the '#' of "#\".
+  void parseCharacter(const char *start);
+
+  /// Parse a datum label definition "#n=" or reference "#n#".
+  /// \param start points to the '#'.
+  /// \return false if this is not a datum label, without consuming anything.
+  bool parseDatumLabel(const char *start);
+
+  /// Parse a string literal.
+  /// \param start points to the opening quote.
+  void parseString(const char *start);
+
+  /// The slow path of \c parseString() for strings containing escapes or
+  /// unterminated strings.
+  /// \param start points after the opening quote.
+  /// \param esc points to the first backslash.
+  void _parseEscapedString(const char *start, const char *esc);
+
+  /// Parse a number starting with a radix or exactness prefix.
+  /// \param start points to the '#' of the first prefix.
+  void parseNumberPrefix(const char *start);
+
+  /// Report an error at \p ptr and produce a zero number token ending there.
+  void invalidNumber(const char *ptr, const char *msg);
+
   void parseNumberDigits(
       const char *start,
       llvm::Optional<bool> exact,
       int radix,
       int sign);
 
+  /// Record an error in deferred mode.
+  /// \return false if the deferred error limit has been reached, after
+  ///     forcing an EOF.
+  bool deferError(SMLoc loc, SMRange range, const llvm::Twine &msg);
+
  private:
   ASTContext &context_;
 
   const char *bufferStart_{};
   const char *bufferEnd_{};
   const char *curCharPtr_{};
+
+  /// If not null, errors are appended here instead of being reported.
+  std::vector<DeferredLexerError> *deferredErrors_{};
+  /// The number of deferred errors forcing an EOF, or 0.
+  unsigned deferredErrorLimit_ = 0;
+  /// The number of errors deferred so far, while there is a limit.
+  unsigned numDeferredErrors_ = 0;
+
+  /// Scratch buffer where escaped string literals are decoded before being
+  /// interned, so repeated strings don't keep allocating in the context.
+  llvm::SmallString<64> stringBuf_{};
 };
 
 } // namespace parser
@@ -0,0 +1,34 @@
+#ifndef SCHEME2020_PARSER_PARALLELLEXER_H
+#define SCHEME2020_PARSER_PARALLELLEXER_H
+
+#include "s2020/Parser/TokenStream.h"
+
+namespace s2020 {
+namespace parser {
+
+/// Tokenize \p input like tokenizeAll(), using up to \p numThreads threads.
+/// The result, including the reported errors and their order, is the same as
+/// that of tokenizeAll().
+///
+/// The buffer is split into chunks at line starts. Each chunk is lexed
+/// speculatively from every state it can start in: from its first byte, as
+/// if no token were open, from the end of a string literal open at its
+/// start, and from the end of a block comment open at its start. The chunks
+/// are then stitched in order, picking in each chunk the speculation which
+/// continues where the previous chunk actually ended. If none does, the
+/// lexer catches up serially until it joins the chunk's main speculation.
+///
+/// Small inputs, and all inputs when \p numThreads is 1, are simply passed to
+/// tokenizeAll().
+/// \param deferErrors whether to record the errors in the stream instead of
+///     reporting them, like tokenizeAll().
+TokenStream tokenizeAllParallel(
+    ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    unsigned numThreads,
+    bool deferErrors = false);
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_PARALLELLEXER_H
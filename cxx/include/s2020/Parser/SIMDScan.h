@@ -0,0 +1,63 @@
+#ifndef SCHEME2020_PARSER_SIMDSCAN_H
+#define SCHEME2020_PARSER_SIMDSCAN_H
+
+#include <cstdint>
+
+namespace s2020 {
+namespace parser {
+
+/// The instruction set used by the vectorized scanning routines of the lexer.
+/// The values are ordered, so a higher value implies all lower ones.
+enum class ScanISA : uint8_t {
+  scalar,
+  sse2,
+  ssse3,
+  avx2,
+};
+
+/// \return a human readable name of the ISA.
+const char *scanISAName(ScanISA isa);
+
+/// \return the best ISA supported by the host CPU.
+ScanISA getBestScanISA();
+
+/// \return the ISA currently used by the scanning routines.
+ScanISA getScanISA();
+
+/// Select the ISA used by the scanning routines. A request for an ISA which is
+/// not supported by the host CPU is clamped to the best supported one. The
+/// best ISA is selected automatically at startup, so this is only needed for
+/// testing and benchmarking.
+/// \return the ISA that was actually selected.
+ScanISA setScanISA(ScanISA isa);
+
+/// Skip a run of lexer whitespace starting at \p ptr.
+/// The input must be zero terminated at \p end.
+/// \return a pointer to the first non-whitespace character, which may be
+///     \p end.
+const char *scanWhitespace(const char *ptr, const char *end);
+
+/// Find the first '\r' or '\n' in the range [ptr, end).
+/// \return a pointer to the line terminator, or \p end if there is none.
+const char *scanLineEnd(const char *ptr, const char *end);
+
+/// Find the end of an identifier, in other words the first character starting
+/// from \p ptr which is not in the "Subsequent" character class.
+/// The input must be zero terminated at \p end.
+/// \return a pointer to the first non-Subsequent character, which may be
+///     \p end.
+const char *scanSubsequent(const char *ptr, const char *end);
+
+/// Find the first '"' or '\\' in the range [ptr, end).
+/// \return a pointer to the character, or \p end if there is none.
+const char *scanQuoteOrBackslash(const char *ptr, const char *end);
+
+/// Find the first '|' or '#' in the range [ptr, end). This is used for
+/// skipping block comments.
+/// \return a pointer to the character, or \p end if there is none.
+const char *scanBarOrHash(const char *ptr, const char *end);
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_SIMDSCAN_H
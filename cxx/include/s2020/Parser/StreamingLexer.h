@@ -0,0 +1,140 @@
+#ifndef SCHEME2020_PARSER_STREAMINGLEXER_H
+#define SCHEME2020_PARSER_STREAMINGLEXER_H
+
+#include "s2020/Parser/Lexer.h"
+
+#include <string>
+#include <vector>
+
+namespace s2020 {
+namespace parser {
+
+/// Lexes input which arrives in pieces, like a pipe or a socket, without ever
+/// holding all of it. A token may span any number of pieces.
+///
+/// Only the unconsumed tail of the input is buffered, so the memory used by
+/// the lexer itself is bounded by the largest token plus the largest piece.
+/// Identifiers and strings are still interned in the context, like with any
+/// other lexer.
+///
+/// The input is not registered with the SourceErrorManager, since it doesn't
+/// stay in memory. Tokens have line and column numbers instead, and errors
+/// are reported without a location, with "name:line:col: " prepended to the
+/// message.
+class StreamingLexer {
+ public:
+  /// \param name the name of the input used in error messages.
+  explicit StreamingLexer(ASTContext &context, StringRef name);
+
+  StreamingLexer(const StreamingLexer &) = delete;
+  void operator=(const StreamingLexer &) = delete;
+
+  ASTContext &getContext() const {
+    return context_;
+  }
+
+  /// Append \p data to the input.
+  void addInput(StringRef data);
+
+  /// Mark the end of the input. No more input can be added after this.
+  void endInput();
+
+  /// Scan the next token, if enough input is available.
+  /// \return false if more input is needed to be sure that the token is
+  ///     complete. Then the current token is invalid and advance() must be
+  ///     called again after addInput() or endInput(). After endInput() this
+  ///     always returns true, eventually with a TokenKind::eof token.
+  bool advance();
+
+  /// The last scanned token. Its source range points into an internal buffer
+  /// and is valid only until the next call to addInput() or advance().
+  const Token &token() const {
+    return lex_.token;
+  }
+
+  /// \return the 1-based line of the start of the last token. Lines are
+  ///     counted only when asked for, so tokens nobody asks about cost
+  ///     nothing extra.
+  unsigned getLine() {
+    return coordOfToken().line;
+  }
+  /// \return the 1-based column, in bytes, of the start of the last token.
+  unsigned getColumn() {
+    return (unsigned)(getOffset() - coordOfToken().lineStart + 1);
+  }
+  /// \return the offset in the input of the start of the last token.
+  uint64_t getOffset() const {
+    return offsetOf(lex_.token.getStartLoc().getPointer());
+  }
+
+  /// \return the number of bytes of input held by the lexer, which have been
+  ///     added but not consumed by tokens yet.
+  size_t getBufferedSize() const {
+    return buf_.size() - 1 - pos_;
+  }
+
+ private:
+  const char *bufStart() const {
+    return buf_.data();
+  }
+  const char *bufEnd() const {
+    return buf_.data() + buf_.size() - 1;
+  }
+
+  /// A line in the input.
+  struct Coord {
+    unsigned line;
+    /// The offset in the input of the start of the line.
+    uint64_t lineStart;
+  };
+
+  /// \return the coordinates of \p to, given that \p from is at \p coord.
+  Coord coordAt(Coord coord, const char *from, const char *to) const;
+
+  /// Move coordPos_ to the start of the last token.
+  /// \return its coordinates.
+  const Coord &coordOfToken();
+
+  uint64_t offsetOf(const char *ptr) const {
+    return bufOffset_ + (ptr - bufStart());
+  }
+
+  /// Report the errors recorded while scanning the last token.
+  void reportErrors();
+
+ private:
+  ASTContext &context_;
+  std::string name_;
+
+  /// The unconsumed input, starting at pos_, followed by a zero terminator.
+  /// The consumed prefix is discarded when input is added.
+  std::vector<char> buf_{};
+  /// The offset in the input of the start of buf_.
+  uint64_t bufOffset_ = 0;
+  /// The offset in buf_ where the next token starts.
+  size_t pos_ = 0;
+  /// The coordinates of coordPos_, an offset in buf_ which is never after
+  /// the start of the last token.
+  Coord coord_{1, 0};
+  size_t coordPos_ = 0;
+
+  /// Don't try to scan again before this many bytes are buffered, unless
+  /// the added input contains stopChar_. After an unterminated string or
+  /// block comment, this waits for the buffered input to double, so a long
+  /// one is rescanned only a logarithmic number of times.
+  size_t retrySize_ = 0;
+  /// The character which can complete the incomplete token, or 0 if any
+  /// input can.
+  char stopChar_ = 0;
+  bool inputEnded_ = false;
+  /// Set once the error limit is reached; only eof is produced after that.
+  bool stopped_ = false;
+
+  std::vector<DeferredLexerError> errors_{};
+  Lexer lex_;
+};
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_STREAMINGLEXER_H
@@ -0,0 +1,248 @@
+#ifndef SCHEME2020_PARSER_TOKENSTREAM_H
+#define SCHEME2020_PARSER_TOKENSTREAM_H
+
+#include "s2020/Parser/Lexer.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <vector>
+
+namespace s2020 {
+namespace parser {
+
+/// All tokens of a buffer, stored as parallel arrays indexed by token number.
+/// The last token is always TokenKind::eof.
+///
+/// Every token has a kind, a start offset and a length in the buffer.
+/// Identifiers, strings and numbers additionally have a payload index into
+/// the corresponding side table; the payload of a character is the character
+/// itself, and that of a datum label is its number. Tools that only care
+/// about token kinds or spelling never touch the side tables.
+class TokenStream {
+  friend class ParallelLexer;
+  friend TokenStream tokenizeAll(
+      ast::ASTContext &context,
+      const llvm::MemoryBuffer &input,
+      bool deferErrors);
+
+ public:
+  class Cursor;
+
+  TokenStream(TokenStream &&) = default;
+  TokenStream &operator=(TokenStream &&) = default;
+
+  /// \return the number of tokens, including the final eof.
+  uint32_t size() const {
+    return (uint32_t)kinds_.size();
+  }
+
+  const char *getBufferStart() const {
+    return bufferStart_;
+  }
+
+  /// \return true if lexical errors were reported or deferred while
+  ///     tokenizing.
+  bool hasErrors() const {
+    return hasErrors_;
+  }
+
+  /// The lexical errors which were deferred instead of reported, in order.
+  llvm::ArrayRef<DeferredLexerError> deferredErrors() const {
+    return errors_;
+  }
+  /// deferredErrorTokens()[i] is the index of the token which produced
+  /// deferredErrors()[i].
+  llvm::ArrayRef<uint32_t> deferredErrorTokens() const {
+    return errorTokens_;
+  }
+
+  TokenKind getKind(uint32_t i) const {
+    return kinds_[i];
+  }
+  uint32_t getStartOffset(uint32_t i) const {
+    return starts_[i];
+  }
+  uint32_t getLength(uint32_t i) const {
+    return lengths_[i];
+  }
+
+  SMLoc getStartLoc(uint32_t i) const {
+    return SMLoc::getFromPointer(bufferStart_ + starts_[i]);
+  }
+  SMLoc getEndLoc(uint32_t i) const {
+    return SMLoc::getFromPointer(bufferStart_ + starts_[i] + lengths_[i]);
+  }
+  SMRange getSourceRange(uint32_t i) const {
+    return {getStartLoc(i), getEndLoc(i)};
+  }
+
+  /// \return the source text of token \p i.
+  StringRef inputStr(uint32_t i) const {
+    return StringRef(bufferStart_ + starts_[i], lengths_[i]);
+  }
+
+  const Number &getNumber(uint32_t i) const {
+    assert(getKind(i) == TokenKind::number);
+    return numbers_[payloads_[i]];
+  }
+
+  Identifier getIdentifier(uint32_t i) const {
+    assert(getKind(i) == TokenKind::identifier);
+    return identifiers_[payloads_[i]];
+  }
+
+  char32_t getCharacter(uint32_t i) const {
+    assert(getKind(i) == TokenKind::character);
+    return payloads_[i];
+  }
+
+  /// \return the decoded contents of a string literal.
+  Identifier getString(uint32_t i) const {
+    assert(getKind(i) == TokenKind::string);
+    return identifiers_[payloads_[i]];
+  }
+
+  uint32_t getLabel(uint32_t i) const {
+    assert(
+        getKind(i) == TokenKind::label_def ||
+        getKind(i) == TokenKind::label_ref);
+    return payloads_[i];
+  }
+
+  /// The raw token kinds, for tools that scan them in bulk.
+  llvm::ArrayRef<TokenKind> kinds() const {
+    return kinds_;
+  }
+
+ private:
+  explicit TokenStream(const char *bufferStart) : bufferStart_(bufferStart) {}
+
+  /// Append a copy of the current token of a lexer.
+  void push(const Token &tok);
+
+ private:
+  const char *bufferStart_;
+  bool hasErrors_ = false;
+
+  std::vector<TokenKind> kinds_{};
+  std::vector<uint32_t> starts_{};
+  std::vector<uint32_t> lengths_{};
+  std::vector<uint32_t> payloads_{};
+
+  /// Identifiers and strings.
+  std::vector<Identifier> identifiers_{};
+  std::vector<Number> numbers_{};
+
+  std::vector<DeferredLexerError> errors_{};
+  std::vector<uint32_t> errorTokens_{};
+};
+
+/// A position in a TokenStream, with the same interface as the current token
+/// of a Lexer. It never moves past the final eof.
+///
+/// The deferred errors of a token are reported when the cursor reaches it,
+/// which is when a lexer would have reported them, so the errors of a parser
+/// reading from the cursor come in the same order as with a lexer.
+class TokenStream::Cursor {
+ public:
+  explicit Cursor(ASTContext &context, const TokenStream &stream)
+      : context_(context), stream_(stream) {
+    reportDeferredErrors();
+  }
+
+  ASTContext &getContext() const {
+    return context_;
+  }
+
+  uint32_t getIndex() const {
+    return index_;
+  }
+
+  void advance() {
+    if (index_ + 1 < stream_.size()) {
+      ++index_;
+      if (LLVM_UNLIKELY(nextError_ != stream_.errors_.size()))
+        reportDeferredErrors();
+    }
+  }
+
+  /// Skip to the final eof.
+  void forceEOF() {
+    index_ = stream_.size() - 1;
+    nextError_ = stream_.errors_.size();
+  }
+
+  TokenKind getKind() const {
+    return stream_.getKind(index_);
+  }
+  SMLoc getStartLoc() const {
+    return stream_.getStartLoc(index_);
+  }
+  SMLoc getEndLoc() const {
+    return stream_.getEndLoc(index_);
+  }
+  SMRange getSourceRange() const {
+    return stream_.getSourceRange(index_);
+  }
+  StringRef inputStr() const {
+    return stream_.inputStr(index_);
+  }
+  const Number &getNumber() const {
+    return stream_.getNumber(index_);
+  }
+  Identifier getIdentifier() const {
+    return stream_.getIdentifier(index_);
+  }
+  char32_t getCharacter() const {
+    return stream_.getCharacter(index_);
+  }
+  Identifier getString() const {
+    return stream_.getString(index_);
+  }
+  uint32_t getLabel() const {
+    return stream_.getLabel(index_);
+  }
+
+  /// Report an error using the current token's location. If the maximum
+  /// number of errors has been reached, skip to eof.
+  /// \return false if too many errors have been emitted and we need to abort.
+  bool error(const llvm::Twine &msg) {
+    return error(getSourceRange(), msg);
+  }
+
+  /// Report an error at \p range. If the maximum number of errors has been
+  /// reached, skip to eof.
+  /// \return false if too many errors have been emitted and we need to abort.
+  bool error(SMRange range, const llvm::Twine &msg);
+
+  /// Report a note at \p loc.
+  void note(SMLoc loc, const llvm::Twine &msg) {
+    context_.sm.note(loc, msg);
+  }
+
+ private:
+  /// Report the deferred errors of the current token.
+  void reportDeferredErrors();
+
+ private:
+  ASTContext &context_;
+  const TokenStream &stream_;
+  uint32_t index_ = 0;
+  /// The first deferred error which hasn't been reported.
+  size_t nextError_ = 0;
+};
+
+/// Lex the whole of \p input, reporting lexical errors as they are
+/// encountered. The input must be smaller than 4GB, since token offsets are
+/// 32-bit; a larger input is reported as an error and produces only an eof.
+/// \param deferErrors whether to record the errors in the stream instead,
+///     to be reported by a Cursor.
+TokenStream tokenizeAll(
+    ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    bool deferErrors = false);
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_TOKENSTREAM_H
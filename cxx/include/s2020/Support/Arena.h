@@ -0,0 +1,104 @@
+#ifndef S2020_SUPPORT_ARENA_H
+#define S2020_SUPPORT_ARENA_H
+
+#include "llvm/Support/Compiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace s2020 {
+
+/// A bump pointer allocator like llvm::BumpPtrAllocator, which can also be
+/// rewound to an earlier position, freeing everything allocated since then at
+/// once.
+///
+/// Memory is allocated in slabs, which grow with the number of slabs like in
+/// llvm::BumpPtrAllocator. Rewinding keeps one spare slab after the current
+/// one, so that allocating and rewinding in a loop doesn't go to malloc() every
+/// time, and frees the rest.
+class Arena {
+ public:
+  /// A position in the arena.
+  struct Checkpoint {
+    /// The number of slabs in use.
+    size_t numSlabs;
+    /// The next free byte in the last slab in use.
+    char *cur;
+    /// The number of large allocations.
+    size_t numLarge;
+  };
+
+  Arena() = default;
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(size_t size, size_t alignment) {
+    uintptr_t ptr =
+        ((uintptr_t)cur_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    // Before the first slab, this only succeeds for an empty allocation.
+    if (LLVM_LIKELY(ptr + size <= (uintptr_t)end_)) {
+      cur_ = (char *)(ptr + size);
+      return (void *)ptr;
+    }
+    return allocateSlow(size, alignment);
+  }
+
+  template <typename T>
+  T *Allocate(size_t num = 1) {
+    return static_cast<T *>(Allocate(num * sizeof(T), alignof(T)));
+  }
+
+  /// \return the current position, which can be passed to rewind().
+  Checkpoint checkpoint() const {
+    return Checkpoint{numSlabs_, cur_, large_.size()};
+  }
+
+  /// Free everything allocated since \p cp was taken. \p cp is still valid
+  /// afterwards, but any checkpoints taken after it are not.
+  void rewind(const Checkpoint &cp);
+
+  /// Take over everything allocated in \p other, which becomes empty. It is
+  /// freed when this arena is rewound to a checkpoint taken before.
+  void adopt(Arena &other);
+
+  /// Free everything.
+  void reset() {
+    rewind(Checkpoint{0, nullptr, 0});
+  }
+
+  /// \return the number of bytes in slabs, in use or not. Large allocations
+  ///     are not included.
+  size_t getTotalMemory() const;
+
+ private:
+  /// The size of the first slabs. It doubles every kSlabGrowthDelay slabs.
+  static constexpr size_t kSlabSize = 4096;
+  static constexpr size_t kSlabGrowthDelay = 128;
+  /// Allocations larger than this get their own memory.
+  static constexpr size_t kLargeThreshold = kSlabSize;
+
+  static size_t slabSize(size_t index) {
+    return kSlabSize << std::min<size_t>(index / kSlabGrowthDelay, 30);
+  }
+
+  /// Allocate when the current slab doesn't have enough room.
+  void *allocateSlow(size_t size, size_t alignment);
+
+  /// All slabs, in use or not. Slab i has slabSize(i) bytes.
+  std::vector<char *> slabs_{};
+  /// The number of slabs in use. The last one is being allocated from.
+  size_t numSlabs_ = 0;
+  /// The free space in the last slab in use.
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+  /// Allocations larger than kLargeThreshold, in allocation order.
+  std::vector<void *> large_{};
+};
+
+} // namespace s2020
+
+#endif // S2020_SUPPORT_ARENA_H
@@ -0,0 +1,21 @@
+#ifndef S2020_SUPPORT_CONVERSIONS_H
+#define S2020_SUPPORT_CONVERSIONS_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace s2020 {
+
+/// Convert a decimal real number to the nearest double, rounding ties to even.
+/// \p str must be syntactically valid and unsigned: decimal digits with an
+/// optional decimal point (at least one digit in total), optionally followed
+/// by 'e' or 'E', an optional sign and one or more exponent digits.
+///
+/// Most numbers are converted with the Clinger fast path or with the
+/// Eisel-Lemire algorithm. Only numbers with more than 19 significant digits
+/// which are very close to a rounding boundary need an exact big integer
+/// comparison. No memory is ever allocated.
+double parseDecimalDouble(llvm::StringRef str);
+
+} // namespace s2020
+
+#endif // S2020_SUPPORT_CONVERSIONS_H
@@ -0,0 +1,33 @@
+#ifndef SCHEME2020_SUPPORT_MAPPEDFILE_H
+#define SCHEME2020_SUPPORT_MAPPEDFILE_H
+
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+
+namespace s2020 {
+
+/// Map the file \p path into memory as a zero terminated buffer, without
+/// reading or copying it. Sources are lexed front to back, so the kernel is
+/// advised to read ahead aggressively and to drop pages behind.
+///
+/// The terminator comes for free: the bytes after the end of the file in its
+/// last page read as zero, and if the file ends exactly at a page boundary,
+/// the next page is an anonymous zero page mapped right after it.
+///
+/// Small files, files which can't be mapped (like pipes) and platforms
+/// without mmap fall back to reading the file.
+///
+/// The file must not be truncated while it is mapped, which would crash the
+/// process when the missing pages are touched.
+///
+/// \param hugePages whether to ask for transparent huge pages, which reduce
+///     TLB misses on very large inputs if the kernel supports them for files.
+llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mapSourceFile(
+    const llvm::Twine &path,
+    bool hugePages = false);
+
+} // namespace s2020
+
+#endif // SCHEME2020_SUPPORT_MAPPEDFILE_H
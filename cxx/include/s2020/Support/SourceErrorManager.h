@@ -13,6 +13,7 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SmallBitVector.h"
+#include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/SourceMgr.h"
 
 #include <cassert>
@@ -285,6 +286,15 @@ class SourceErrorManager {
     return sm_.AddNewSourceBuffer(std::move(f), SMLoc{});
   }
 
+  /// Load the file \p path with mapSourceFile() and add it as a source buffer.
+  /// This is the preferred way of loading sources, since large files are
+  /// mapped instead of being read and copied.
+  /// \return the ID of the newly added buffer or the error which prevented
+  ///     loading the file.
+  llvm::ErrorOr<uint32_t> addSourceFile(
+      const llvm::Twine &path,
+      bool hugePages = false);
+
   /// Add a source buffer which maps to a file, but doesn't actually contain any
   /// source.
   /// \param bufferName the LLVM buffer name associated with the buffer. In
@@ -8,9 +8,14 @@
 #ifndef S2020_SUPPORT_STRINGTABLE_H
 #define S2020_SUPPORT_STRINGTABLE_H
 
+#include "s2020/Support/Arena.h"
+
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringRef.h"
 
+#include <cstdint>
+#include <cstring>
+
 namespace llvm {
 class raw_ostream;
 } // namespace llvm
@@ -31,18 +36,71 @@ StringRef zeroTerminate(Allocator &allocator, StringRef str) {
   return StringRef(s, str.size());
 }
 
+/// Load 8 bytes from a possibly unaligned address, in host byte order.
+inline uint64_t loadUnaligned64(const char *p) {
+  uint64_t res;
+  memcpy(&res, p, sizeof(res));
+  return res;
+}
+/// Load 4 bytes from a possibly unaligned address, in host byte order.
+inline uint32_t loadUnaligned32(const char *p) {
+  uint32_t res;
+  memcpy(&res, p, sizeof(res));
+  return res;
+}
+
+/// \return the hash of \p str used by StringTable. It reads the string a
+/// word at a time, with overlapping reads for the tail instead of a loop, since
+/// most strings are short identifiers.
+inline unsigned hashString(StringRef str) {
+  static constexpr uint64_t kMul = 0x9E3779B97F4A7C15ull;
+
+  const char *ptr = str.data();
+  size_t len = str.size();
+  uint64_t hash = len * kMul;
+  if (len > 8) {
+    for (const char *last = ptr + len - 8; ptr < last; ptr += 8)
+      hash = (hash ^ loadUnaligned64(ptr)) * kMul;
+    hash = (hash ^ loadUnaligned64(str.end() - 8)) * kMul;
+  } else if (len >= 4) {
+    uint64_t word = loadUnaligned32(ptr) |
+        (uint64_t)loadUnaligned32(str.end() - 4) << 32;
+    hash = (hash ^ word) * kMul;
+  } else if (len) {
+    hash = (hash ^
+            ((unsigned char)ptr[0] | (unsigned char)ptr[len / 2] << 8 |
+             (unsigned char)ptr[len - 1] << 16)) *
+        kMul;
+  }
+  // The high bits of a product depend on all the lower bits of its inputs,
+  // but not the other way round: fold them back down before the final
+  // multiply, and keep its high half.
+  hash = (hash ^ (hash >> 32)) * kMul;
+  return (unsigned)(hash >> 32);
+}
+
 class UniqueString {
   const StringRef str_;
+  const unsigned hash_;
+  /// The string added to the table before this one.
+  UniqueString *prev_ = nullptr;
+
+  friend class StringTable;
 
   UniqueString(const UniqueString &) = delete;
   UniqueString &operator=(const UniqueString &) = delete;
 
  public:
-  explicit UniqueString(StringRef str) : str_(str){};
+  explicit UniqueString(StringRef str, unsigned hash)
+      : str_(str), hash_(hash){};
 
   const StringRef &str() const {
     return str_;
   }
+  /// \return hashString() of the string.
+  unsigned hash() const {
+    return hash_;
+  }
   const char *c_str() const {
     return str_.begin();
   }
@@ -103,10 +161,71 @@ using llvm::StringRef;
 /// llvm::StringMap it gives us access to the string itself and also provides
 /// convenient zero termination.
 class StringTable {
-  using Allocator = llvm::BumpPtrAllocator;
+  using Allocator = Arena;
   Allocator &allocator_;
 
-  llvm::DenseMap<StringRef, UniqueString *> strMap_{};
+  /// A key of the table: a string and its hash. Keeping the hash in the key
+  /// means that growing the table never rehashes a string, and that probing
+  /// compares hashes before touching the characters.
+  struct Key {
+    const char *data;
+    uint32_t size;
+    uint32_t hash;
+  };
+
+  /// The sizes of the empty and tombstone keys, which no string can have.
+  /// A real key may have a null pointer, for an empty StringRef().
+  static constexpr uint32_t kEmptySize = UINT32_MAX;
+  static constexpr uint32_t kTombstoneSize = UINT32_MAX - 1;
+
+  struct KeyInfo {
+    static Key getEmptyKey() {
+      return Key{nullptr, kEmptySize, 0};
+    }
+    static Key getTombstoneKey() {
+      return Key{nullptr, kTombstoneSize, 0};
+    }
+    static unsigned getHashValue(const Key &key) {
+      return key.hash;
+    }
+    static bool isEqual(const Key &a, const Key &b) {
+      // Neither the empty nor the tombstone key has the size of a string, so
+      // past this point both keys are strings, or the same special key.
+      if (a.hash != b.hash || a.size != b.size)
+        return false;
+      if (a.data == b.data)
+        return true;
+      // Most identifiers are short, so avoid calling memcmp() for them.
+      size_t len = a.size;
+      if (len >= 8 && len <= 16) {
+        return loadUnaligned64(a.data) == loadUnaligned64(b.data) &&
+            loadUnaligned64(a.data + len - 8) ==
+            loadUnaligned64(b.data + len - 8);
+      }
+      if (len >= 4 && len < 8) {
+        return loadUnaligned32(a.data) == loadUnaligned32(b.data) &&
+            loadUnaligned32(a.data + len - 4) ==
+            loadUnaligned32(b.data + len - 4);
+      }
+      // An empty string may have a null pointer, which memcmp() can't take.
+      return len == 0 || memcmp(a.data, b.data, len) == 0;
+    }
+  };
+
+  llvm::DenseMap<Key, UniqueString *, KeyInfo> strMap_{};
+  /// The string added last, the start of a list of all strings linked
+  /// through UniqueString::prev_, so the newest ones can be removed by
+  /// truncate().
+  UniqueString *newest_ = nullptr;
+  /// The number of strings in the table.
+  size_t size_ = 0;
+
+  /// Link \p str, which has just been added to the map, into the list.
+  void link(UniqueString *str) {
+    str->prev_ = newest_;
+    newest_ = str;
+    ++size_;
+  }
 
   StringTable(const StringTable &) = delete;
   StringTable &operator=(const StringTable &_) = delete;
@@ -116,22 +235,51 @@ class StringTable {
 
   /// Return a unique zero-terminated copy of the supplied string \p name.
   UniqueString *getString(StringRef name) {
-    // Already in the map?
-    auto it = strMap_.find(name);
+    return getString(name, hashString(name));
+  }
+
+  /// Return a unique zero-terminated copy of the supplied string \p name,
+  /// whose hashString() has already been computed as \p hash.
+  UniqueString *getString(StringRef name, unsigned hash);
+
+  /// Return a unique string equal to the supplied string \p str, which must
+  /// be zero-terminated and must live at least as long as the table. Unlike
+  /// getString(), the string is not copied when it is added to the table.
+  UniqueString *getStringNoCopy(StringRef str) {
+    assert(str.data()[str.size()] == 0 && "string must be zero terminated");
+    Key key{str.data(), (uint32_t)str.size(), hashString(str)};
+    auto it = strMap_.find(key);
     if (it != strMap_.end())
       return it->second;
 
-    // Allocate a zero-terminated copy of the string
-    auto *str = new (allocator_.Allocate<UniqueString>())
-        UniqueString(zeroTerminate(allocator_, name));
-    strMap_.insert({str->str(), str});
-    return str;
+    auto *ustr =
+        new (allocator_.Allocate<UniqueString>()) UniqueString(str, key.hash);
+    strMap_.insert({key, ustr});
+    link(ustr);
+    return ustr;
   }
 
-  /// A wrapper arond getString() returning an Identifier.
+  /// \return the number of strings in the table, which can be passed to
+  ///     truncate() later.
+  size_t size() const {
+    return size_;
+  }
+
+  /// Remove all strings but the first \p size ones added to the table, so that
+  /// the allocator can be rewound to where it was when the table had \p size
+  /// strings. Their Identifiers must no longer be used.
+  void truncate(size_t size);
+
+  /// A wrapper around getString() returning an Identifier.
   Identifier getIdentifier(StringRef name) {
     return Identifier::getFromPointer(getString(name));
   }
+
+  /// A wrapper around getString() with a precomputed hash returning an
+  /// Identifier.
+  Identifier getIdentifier(StringRef name, unsigned hash) {
+    return Identifier::getFromPointer(getString(name, hash));
+  }
 };
 
 } // namespace s2020
@@ -1,8 +1,16 @@
 #include "s2020/AST/AST.h"
 
+#include "s2020/AST/ASTVisitor.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstring>
+
 using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
@@ -20,18 +28,97 @@ llvm::StringRef nodeKindStr(NodeKind kind) {
   return names[(unsigned)kind];
 }
 
+PairNode *PairNode::create(ASTContext &ctx, Node *car, Node *cdr) {
+  void *mem = ctx.allocateNode(totalSizeToAlloc<Node *>(1), alignof(PairNode));
+  auto *pair = new (mem) PairNode(car, false);
+  pair->setCdr(cdr);
+  return pair;
+}
+
+PairNode *PairNode::createList(
+    ASTContext &ctx,
+    llvm::ArrayRef<Node *> elements,
+    Node *tail) {
+  assert(!elements.empty() && "a list of pairs must have elements");
+  size_t last = elements.size() - 1;
+  size_t size = last * sizeof(PairNode) +
+      (tail ? totalSizeToAlloc<Node *>(1)
+            : sizeof(PairNode) + sizeof(NullNode));
+  auto *pairs =
+      static_cast<PairNode *>(ctx.allocateNode(size, alignof(PairNode)));
+  for (size_t i = 0; i != last; ++i)
+    new (&pairs[i]) PairNode(elements[i], true);
+  if (tail) {
+    new (&pairs[last]) PairNode(elements[last], false);
+    pairs[last].setCdr(tail);
+  } else {
+    new (&pairs[last]) PairNode(elements[last], true);
+    new (&pairs[last + 1]) NullNode();
+  }
+  return pairs;
+}
+
 PairNode *cons(ASTContext &ctx, Node *a, Node *b) {
-  return new (ctx) PairNode(a, b);
+  return PairNode::create(ctx, a, b);
+}
+
+BytevectorNode *BytevectorNode::create(
+    ASTContext &ctx,
+    llvm::ArrayRef<uint8_t> bytes) {
+  void *mem = ctx.allocateNode(
+      totalSizeToAlloc<uint8_t>(bytes.size()), alignof(BytevectorNode));
+  auto *node = new (mem) BytevectorNode(bytes.size());
+  std::copy(bytes.begin(), bytes.end(), node->getTrailingObjects<uint8_t>());
+  return node;
+}
+
+VectorNode *VectorNode::create(
+    ASTContext &ctx,
+    llvm::ArrayRef<Node *> elements) {
+  void *mem = ctx.allocateNode(
+      totalSizeToAlloc<Node *>(elements.size()), alignof(VectorNode));
+  auto *node = new (mem) VectorNode(elements.size());
+  std::copy(
+      elements.begin(), elements.end(), node->getTrailingObjects<Node *>());
+  return node;
 }
 
-#define DECLARE_SIMPLE_AST_EQUAL(name)                                       \
-  static inline bool equal##name(const name##Node *a, const name##Node *b) { \
-    return a->getValue() == b->getValue();                                   \
+namespace {
+
+/// The state of deepEqual().
+struct EqualState {
+  /// The pairs of pairs or vectors which have been reached.
+  llvm::DenseSet<std::pair<const Node *, const Node *>> visited{};
+  /// The parts which were too deep to compare recursively, and remain to be
+  /// compared.
+  llvm::SmallVector<std::pair<const Node *, const Node *>, 32> work{};
+};
+
+} // anonymous namespace
+
+/// How deep deepEqual() recurses into cars, elements and stored cdrs before
+/// it leaves the rest to its worklist, so its stack use is bounded but
+/// typical data is compared without the overhead of the worklist.
+static constexpr unsigned kMaxEqualDepth = 256;
+
+static bool
+equalNode(const Node *a, const Node *b, unsigned depth, EqualState &state);
+
+/// Compare the parts \p a and \p b of two nodes which are being compared at
+/// \p depth.
+static inline bool
+equalPart(const Node *a, const Node *b, unsigned depth, EqualState &state) {
+  if (depth == kMaxEqualDepth) {
+    state.work.emplace_back(a, b);
+    return true;
   }
-#define DECLARE_NOTIMPL_AST_EQUAL(name)                                      \
-  static inline bool equal##name(const name##Node *a, const name##Node *b) { \
-    llvm_unreachable("equal" #name " not implemented");                      \
-    return false;                                                            \
+  return equalNode(a, b, depth + 1, state);
+}
+
+#define DECLARE_SIMPLE_AST_EQUAL(name)                                    \
+  static inline bool equal##name(                                         \
+      const name##Node *a, const name##Node *b, unsigned, EqualState &) { \
+    return a->getValue() == b->getValue();                                \
   }
 
 DECLARE_SIMPLE_AST_EQUAL(Boolean);
@@ -40,35 +127,402 @@ DECLARE_SIMPLE_AST_EQUAL(String);
 DECLARE_SIMPLE_AST_EQUAL(Symbol);
 DECLARE_SIMPLE_AST_EQUAL(Number);
 
-DECLARE_NOTIMPL_AST_EQUAL(Bytevector);
-DECLARE_NOTIMPL_AST_EQUAL(Vector);
+static inline bool equalBytevector(
+    const BytevectorNode *a,
+    const BytevectorNode *b,
+    unsigned,
+    EqualState &) {
+  return a->getBytes() == b->getBytes();
+}
+static inline bool equalVector(
+    const VectorNode *a,
+    const VectorNode *b,
+    unsigned depth,
+    EqualState &state) {
+  if (a->size() != b->size())
+    return false;
+  for (size_t i = 0, e = a->size(); i != e; ++i)
+    if (!equalPart(a->getElement(i), b->getElement(i), depth, state))
+      return false;
+  return true;
+}
 
-static inline bool equalNull(const NullNode *a, const NullNode *b) {
+static inline bool
+equalNull(const NullNode *a, const NullNode *b, unsigned, EqualState &) {
   return true;
 }
-static inline bool equalPair(const PairNode *a, const PairNode *b) {
-  return deepEqual(a->getCar(), b->getCar()) &&
-      deepEqual(a->getCdr(), b->getCdr());
+static inline bool equalPair(
+    const PairNode *a,
+    const PairNode *b,
+    unsigned depth,
+    EqualState &state) {
+  for (;;) {
+    if (!equalPart(a->getCar(), b->getCar(), depth, state))
+      return false;
+    if (!a->isCdrCoded() || !b->isCdrCoded())
+      return equalPart(a->getCdr(), b->getCdr(), depth, state);
+
+    // A CDR-coded cdr is further on in memory, so a cycle can't be made of
+    // them only, and the pairs reached through them need not be remembered.
+    auto *cdrA = dyn_cast<PairNode>(a->getCdr());
+    auto *cdrB = dyn_cast<PairNode>(b->getCdr());
+    if (!cdrA || !cdrB || cdrA == cdrB)
+      return equalPart(a->getCdr(), b->getCdr(), depth, state);
+    a = cdrA;
+    b = cdrB;
+  }
 }
 
-bool deepEqual(const Node *a, const Node *b) {
+/// Compare \p a and \p b, which are \p depth levels below the node which the
+/// worklist started from.
+static bool
+equalNode(const Node *a, const Node *b, unsigned depth, EqualState &state) {
+  if (a == b)
+    return true;
   if (a->getKind() != b->getKind())
     return false;
 
+  // Shared and cyclic data reaches the same two nodes again. They can be
+  // assumed equal, since a difference is found by the first comparison.
+  if ((isa<PairNode>(a) || isa<VectorNode>(a)) &&
+      !state.visited.insert({a, b}).second)
+    return true;
+
   switch (a->getKind()) {
 #define S2020_AST_NODE(name) \
   case NodeKind::name:       \
-    return equal##name(cast<name##Node>(a), cast<name##Node>(b));
+    return equal##name(cast<name##Node>(a), cast<name##Node>(b), depth, state);
 #include "s2020/AST/NodeKinds.def"
     default:
       return true;
   }
 }
 
-static void dump(llvm::raw_ostream &OS, const Node *node, unsigned indent);
+bool deepEqual(const Node *a, const Node *b) {
+  EqualState state{};
+  if (!equalNode(a, b, 0, state))
+    return false;
+  while (!state.work.empty()) {
+    auto item = state.work.pop_back_val();
+    if (!equalNode(item.first, item.second, 0, state))
+      return false;
+  }
+  return true;
+}
 
-static void
-dumpCharacter(llvm::raw_ostream &OS, const CharacterNode *node, unsigned) {
+/// The multiplier which mixes the parts of a hash, as in hashString().
+static constexpr uint64_t kHashMul = 0x9E3779B97F4A7C15ull;
+
+/// \return \p hash with \p value mixed in.
+static uint64_t mixHash(uint64_t hash, uint64_t value) {
+  return (hash ^ value) * kHashMul;
+}
+
+/// \return a hash of the value of \p node, which is not a pair or a vector.
+static uint64_t hashAtom(const Node *node) {
+  auto kind = (uint64_t)node->getKind();
+  switch (node->getKind()) {
+    case NodeKind::Boolean:
+      return mixHash(kind, cast<BooleanNode>(node)->getValue());
+    case NodeKind::Character:
+      return mixHash(kind, cast<CharacterNode>(node)->getValue());
+    case NodeKind::Number: {
+      // Numbers are equal if they have the same bit pattern.
+      const Number &num = cast<NumberNode>(node)->getValue();
+      uint64_t bits;
+      if (num.isExact()) {
+        bits = (uint64_t)num.getExact();
+      } else {
+        InexactNumberT inexact = num.getInexact();
+        memcpy(&bits, &inexact, sizeof(bits));
+      }
+      return mixHash(mixHash(kind, (uint64_t)num.getKind()), bits);
+    }
+    case NodeKind::String:
+      return mixHash(
+          kind,
+          (uintptr_t)cast<StringNode>(node)->getValue().getUnderlyingPointer());
+    case NodeKind::Symbol:
+      return mixHash(
+          kind,
+          (uintptr_t)cast<SymbolNode>(node)->getValue().getUnderlyingPointer());
+    case NodeKind::Bytevector: {
+      auto bytes = cast<BytevectorNode>(node)->getBytes();
+      return mixHash(
+          kind,
+          hashString(llvm::StringRef(
+              reinterpret_cast<const char *>(bytes.data()), bytes.size())));
+    }
+    default:
+      return kind;
+  }
+}
+
+/// \return the hash of a pair or a vector, before the hashes of its parts
+///     are mixed into it.
+static uint64_t startHash(const Node *node) {
+  auto kind = (uint64_t)node->getKind();
+  if (auto *vec = dyn_cast<VectorNode>(node))
+    return mixHash(kind, vec->size());
+  return kind;
+}
+
+/// \return \p hash as the hash of a datum, which is never 0.
+static unsigned finishHash(uint64_t hash) {
+  // Fold the high bits down before the last multiply, like hashString().
+  hash = (hash ^ (hash >> 32)) * kHashMul;
+  auto res = (unsigned)(hash >> 32);
+  return res ? res : 1;
+}
+
+/// \return the part \p index of a pair or a vector, or nullptr after the
+///     last one.
+static const Node *getPart(const Node *node, size_t index) {
+  if (auto *pair = dyn_cast<PairNode>(node)) {
+    if (index == 0)
+      return pair->getCar();
+    return index == 1 ? pair->getCdr() : nullptr;
+  }
+  auto *vec = cast<VectorNode>(node);
+  return index < vec->size() ? vec->getElement(index) : nullptr;
+}
+
+/// \return a hash of the first nodes of the infinite tree which the cyclic
+///     \p node unfolds to, which is the same for cyclic ASTs which are
+///     deepEqual(), however they are made.
+static unsigned hashUnfolding(const Node *node) {
+  static constexpr unsigned kMaxNodes = 64;
+  uint64_t hash = 0;
+  llvm::SmallVector<const Node *, 32> stack{node};
+  for (unsigned i = 0; i != kMaxNodes && !stack.empty(); ++i) {
+    node = stack.pop_back_val();
+    if (auto *pair = dyn_cast<PairNode>(node)) {
+      hash = mixHash(hash, startHash(node));
+      stack.push_back(pair->getCdr());
+      stack.push_back(pair->getCar());
+    } else if (auto *vec = dyn_cast<VectorNode>(node)) {
+      hash = mixHash(hash, startHash(node));
+      auto elements = vec->getElements();
+      stack.append(elements.rbegin(), elements.rend());
+    } else {
+      hash = mixHash(hash, hashAtom(node));
+    }
+  }
+  return finishHash(hash);
+}
+
+unsigned hashDatum(const Node *node) {
+  if (unsigned hash = node->getInternedHash())
+    return hash;
+  if (!isa<PairNode>(node) && !isa<VectorNode>(node))
+    return finishHash(hashAtom(node));
+
+  // The pairs and vectors whose parts are being hashed, without recursing.
+  struct Pending {
+    const Node *node;
+    size_t nextPart;
+    uint64_t hash;
+  };
+  llvm::SmallVector<Pending, 32> stack{};
+  // The hash of every pair and vector reached, or 0 while it is pending, so
+  // shared data is hashed once and cyclic data is found.
+  llvm::DenseMap<const Node *, unsigned> hashes{};
+
+  hashes[node] = 0;
+  stack.push_back(Pending{node, 0, startHash(node)});
+  for (;;) {
+    Pending &top = stack.back();
+    const Node *part = getPart(top.node, top.nextPart++);
+    if (!part) {
+      unsigned hash = finishHash(top.hash);
+      hashes[top.node] = hash;
+      stack.pop_back();
+      if (stack.empty())
+        return hash;
+      stack.back().hash = mixHash(stack.back().hash, hash);
+      continue;
+    }
+
+    unsigned hash = part->getInternedHash();
+    if (!hash && !isa<PairNode>(part) && !isa<VectorNode>(part)) {
+      hash = finishHash(hashAtom(part));
+    } else if (!hash) {
+      auto res = hashes.try_emplace(part, 0);
+      if (res.second) {
+        stack.push_back(Pending{part, 0, startHash(part)});
+        continue;
+      }
+      // Cyclic data can only be equal to cyclic data, which is hashed
+      // differently.
+      if (!res.first->second)
+        return hashUnfolding(node);
+      hash = res.first->second;
+    }
+    top.hash = mixHash(top.hash, hash);
+  }
+}
+
+Node *ASTContext::intern(Node *node) {
+  unsigned hash;
+  if (auto *pair = dyn_cast<PairNode>(node)) {
+    // Hash the pairs of a CDR-coded list from the last one, whose cdr is
+    // stored or is the empty list after it. Only the first pair is interned,
+    // so the hashes of the others are not kept.
+    llvm::SmallVector<PairNode *, 8> pairs{pair};
+    while (pair->isCdrCoded() && isa<PairNode>(pair->getCdr())) {
+      pair = cast<PairNode>(pair->getCdr());
+      pairs.push_back(pair);
+    }
+    Node *last = pair->getCdr();
+    hash = pair->isCdrCoded() ? finishHash(hashAtom(last)) : last->hash_;
+    if (!hash)
+      return node;
+    for (PairNode *cur : pairs)
+      if (!cur->getCar()->hash_)
+        return node;
+    for (size_t i = pairs.size(); i-- != 0;) {
+      hash = finishHash(mixHash(
+          mixHash(startHash(pairs[i]), pairs[i]->getCar()->hash_), hash));
+    }
+  } else if (auto *vec = dyn_cast<VectorNode>(node)) {
+    uint64_t code = startHash(vec);
+    for (Node *element : vec->getElements()) {
+      if (!element->hash_)
+        return node;
+      code = mixHash(code, element->hash_);
+    }
+    hash = finishHash(code);
+  } else {
+    hash = finishHash(hashAtom(node));
+  }
+
+  node->hash_ = hash;
+  auto res = interned_.insert(InternKey{node, hash});
+  if (res.second)
+    internOrder_.push_back(node);
+  return res.first->node;
+}
+
+bool ASTContext::InternKeyInfo::equalContents(const Node *a, const Node *b) {
+  if (a->getKind() != b->getKind())
+    return false;
+
+  switch (a->getKind()) {
+    case NodeKind::Pair: {
+      // The cars are interned, so they are equal only if they are the same,
+      // but the pairs after the first one are not.
+      auto *pairA = cast<PairNode>(a);
+      auto *pairB = cast<PairNode>(b);
+      for (;;) {
+        if (pairA->getCar() != pairB->getCar())
+          return false;
+        const Node *cdrA = pairA->getCdr();
+        const Node *cdrB = pairB->getCdr();
+        if (cdrA == cdrB)
+          return true;
+        pairA = dyn_cast<PairNode>(cdrA);
+        pairB = dyn_cast<PairNode>(cdrB);
+        if (!pairA || !pairB)
+          return !pairA && !pairB && isa<NullNode>(cdrA) && isa<NullNode>(cdrB);
+      }
+    }
+    case NodeKind::Vector:
+      return cast<VectorNode>(a)->getElements() ==
+          cast<VectorNode>(b)->getElements();
+    default:
+      return deepEqual(a, b);
+  }
+}
+
+namespace {
+
+/// A pair or vector which is being printed by dump().
+struct DumpFrame {
+  /// The vector, or the pair of a list whose car was printed last.
+  const Node *node;
+  /// The index of the next element of a vector. For a list, 0 before the
+  /// first car is printed, 1 while the cars are printed and 2 once the cdr
+  /// after the period is.
+  size_t next;
+  unsigned indent;
+};
+
+/// The state of dump().
+struct DumpState {
+  /// The label of every pair and vector which is reached more than once, or
+  /// -1 before it is printed, so shared and cyclic data is printed once.
+  llvm::DenseMap<const Node *, int> labels{};
+  int nextLabel = 0;
+  /// The pairs and vectors being printed, the innermost last.
+  llvm::SmallVector<DumpFrame, 16> stack{};
+
+  /// Find the shared nodes reachable from \p root.
+  explicit DumpState(const Node *root);
+};
+
+/// Finds the pairs and vectors which are reached more than once.
+class SharedFinder : public ConstRecursiveASTVisitor<SharedFinder> {
+ public:
+  /// Whether every pair and vector has been reached more than once.
+  llvm::DenseMap<const Node *, bool> shared{};
+
+  bool shouldTraverse(const Node *node) {
+    // Atoms are printed as often as they are reached.
+    if (!isa<PairNode>(node) && !isa<VectorNode>(node))
+      return false;
+    // The parts are walked the first time only.
+    auto res = shared.try_emplace(node, false);
+    if (!res.second)
+      res.first->second = true;
+    return res.second;
+  }
+};
+
+/// Buffers the output of dump() to an unbuffered stream, such as errs(), so
+/// it isn't written a token at a time.
+class BufferedOStream : public llvm::raw_ostream {
+ public:
+  explicit BufferedOStream(llvm::raw_ostream &OS) : OS_(OS) {
+    SetBufferSize(64 * 1024);
+  }
+  ~BufferedOStream() override {
+    flush();
+  }
+
+ private:
+  void write_impl(const char *ptr, size_t size) override {
+    OS_.write(ptr, size);
+  }
+  uint64_t current_pos() const override {
+    return OS_.tell();
+  }
+
+  llvm::raw_ostream &OS_;
+};
+
+} // anonymous namespace
+
+DumpState::DumpState(const Node *root) {
+  SharedFinder finder{};
+  finder.traverse(root);
+  for (const auto &entry : finder.shared)
+    if (entry.second)
+      labels[entry.first] = -1;
+}
+
+/// Print \p node, or if it is a pair or a vector, only start it and push it
+/// on the stack.
+static void dump(
+    llvm::raw_ostream &OS,
+    const Node *node,
+    unsigned indent,
+    DumpState &state);
+
+static void dumpCharacter(
+    llvm::raw_ostream &OS,
+    const CharacterNode *node,
+    unsigned,
+    DumpState &) {
   char32_t ch = cast<CharacterNode>(node)->getValue();
   OS << "#\\";
 
@@ -83,13 +537,16 @@ dumpCharacter(llvm::raw_ostream &OS, const CharacterNode *node, unsigned) {
       if (ch > 32 && ch < 127)
         OS.write((unsigned char)ch);
       else
-        OS << llvm::format("0x%x", ch);
+        OS << llvm::format("x%x", ch);
       break;
   }
 }
 
-static void
-dumpSymbol(llvm::raw_ostream &OS, const SymbolNode *node, unsigned) {
+static void dumpSymbol(
+    llvm::raw_ostream &OS,
+    const SymbolNode *node,
+    unsigned,
+    DumpState &) {
   // TODO: utf-8
   llvm::StringRef str = node->getValue().str();
   // Do we need to escape it?
@@ -144,58 +601,86 @@ static void dumpIndent(llvm::raw_ostream &OS, unsigned indent) {
   OS << llvm::left_justify("", indent * 4);
 }
 
-static void
-dumpPair(llvm::raw_ostream &OS, const PairNode *node, unsigned indent) {
+static void dumpPair(
+    llvm::raw_ostream &OS,
+    const PairNode *node,
+    unsigned indent,
+    DumpState &state) {
   OS << "(";
-  dump(OS, node->getCar(), indent + 1);
-
-  while (auto *next = dyn_cast<PairNode>(node->getCdr())) {
-    node = next;
-    OS << "\n";
-    dumpIndent(OS, indent + 1);
-    dump(OS, node->getCar(), indent + 1);
-  }
-
-  if (!isa<NullNode>(node->getCdr())) {
-    OS << " . ";
-    dump(OS, node->getCdr(), indent + 1);
-  }
-
-  OS << ")";
+  state.stack.push_back(DumpFrame{node, 0, indent});
 }
 
-static void
-dumpBoolean(llvm::raw_ostream &OS, const BooleanNode *node, unsigned) {
+static void dumpBoolean(
+    llvm::raw_ostream &OS,
+    const BooleanNode *node,
+    unsigned,
+    DumpState &) {
   OS << (node->getValue() ? "#t" : "#f");
 }
-static void
-dumpNumber(llvm::raw_ostream &OS, const NumberNode *node, unsigned) {
+static void dumpNumber(
+    llvm::raw_ostream &OS,
+    const NumberNode *node,
+    unsigned,
+    DumpState &) {
   OS << node->getValue();
 }
-static void
-dumpString(llvm::raw_ostream &OS, const StringNode *node, unsigned) {
+static void dumpString(
+    llvm::raw_ostream &OS,
+    const StringNode *node,
+    unsigned,
+    DumpState &) {
   // TODO: utf-8
   OS.write('"');
   OS.write_escaped(node->getValue().str(), true);
   OS.write('"');
 }
-static void
-dumpBytevector(llvm::raw_ostream &OS, const BytevectorNode *node, unsigned) {
-  llvm_unreachable("not implemented");
+static void dumpBytevector(
+    llvm::raw_ostream &OS,
+    const BytevectorNode *node,
+    unsigned,
+    DumpState &) {
+  OS << "#u8(";
+  bool first = true;
+  for (uint8_t byte : node->getBytes()) {
+    if (!first)
+      OS << " ";
+    first = false;
+    OS << (unsigned)byte;
+  }
+  OS << ")";
 }
-static void
-dumpVector(llvm::raw_ostream &OS, const VectorNode *node, unsigned) {
-  llvm_unreachable("not implemented");
+static void dumpVector(
+    llvm::raw_ostream &OS,
+    const VectorNode *node,
+    unsigned indent,
+    DumpState &state) {
+  OS << "#(";
+  state.stack.push_back(DumpFrame{node, 0, indent});
 }
-static void dumpNull(llvm::raw_ostream &OS, const NullNode *, unsigned) {
+static void
+dumpNull(llvm::raw_ostream &OS, const NullNode *, unsigned, DumpState &) {
   OS << "()";
 }
 
-static void dump(llvm::raw_ostream &OS, const Node *node, unsigned indent) {
+static void dump(
+    llvm::raw_ostream &OS,
+    const Node *node,
+    unsigned indent,
+    DumpState &state) {
+  auto it = state.labels.find(node);
+  if (it != state.labels.end()) {
+    if (it->second >= 0) {
+      OS << "#" << it->second << "#";
+      return;
+    }
+    it->second = state.nextLabel++;
+    OS << "#" << it->second << "=";
+  }
+
   switch (node->getKind()) {
-#define S2020_AST_NODE(name)                        \
-  case NodeKind::name:                              \
-    dump##name(OS, cast<name##Node>(node), indent); \
+#define S2020_AST_NODE(name)                                \
+  case NodeKind::name:                                      \
+    dump##name(OS, cast<name##Node>(node), indent, state);  \
     break;
 #include "s2020/AST/NodeKinds.def"
     default:
@@ -203,8 +688,78 @@ static void dump(llvm::raw_ostream &OS, const Node *node, unsigned indent) {
   }
 }
 
+/// Print the rest of the innermost pair or vector on the stack, up to its
+/// next part which is a pair or a vector.
+static void dumpNext(llvm::raw_ostream &OS, DumpState &state) {
+  DumpFrame &frame = state.stack.back();
+  unsigned indent = frame.indent;
+
+  if (auto *vec = dyn_cast<VectorNode>(frame.node)) {
+    if (frame.next == vec->size()) {
+      OS << ")";
+      state.stack.pop_back();
+      return;
+    }
+    if (frame.next) {
+      OS << "\n";
+      dumpIndent(OS, indent + 1);
+    }
+    // The frame may move when the element is pushed.
+    const Node *element = vec->getElement(frame.next++);
+    dump(OS, element, indent + 1, state);
+    return;
+  }
+
+  if (frame.next == 0) {
+    frame.next = 1;
+    dump(OS, cast<PairNode>(frame.node)->getCar(), indent + 1, state);
+    return;
+  }
+  if (frame.next == 2) {
+    OS << ")";
+    state.stack.pop_back();
+    return;
+  }
+  // Print the cars of the list up to the next pair or vector. A shared pair
+  // in the tail is printed after a period, with its label.
+  for (;;) {
+    const Node *cdr = cast<PairNode>(frame.node)->getCdr();
+    auto *next = dyn_cast<PairNode>(cdr);
+    if (!next || state.labels.count(next)) {
+      if (isa<NullNode>(cdr)) {
+        OS << ")";
+        state.stack.pop_back();
+      } else {
+        OS << " . ";
+        frame.next = 2;
+        dump(OS, cdr, indent + 1, state);
+      }
+      return;
+    }
+
+    frame.node = next;
+    OS << "\n";
+    dumpIndent(OS, indent + 1);
+    const Node *car = next->getCar();
+    dump(OS, car, indent + 1, state);
+    // The car may have been pushed, moving the frame.
+    if (isa<PairNode>(car) || isa<VectorNode>(car))
+      return;
+  }
+}
+
 void dump(llvm::raw_ostream &OS, const Node *node) {
-  dump(OS, node, 0);
+  // An unbuffered stream would be written a token at a time.
+  if (!OS.GetBufferSize()) {
+    BufferedOStream buffered{OS};
+    dump(buffered, node);
+    return;
+  }
+
+  DumpState state{node};
+  dump(OS, node, 0, state);
+  while (!state.stack.empty())
+    dumpNext(OS, state);
   OS << "\n";
 }
 
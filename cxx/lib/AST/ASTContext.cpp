@@ -1,10 +1,54 @@
 #include "s2020/AST/ASTContext.h"
 
+#include "s2020/AST/AST.h"
+
 namespace s2020 {
 namespace ast {
 
-ASTContext::ASTContext() = default;
+ASTContext::ASTContext() {
+  // The shared nodes live as long as the context, so they are not allocated
+  // in the node arena.
+  auto makeSymbol = [this](llvm::StringRef name) -> Node * {
+    return new (allocator.Allocate<SymbolNode>())
+        SymbolNode(stringTable.getIdentifier(name));
+  };
+  sharedNodes_.quote = makeSymbol("quote");
+  sharedNodes_.quasiquote = makeSymbol("quasiquote");
+  sharedNodes_.unquote = makeSymbol("unquote");
+  sharedNodes_.unquoteSplicing = makeSymbol("unquote-splicing");
+  sharedNodes_.null = new (allocator.Allocate<NullNode>()) NullNode();
+
+  // Interned first, so they are never removed.
+  intern(sharedNodes_.quote);
+  intern(sharedNodes_.quasiquote);
+  intern(sharedNodes_.unquote);
+  intern(sharedNodes_.unquoteSplicing);
+  intern(sharedNodes_.null);
+  numSharedInterned_ = internOrder_.size();
+}
+
 ASTContext::~ASTContext() = default;
 
+void ASTContext::adoptNodes(ASTContext &other) {
+  // The shared nodes of the other context are not adopted.
+  for (size_t i = other.numSharedInterned_, e = other.internOrder_.size();
+       i != e;
+       ++i) {
+    Node *node = other.internOrder_[i];
+    if (interned_.insert(InternKey{node, node->hash_}).second)
+      internOrder_.push_back(node);
+  }
+  other.truncateInterned(other.numSharedInterned_);
+  nodeArena_.adopt(other.nodeArena_);
+}
+
+void ASTContext::truncateInterned(size_t size) {
+  while (internOrder_.size() > size) {
+    Node *node = internOrder_.back();
+    interned_.erase(InternKey{node, node->hash_});
+    internOrder_.pop_back();
+  }
+}
+
 } // namespace ast
 } // namespace s2020
@@ -0,0 +1,451 @@
+#include "s2020/AST/CompactAST.h"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+namespace s2020 {
+namespace ast {
+
+CompactAST::NodeRef
+CompactAST::allocate(const Node *node, uint32_t value, size_t size) {
+  assert(value < (1u << 24) && "value doesn't fit with the kind");
+  if (ownedWords_.size() + kHeaderSize + size > UINT32_MAX)
+    llvm::report_fatal_error("compact AST is too large");
+
+  auto ref = (NodeRef)ownedWords_.size();
+  ownedWords_.resize(ownedWords_.size() + kHeaderSize + size);
+  words_ = ownedWords_;
+  ownedWords_[ref] = (uint32_t)node->getKind() | (value << 8);
+
+  SMRange rng = node->getSourceRange();
+  if (rng.isValid()) {
+    assert(
+        rng.Start.getPointer() >= bufferStart_ &&
+        rng.End.getPointer() - bufferStart_ < kNoLocation &&
+        "location is outside of the buffer");
+    ownedWords_[ref + 1] = (uint32_t)(rng.Start.getPointer() - bufferStart_);
+    ownedWords_[ref + 2] =
+        (uint32_t)(rng.End.getPointer() - rng.Start.getPointer());
+  } else {
+    ownedWords_[ref + 1] = kNoLocation;
+  }
+  return ref;
+}
+
+uint32_t CompactAST::addIdentifier(Identifier ident) {
+  auto it = identifierIndex_.insert({ident, (uint32_t)identifiers_.size()});
+  if (it.second)
+    identifiers_.push_back(ident);
+  return it.first->second;
+}
+
+CompactAST::NodeRef CompactAST::encode(const Node *node) {
+  assert(!image_ && "a loaded image can't be extended");
+  // The pairs and vectors which have already been encoded.
+  llvm::DenseMap<const Node *, NodeRef> encoded{};
+  // The nodes still to encode, and the word which refers to each of them.
+  llvm::SmallVector<std::pair<const Node *, uint32_t>, 32> stack{};
+
+  auto encodeOne = [this, &encoded, &stack](const Node *node) -> NodeRef {
+    NodeRef ref;
+    switch (node->getKind()) {
+      case NodeKind::Boolean:
+        return allocate(node, llvm::cast<BooleanNode>(node)->getValue(), 0);
+      case NodeKind::Character:
+        return allocate(node, llvm::cast<CharacterNode>(node)->getValue(), 0);
+      case NodeKind::Number: {
+        const Number &num = llvm::cast<NumberNode>(node)->getValue();
+        if (num.isExact() && num.getExact() == (int32_t)num.getExact()) {
+          ref = allocate(node, 0, 1);
+          ownedWords_[ref + kHeaderSize] = (uint32_t)num.getExact();
+        } else {
+          ref = allocate(node, kBoxedNumber, 1);
+          ownedWords_[ref + kHeaderSize] = (uint32_t)numbers_.size();
+          numbers_.push_back(num);
+        }
+        return ref;
+      }
+      case NodeKind::String:
+        ref = allocate(node, 0, 1);
+        ownedWords_[ref + kHeaderSize] =
+            addIdentifier(llvm::cast<StringNode>(node)->getValue());
+        return ref;
+      case NodeKind::Symbol:
+        ref = allocate(node, 0, 1);
+        ownedWords_[ref + kHeaderSize] =
+            addIdentifier(llvm::cast<SymbolNode>(node)->getValue());
+        return ref;
+      case NodeKind::Null:
+        return allocate(node, 0, 0);
+      case NodeKind::Bytevector: {
+        auto bytes = llvm::cast<BytevectorNode>(node)->getBytes();
+        ref = allocate(node, 0, 1 + (bytes.size() + 3) / 4);
+        ownedWords_[ref + kHeaderSize] = (uint32_t)bytes.size();
+        if (!bytes.empty())
+          memcpy(
+              &ownedWords_[ref + kHeaderSize + 1], bytes.data(), bytes.size());
+        return ref;
+      }
+      case NodeKind::Vector: {
+        auto it = encoded.find(node);
+        if (it != encoded.end())
+          return it->second;
+        auto elements = llvm::cast<VectorNode>(node)->getElements();
+        ref = allocate(node, 0, 1 + elements.size());
+        encoded[node] = ref;
+        ownedWords_[ref + kHeaderSize] = (uint32_t)elements.size();
+        // Push them in reverse, so they are encoded in order.
+        for (size_t i = elements.size(); i-- != 0;)
+          stack.emplace_back(elements[i], ref + kHeaderSize + 1 + i);
+        return ref;
+      }
+      case NodeKind::Pair: {
+        auto it = encoded.find(node);
+        if (it != encoded.end())
+          return it->second;
+        auto *pair = llvm::cast<PairNode>(node);
+        ref = allocate(node, 0, 2);
+        encoded[node] = ref;
+        // Encode the car first, so it is next to the pair.
+        stack.emplace_back(pair->getCdr(), ref + kHeaderSize + 1);
+        stack.emplace_back(pair->getCar(), ref + kHeaderSize);
+        return ref;
+      }
+      case NodeKind::_end:
+        break;
+    }
+    llvm_unreachable("invalid node kind");
+  };
+
+  NodeRef root = encodeOne(node);
+  while (!stack.empty()) {
+    auto item = stack.pop_back_val();
+    // Evaluate this first, since it may grow words_.
+    NodeRef ref = encodeOne(item.first);
+    ownedWords_[item.second] = ref;
+  }
+  ownedRoots_.push_back(root);
+  roots_ = ownedRoots_;
+  return root;
+}
+
+Node *CompactAST::decode(ASTContext &context, NodeRef ref) const {
+  // The pairs and vectors which have already been decoded.
+  llvm::DenseMap<NodeRef, Node *> decoded{};
+  // A node still to decode, and the pair or vector which refers to it.
+  struct Item {
+    NodeRef ref;
+    Node *parent;
+    /// 0 for the car and 1 for the cdr of a pair, or the index in a vector.
+    size_t index;
+  };
+  llvm::SmallVector<Item, 32> stack{};
+
+  auto decodeOne = [this, &context, &decoded, &stack](NodeRef ref) -> Node * {
+    Node *node;
+    switch (getKind(ref)) {
+      case NodeKind::Boolean:
+        node = new (context) BooleanNode(getBoolean(ref));
+        break;
+      case NodeKind::Character:
+        node = new (context) CharacterNode(getCharacter(ref));
+        break;
+      case NodeKind::Number:
+        node = new (context) NumberNode(getNumber(ref));
+        break;
+      case NodeKind::String:
+        node = new (context) StringNode(
+            image_ ? context.stringTable.getIdentifier(getString(ref))
+                   : getIdentifier(ref));
+        break;
+      case NodeKind::Symbol:
+        node = new (context) SymbolNode(
+            image_ ? context.stringTable.getIdentifier(getString(ref))
+                   : getIdentifier(ref));
+        break;
+      case NodeKind::Null:
+        node = new (context) NullNode();
+        break;
+      case NodeKind::Bytevector:
+        node = BytevectorNode::create(context, getBytes(ref));
+        break;
+      case NodeKind::Vector: {
+        auto it = decoded.find(ref);
+        if (it != decoded.end())
+          return it->second;
+        auto elements = getElements(ref);
+        llvm::SmallVector<Node *, 8> placeholders(elements.size(), nullptr);
+        node = VectorNode::create(context, placeholders);
+        decoded[ref] = node;
+        for (size_t i = elements.size(); i-- != 0;)
+          stack.push_back(Item{elements[i], node, i});
+        break;
+      }
+      case NodeKind::Pair: {
+        auto it = decoded.find(ref);
+        if (it != decoded.end())
+          return it->second;
+        node = PairNode::create(context, nullptr, nullptr);
+        decoded[ref] = node;
+        stack.push_back(Item{getCdr(ref), node, 1});
+        stack.push_back(Item{getCar(ref), node, 0});
+        break;
+      }
+      case NodeKind::_end:
+        llvm_unreachable("invalid node kind");
+    }
+    node->setSourceRange(getSourceRange(ref));
+    return node;
+  };
+
+  Node *root = decodeOne(ref);
+  while (!stack.empty()) {
+    Item item = stack.pop_back_val();
+    Node *node = decodeOne(item.ref);
+    if (auto *pair = llvm::dyn_cast<PairNode>(item.parent)) {
+      if (item.index == 0)
+        pair->setCar(node);
+      else
+        pair->setCdr(node);
+    } else {
+      llvm::cast<VectorNode>(item.parent)->setElement(item.index, node);
+    }
+  }
+  return root;
+}
+
+llvm::ErrorOr<CompactAST> CompactAST::load(
+    llvm::StringRef image,
+    llvm::StringRef source) {
+  auto malformed = std::make_error_code(std::errc::illegal_byte_sequence);
+  if (image.size() < sizeof(ImageHeader) ||
+      (uintptr_t)image.data() % alignof(uint32_t) != 0)
+    return malformed;
+  ImageHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+  if (header.magic != kImageMagic)
+    return malformed;
+  if (header.version != kImageVersion)
+    return std::make_error_code(std::errc::not_supported);
+  if (header.sourceSize != source.size() ||
+      header.sourceHash != hashString(source))
+    return std::make_error_code(std::errc::invalid_argument);
+
+  // Computed in 64 bits, so it can't overflow.
+  uint64_t size = sizeof(ImageHeader) +
+      ((uint64_t)header.numWords + header.numRoots + header.numStrings + 1) *
+          sizeof(uint32_t) +
+      (uint64_t)header.numNumbers * sizeof(ImageNumber) + header.stringBytes;
+  if (size != image.size())
+    return malformed;
+
+  CompactAST res{source.data()};
+  auto *ptr =
+      reinterpret_cast<const uint32_t *>(image.data() + sizeof(ImageHeader));
+  res.words_ = llvm::makeArrayRef(ptr, header.numWords);
+  ptr += header.numWords;
+  res.roots_ = llvm::makeArrayRef(ptr, header.numRoots);
+  ptr += header.numRoots;
+  res.stringOffsets_ = ptr;
+  ptr += header.numStrings + 1;
+  res.imageNumbers_ = reinterpret_cast<const ImageNumber *>(ptr);
+  res.strings_ =
+      reinterpret_cast<const char *>(res.imageNumbers_ + header.numNumbers);
+  res.image_ = image.data();
+  res.imageSize_ = image.size();
+
+  if (res.stringOffsets_[header.numStrings] != header.stringBytes ||
+      !res.checkImage(
+          header.sourceSize, header.numStrings, header.numNumbers))
+    return malformed;
+  return std::move(res);
+}
+
+uint64_t CompactAST::getContentSize(NodeRef ref) const {
+  switch (getKind(ref)) {
+    case NodeKind::Number:
+    case NodeKind::String:
+    case NodeKind::Symbol:
+      return 1;
+    case NodeKind::Pair:
+      return 2;
+    case NodeKind::Vector:
+      return 1 + (uint64_t)getSize(ref);
+    case NodeKind::Bytevector:
+      return 1 + ((uint64_t)getSize(ref) + 3) / 4;
+    default:
+      return 0;
+  }
+}
+
+bool CompactAST::checkImage(
+    uint32_t sourceSize,
+    uint32_t numStrings,
+    uint32_t numNumbers) const {
+  // Every string is followed by its terminator, so the offsets increase.
+  if (numStrings && stringOffsets_[0] != 0)
+    return false;
+  for (uint32_t i = 0; i != numStrings; ++i) {
+    if (stringOffsets_[i] >= stringOffsets_[i + 1] ||
+        strings_[stringOffsets_[i + 1] - 1] != 0)
+      return false;
+  }
+  for (uint32_t i = 0; i != numNumbers; ++i) {
+    if (imageNumbers_[i].kind != (uint32_t)NumberKind::exact &&
+        imageNumbers_[i].kind != (uint32_t)NumberKind::inexact)
+      return false;
+  }
+
+  // The nodes follow each other without gaps. Check each of them, and
+  // remember where they start, so the references can be checked next.
+  const uint64_t numWords = words_.size();
+  llvm::BitVector starts(words_.size());
+  for (uint64_t ref = 0; ref != numWords;) {
+    if (ref + kHeaderSize > numWords)
+      return false;
+    starts.set(ref);
+
+    NodeKind kind = getKind(ref);
+    if (kind >= NodeKind::_end)
+      return false;
+    uint32_t start = words_[ref + 1];
+    if (start != kNoLocation &&
+        (start > sourceSize || words_[ref + 2] > sourceSize - start))
+      return false;
+
+    // The size of a vector or bytevector is in its first word.
+    bool sized = kind == NodeKind::Vector || kind == NodeKind::Bytevector;
+    if (sized && ref + kHeaderSize + 1 > numWords)
+      return false;
+    uint64_t end = ref + kHeaderSize + getContentSize(ref);
+    if (end > numWords)
+      return false;
+
+    if (kind == NodeKind::Number) {
+      if ((getValue(ref) & kBoxedNumber) &&
+          words_[ref + kHeaderSize] >= numNumbers)
+        return false;
+    } else if (kind == NodeKind::String || kind == NodeKind::Symbol) {
+      if (words_[ref + kHeaderSize] >= numStrings)
+        return false;
+    }
+    ref = end;
+  }
+
+  auto isNode = [&starts, numWords](NodeRef ref) {
+    return ref < numWords && starts.test(ref);
+  };
+  for (NodeRef root : roots_) {
+    if (!isNode(root))
+      return false;
+  }
+  for (uint64_t ref = 0; ref != numWords;
+       ref += kHeaderSize + getContentSize(ref)) {
+    llvm::ArrayRef<NodeRef> children{};
+    if (getKind(ref) == NodeKind::Pair)
+      children = words_.slice(ref + kHeaderSize, 2);
+    else if (getKind(ref) == NodeKind::Vector)
+      children = getElements(ref);
+    for (NodeRef child : children) {
+      if (!isNode(child))
+        return false;
+    }
+  }
+  return true;
+}
+
+void CompactAST::write(llvm::raw_ostream &OS, llvm::StringRef source) const {
+  if (image_) {
+    OS.write(image_, imageSize_);
+    return;
+  }
+  if (source.size() > UINT32_MAX)
+    llvm::report_fatal_error("source is too large for an image");
+
+  std::vector<uint32_t> stringOffsets{};
+  stringOffsets.reserve(identifiers_.size() + 1);
+  uint64_t stringBytes = 0;
+  for (Identifier ident : identifiers_) {
+    stringOffsets.push_back((uint32_t)stringBytes);
+    stringBytes += ident.str().size() + 1;
+  }
+  if (stringBytes > UINT32_MAX)
+    llvm::report_fatal_error("strings are too large for an image");
+  stringOffsets.push_back((uint32_t)stringBytes);
+
+  ImageHeader header{
+      kImageMagic,
+      kImageVersion,
+      (uint32_t)source.size(),
+      hashString(source),
+      (uint32_t)words_.size(),
+      (uint32_t)roots_.size(),
+      (uint32_t)identifiers_.size(),
+      (uint32_t)numbers_.size(),
+      (uint32_t)stringBytes};
+  OS.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  OS.write(
+      reinterpret_cast<const char *>(words_.data()),
+      words_.size() * sizeof(uint32_t));
+  OS.write(
+      reinterpret_cast<const char *>(roots_.data()),
+      roots_.size() * sizeof(NodeRef));
+  OS.write(
+      reinterpret_cast<const char *>(stringOffsets.data()),
+      stringOffsets.size() * sizeof(uint32_t));
+  for (const Number &num : numbers_) {
+    uint64_t bits;
+    if (num.isExact()) {
+      bits = (uint64_t)num.getExact();
+    } else {
+      InexactNumberT inexact = num.getInexact();
+      memcpy(&bits, &inexact, sizeof(bits));
+    }
+    ImageNumber imageNum{
+        (uint32_t)num.getKind(), {(uint32_t)bits, (uint32_t)(bits >> 32)}};
+    OS.write(reinterpret_cast<const char *>(&imageNum), sizeof(imageNum));
+  }
+  for (Identifier ident : identifiers_)
+    OS << ident.str() << '\0';
+}
+
+size_t CompactAST::getMemorySize() const {
+  if (image_)
+    return imageSize_;
+  return words_.size() * sizeof(uint32_t) + roots_.size() * sizeof(NodeRef) +
+      identifiers_.size() * sizeof(Identifier) +
+      identifierIndex_.getMemorySize() + numbers_.size() * sizeof(Number);
+}
+
+SMRange CompactAST::getSourceRange(NodeRef ref) const {
+  uint32_t start = words_[ref + 1];
+  if (start == kNoLocation)
+    return SMRange{};
+  const char *ptr = bufferStart_ + start;
+  return SMRange{SMLoc::getFromPointer(ptr),
+                 SMLoc::getFromPointer(ptr + words_[ref + 2])};
+}
+
+Number CompactAST::getNumber(NodeRef ref) const {
+  assert(getKind(ref) == NodeKind::Number);
+  uint32_t word = words_[ref + kHeaderSize];
+  if (getValue(ref) & kBoxedNumber) {
+    if (!image_)
+      return numbers_[word];
+    const ImageNumber &num = imageNumbers_[word];
+    uint64_t bits = num.bits[0] | (uint64_t)num.bits[1] << 32;
+    if ((NumberKind)num.kind == NumberKind::exact)
+      return Number{(ExactNumberT)bits};
+    InexactNumberT inexact;
+    memcpy(&inexact, &bits, sizeof(inexact));
+    return Number{inexact};
+  }
+  return Number{(ExactNumberT)(int32_t)word};
+}
+
+} // namespace ast
+} // namespace s2020
@@ -0,0 +1,15 @@
+#include "CharTab.h"
+
+namespace s2020 {
+namespace parser {
+
+const CC::Flags charTab[256] = {
+#include "./CharTab.inc"
+};
+
+const uint8_t digitTab[256] = {
+#include "./DigitTab.inc"
+};
+
+} // namespace parser
+} // namespace s2020
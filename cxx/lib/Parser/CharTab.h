@@ -0,0 +1,81 @@
+#ifndef SCHEME2020_PARSER_CHARTAB_H
+#define SCHEME2020_PARSER_CHARTAB_H
+
+#include <cstdint>
+
+namespace s2020 {
+namespace parser {
+
+/// Character classes and flags used by the lexer. The classification table
+/// itself is generated by genCharTab.py.
+struct CC {
+  enum {
+    // 0,1,2
+    ClassMask = 7,
+
+    WhitespaceClass = 1,
+    /// Initial identifier.
+    InitialClass = 2,
+    /// +, -, .
+    PeculiarIdentClass = 3,
+    /// 0-9
+    DigitClass = 4,
+    /// #
+    HashClass = 5,
+    /// UTF8
+    UTF8Class = 6,
+
+    // 3
+    /// Subsequent identifier.
+    Subsequent = (1 << 3),
+    // 4
+    SignSubsequent = (2 << 3),
+    // 5
+    DotSubsequent = (4 << 3),
+    // 6
+    Delimiter = (8 << 3)
+  };
+
+  using Flags = uint8_t;
+
+  static Flags getClass(Flags f) {
+    return f & ClassMask;
+  }
+
+  static bool testSubsequent(Flags f) {
+    return f & Subsequent;
+  }
+  static bool testSignSubsequent(Flags f) {
+    return f & SignSubsequent;
+  }
+  static bool testDotSubsequent(Flags f) {
+    return f & DotSubsequent;
+  }
+  static bool testDelimiter(Flags f) {
+    return f & Delimiter;
+  }
+};
+
+/// The character classification table, indexed by byte value.
+extern const CC::Flags charTab[256];
+
+/// \return the character flags at the specified address.
+inline CC::Flags getCharFlags(const char *p) {
+  return charTab[*(const unsigned char *)p];
+}
+
+/// The value of every byte as a digit in radix up to 16, or 0xFF if it isn't
+/// one. Generated by genCharTab.py.
+extern const uint8_t digitTab[256];
+
+/// \return the value of the character at the specified address as a digit
+///     in radix up to 16, or 0xFF if it is not a digit. The caller checks the
+///     value against the radix.
+inline unsigned getDigitValue(const char *p) {
+  return digitTab[*(const unsigned char *)p];
+}
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_CHARTAB_H
@@ -1,6 +1,16 @@
 #include "s2020/Parser/DatumParser.h"
 
 #include "s2020/Parser/Lexer.h"
+#include "s2020/Parser/ParallelLexer.h"
+#include "s2020/Parser/TokenStream.h"
+
+#include "ParallelFor.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <new>
 
 using llvm::cast;
 
@@ -9,239 +19,1209 @@ namespace parser {
 
 namespace {
 
-class DatumParser {
+/// Presents the current token of a Lexer with the same interface as
+/// TokenStream::Cursor.
+class LexerTokenSource {
  public:
-  explicit DatumParser(
+  explicit LexerTokenSource(
       ast::ASTContext &context,
       const llvm::MemoryBuffer &input)
       : context_(context), lex_(context, input) {
     lex_.advance();
   }
 
-  llvm::Optional<std::vector<ast::Node *>> parse();
+  void advance() {
+    lex_.advance();
+  }
 
- private:
-  ast::Node *parseDatum();
+  /// Lex the current token again, after the strings it interned have been
+  /// freed. Its errors have already been reported, so they are dropped.
+  void relex() {
+    std::vector<DeferredLexerError> errors{};
+    lex_.seek(lex_.token.getStartLoc());
+    lex_.setDeferredErrors(&errors);
+    lex_.advance();
+    lex_.setDeferredErrors(nullptr);
+  }
 
-  /// Skip all datum comments and return true if there is a fatal error.
-  bool skipDatumComments();
+  TokenKind getKind() const {
+    return lex_.token.getKind();
+  }
+  SMLoc getStartLoc() const {
+    return lex_.token.getStartLoc();
+  }
+  SMLoc getEndLoc() const {
+    return lex_.token.getEndLoc();
+  }
+  SMRange getSourceRange() const {
+    return lex_.token.getSourceRange();
+  }
+  const Number &getNumber() const {
+    return lex_.token.getNumber();
+  }
+  Identifier getIdentifier() const {
+    return lex_.token.getIdentifier();
+  }
+  char32_t getCharacter() const {
+    return lex_.token.getCharacter();
+  }
+  Identifier getString() const {
+    return lex_.token.getString();
+  }
+  uint32_t getLabel() const {
+    return lex_.token.getLabel();
+  }
 
-  template <typename N, typename V>
-  ast::Node *makeSimpleNodeAndAdvance(const V &v) {
-    auto *node = new (context_) N(v);
-    node->setSourceRange(lex_.token.getSourceRange());
-    lex_.advance();
-    return node;
+  bool error(const llvm::Twine &msg) {
+    return lex_.error(msg);
+  }
+  bool error(SMRange range, const llvm::Twine &msg) {
+    return lex_.error(range, msg);
   }
 
-  ast::Node *parseList(TokenKind closingKind);
+  void note(SMLoc loc, const llvm::Twine &msg) {
+    context_.sm.note(loc, msg);
+  }
 
  private:
   ast::ASTContext &context_;
-  /// Lex lexer.
   Lexer lex_;
-  /// Whether a fatal error has already been reported, so we shouldn't report
-  /// any more.
-  bool fatal_ = false;
-  /// Maximum allowed nesting level to avoid stack overflow.
-  static constexpr unsigned MAX_NESTING = 1024;
-  /// Nesting level.
-  unsigned nesting_ = 0;
-
-  /// A RAII to maintain the nesting.
-  class NestingRAII;
 };
 
-class DatumParser::NestingRAII {
+/// A message reported while parsing a region in parallel, to be replayed in
+/// order when the regions are joined.
+struct DeferredMessage {
+  bool isNote;
+  /// The index of the current token when the message was reported.
+  uint32_t token;
+  SMRange range;
+  std::string msg;
+};
+
+/// Presents the tokens [begin, end) of a TokenStream, followed by an eof, with
+/// the same interface as TokenStream::Cursor. Messages are deferred instead of
+/// reported, since the regions of a stream are parsed in parallel.
+class RegionTokenSource {
  public:
-  explicit NestingRAII(DatumParser &parser) : p_(parser) {
-    ++p_.nesting_;
+  explicit RegionTokenSource(
+      const TokenStream &stream,
+      uint32_t begin,
+      uint32_t end,
+      std::vector<DeferredMessage> &messages)
+      : stream_(stream), index_(begin), end_(end), messages_(messages) {}
+
+  void advance() {
+    if (index_ != end_)
+      ++index_;
+  }
+
+  TokenKind getKind() const {
+    return index_ != end_ ? stream_.getKind(index_) : TokenKind::eof;
+  }
+  SMLoc getStartLoc() const {
+    return stream_.getStartLoc(index_);
   }
-  ~NestingRAII() {
-    --p_.nesting_;
+  SMLoc getEndLoc() const {
+    return stream_.getEndLoc(index_);
+  }
+  SMRange getSourceRange() const {
+    return stream_.getSourceRange(index_);
+  }
+  const Number &getNumber() const {
+    return stream_.getNumber(index_);
+  }
+  Identifier getIdentifier() const {
+    return stream_.getIdentifier(index_);
+  }
+  char32_t getCharacter() const {
+    return stream_.getCharacter(index_);
+  }
+  Identifier getString() const {
+    return stream_.getString(index_);
+  }
+  uint32_t getLabel() const {
+    return stream_.getLabel(index_);
+  }
+
+  bool error(const llvm::Twine &msg) {
+    return error(getSourceRange(), msg);
+  }
+  bool error(SMRange range, const llvm::Twine &msg) {
+    messages_.push_back(DeferredMessage{false, index_, range, msg.str()});
+    return true;
+  }
+
+  void note(SMLoc loc, const llvm::Twine &msg) {
+    messages_.push_back(
+        DeferredMessage{true, index_, SMRange{loc, loc}, msg.str()});
   }
 
  private:
-  DatumParser &p_;
+  const TokenStream &stream_;
+  uint32_t index_;
+  /// The end of the region, which is either the final eof of the stream or
+  /// the start of the next region.
+  const uint32_t end_;
+  std::vector<DeferredMessage> &messages_;
+};
+
+/// What an open frame of the parser is collecting.
+enum class FrameKind : uint8_t {
+  /// A datum comment, whose datum is discarded.
+  Comment,
+  /// An abbreviation like 'x, whose datum is wrapped in a list.
+  Abbreviation,
+  /// A datum label definition "#n=", which names the next datum.
+  Label,
+  List,
+  Vector,
+  Bytevector,
 };
 
-#define CHECK_NESTING()                        \
-  NestingRAII nestingRAII{*this};              \
-  if (nesting_ >= MAX_NESTING) {               \
-    lex_.error("too many nested expressions"); \
-    fatal_ = true;                             \
-    return nullptr;                            \
-  } else {                                     \
+/// \return whether the frame is a prefix which applies to the next datum,
+///     rather than a collection of datums ended by a closing token.
+inline bool isPrefix(FrameKind kind) {
+  return kind == FrameKind::Comment || kind == FrameKind::Abbreviation ||
+      kind == FrameKind::Label;
+}
+
+/// \return the name of a frame kind other than Comment, for messages.
+const char *frameName(FrameKind kind) {
+  switch (kind) {
+    case FrameKind::Abbreviation:
+      return "abbreviation";
+    case FrameKind::Label:
+      return "datum label";
+    case FrameKind::Vector:
+      return "vector";
+    case FrameKind::Bytevector:
+      return "bytevector";
+    default:
+      return "list";
   }
+}
 
-llvm::Optional<std::vector<ast::Node *>> DatumParser::parse() {
+/// Where a list is in its parsing. Vectors and bytevectors are always
+/// expecting elements.
+enum class ListState : uint8_t {
+  /// Expecting an element, a period after the first element, or the end.
+  Elements,
+  /// After the period, expecting the last cdr.
+  Cdr,
+  /// After the last cdr, expecting the end.
+  End,
+  /// There was garbage after the last cdr, which is being skipped.
+  Skip,
+};
+
+/// A parser of datums. \p TokenSource is a LexerTokenSource, which lexes on
+/// demand, a TokenStream::Cursor over a pre-lexed buffer, or a
+/// RegionTokenSource over a part of one.
+///
+/// Instead of recursing, the parser keeps the lists and datum comments which
+/// are still open on an explicit stack of frames, so the nesting depth is only
+/// limited by memory. The frames are allocated in the context and recycled
+/// through a free list, so the memory used is proportional to the deepest
+/// nesting, not to the size of the input.
+///
+/// The elements of lists, vectors and bytevectors are collected on stacks
+/// shared by all frames, and copied into the nodes when the list ends, so the
+/// pairs of a list are allocated together and CDR-coded.
+///
+/// Datum labels are scoped to the top level datum. A reference to a label
+/// whose datum is complete is just that datum. A reference from inside the
+/// labeled datum, which makes it cyclic, is a placeholder until the top level
+/// datum is complete, and then the placeholders are replaced in one pass.
+template <typename TokenSource>
+class DatumParser {
+ public:
+  explicit DatumParser(ast::ASTContext &context, TokenSource &tokens)
+      : DatumParser(context, tokens, context.getSharedNodes()) {}
+
+  /// Use the \p shared nodes of another context, which must outlive the
+  /// datums.
+  explicit DatumParser(
+      ast::ASTContext &context,
+      TokenSource &tokens,
+      const ast::ASTContext::SharedNodes &shared)
+      : context_(context),
+        tok_(tokens),
+        shared_(shared),
+        hashConsing_(context.isHashConsing()) {}
+
+  llvm::Optional<std::vector<ast::Node *>> parse();
+
+  /// Parse the next top level datum. splitRegions() follows the same steps
+  /// without building nodes.
+  /// \return nullptr at EOF.
+  ast::Node *parseDatum();
+
+ private:
+  template <typename N, typename V>
+  ast::Node *makeSimpleNodeAndAdvance(const V &v) {
+    auto cp = startDatum();
+    ast::Node *node = new (context_) N(v);
+    node->setSourceRange(tok_.getSourceRange());
+    node = intern(node, cp);
+    tok_.advance();
+    return node;
+  }
+
+  /// \return where the nodes of the next datum are allocated, for intern().
+  ast::ASTContext::Checkpoint startDatum() const {
+    ast::ASTContext::Checkpoint cp;
+    if (hashConsing_)
+      cp = context_.checkpoint();
+    return cp;
+  }
+
+  /// When hash-consing, intern the complete \p datum, whose nodes were
+  /// allocated after \p cp, and free them if it was a duplicate.
+  /// \return the interned datum, or \p datum when not hash-consing.
+  ast::Node *intern(ast::Node *datum, const ast::ASTContext::Checkpoint &cp) {
+    if (!hashConsing_)
+      return datum;
+    ast::Node *res = context_.intern(datum);
+    if (res != datum)
+      context_.rewindNodes(cp);
+    return res;
+  }
+
+  struct Label;
+
+  /// An open list, vector, bytevector, datum comment, abbreviation or datum
+  /// label.
+  struct Frame {
+    /// The enclosing frame, or nullptr.
+    Frame *prev;
+    FrameKind kind;
+    ListState state;
+    TokenKind closingKind;
+    SMLoc startLoc;
+    /// Where the elements of a list, vector or bytevector start in elements_
+    /// or bytes_. The cdr of a dotted list is its last element.
+    size_t base;
+    /// Where a datum comment started allocating its nodes.
+    ast::ASTContext::Checkpoint commentStart;
+    /// The symbol an abbreviation expands to.
+    ast::Node *symbol;
+    /// The label defined by a datum label, or the newest label when a datum
+    /// comment started.
+    Label *label;
+  };
+
+  /// A datum label of the current top level datum. Labels are allocated in
+  /// the context and recycled like frames.
+  struct Label {
+    /// The label defined before this one.
+    Label *prev;
+    /// A label with the same number which this one hides, after an error.
+    Label *hidden;
+    uint32_t number;
+    /// The labeled datum, or nullptr while it is being parsed.
+    ast::Node *datum;
+    /// Stands for the datum in references made while it is being parsed.
+    ast::NullNode placeholder{};
+  };
+
+  /// Push a new frame, which must then be initialized.
+  Frame *push() {
+    Frame *frame = freeFrames_;
+    if (frame)
+      freeFrames_ = frame->prev;
+    else
+      frame = context_.allocator.template Allocate<Frame>();
+    frame->prev = top_;
+    top_ = frame;
+    return frame;
+  }
+
+  void pop() {
+    Frame *frame = top_;
+    top_ = frame->prev;
+    frame->prev = freeFrames_;
+    freeFrames_ = frame;
+  }
+
+  /// Start a list, vector or bytevector whose opening token is the current
+  /// token.
+  void openList(FrameKind kind, TokenKind closingKind);
+
+  /// Finish the list in the top frame at the current token, which is its
+  /// closing token, and pop it.
+  /// \return the list.
+  ast::Node *closeList();
+
+  /// Finish the vector or bytevector in the top frame at the current token,
+  /// which is its closing token, and pop it.
+  /// \return the vector or bytevector.
+  ast::Node *closeVector();
+
+  /// Add a parsed datum to the list, vector or comment in the top frame.
+  void addDatum(ast::Node *datum);
+
+  /// Add the current token, a number, to the bytevector in the top frame.
+  /// Bytes don't need number nodes.
+  void addByte();
+
+  /// Start an abbreviation which expands to a list headed by \p symbol. The
+  /// current token is the abbreviation.
+  void openAbbreviation(ast::Node *symbol);
+
+  /// Wrap \p datum in the abbreviation in the top frame, and pop it.
+  /// \return the expanded abbreviation.
+  ast::Node *closeAbbreviation(ast::Node *datum);
+
+  /// Start the definition of the datum label in the current token.
+  void openLabel();
+
+  /// Make \p datum the datum of the label in the top frame, and pop it.
+  /// \return the datum, which is only different from \p datum after an
+  ///     error.
+  ast::Node *closeLabel(ast::Node *datum);
+
+  /// \return the datum referenced by the current token, which is a datum
+  ///     label reference.
+  ast::Node *referenceLabel();
+
+  /// Forget the labels defined after \p last, which is nullptr or a label
+  /// which is still defined.
+  void undefineLabels(Label *last);
+
+  /// \return \p node, or if it is a placeholder of a label whose datum is
+  ///     complete, that datum.
+  ast::Node *resolve(ast::Node *node);
+
+  /// Replace the placeholders in the complete top level datum \p root, and
+  /// forget all labels.
+  void finishLabels(ast::Node *root);
+
+  /// Report the innermost list which is still open at EOF as unterminated,
+  /// and pop all frames.
+  void reportUnterminated();
+
+ private:
+  ast::ASTContext &context_;
+  /// The current token.
+  TokenSource &tok_;
+  /// The symbols which abbreviations expand to.
+  const ast::ASTContext::SharedNodes &shared_;
+  /// Whether the datums are hash-consed.
+  bool hashConsing_;
+  /// The innermost open frame, or nullptr at the top level.
+  Frame *top_ = nullptr;
+  /// Frames which have been popped and can be reused.
+  Frame *freeFrames_ = nullptr;
+  /// The elements of the open vectors, the innermost last.
+  std::vector<ast::Node *> elements_{};
+  /// The bytes of the open bytevectors, the innermost last.
+  std::vector<uint8_t> bytes_{};
+  /// The newest datum label, or nullptr.
+  Label *labels_ = nullptr;
+  /// Labels which have been forgotten and can be reused.
+  Label *freeLabels_ = nullptr;
+  /// The current definition of every label number.
+  llvm::DenseMap<uint32_t, Label *> labelMap_{};
+  /// The labels whose placeholders have been referenced.
+  llvm::DenseMap<const ast::Node *, Label *> placeholders_{};
+};
+
+template <typename TokenSource>
+llvm::Optional<std::vector<ast::Node *>> DatumParser<TokenSource>::parse() {
   // Remember how many errors we started with.
   if (context_.sm.isErrorLimitReached())
     return llvm::None;
 
   auto numErrors = context_.sm.getErrorCount();
+  auto start = context_.checkpoint();
 
   std::vector<ast::Node *> res{};
   while (auto *datum = parseDatum())
     res.push_back(datum);
 
-  // If errors occurred
-  if (numErrors != context_.sm.getErrorCount())
+  // If errors occurred, nothing that was parsed is returned, so its memory
+  // can be released. The lexer is at EOF, so it holds no strings either.
+  if (numErrors != context_.sm.getErrorCount()) {
+    context_.rewind(start);
     return llvm::None;
+  }
 
   return std::move(res);
 }
 
-ast::Node *DatumParser::parseDatum() {
-  CHECK_NESTING();
-
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::parseDatum() {
   for (;;) {
-    switch (lex_.token.getKind()) {
+    ast::Node *datum;
+    TokenKind kind = tok_.getKind();
+
+    // Check what the innermost list allows at this point, other than a datum.
+    if (top_ && !isPrefix(top_->kind) && kind != TokenKind::datum_comment) {
+      if (kind == top_->closingKind && top_->state != ListState::Cdr) {
+        datum = top_->kind == FrameKind::List ? closeList() : closeVector();
+        goto haveDatum;
+      }
+      if (kind == TokenKind::number && top_->kind == FrameKind::Bytevector) {
+        addByte();
+        continue;
+      }
+      if (kind == TokenKind::period && top_->kind == FrameKind::List &&
+          top_->state == ListState::Elements &&
+          elements_.size() != top_->base) {
+        top_->state = ListState::Cdr;
+        tok_.advance();
+        continue;
+      }
+      if (top_->state == ListState::End && kind != TokenKind::eof) {
+        tok_.error("list terminator expected");
+        tok_.note(top_->startLoc, "list started here");
+        // Skip until the end of the list.
+        top_->state = ListState::Skip;
+      }
+    }
+
+    switch (kind) {
       case TokenKind::eof:
+        reportUnterminated();
         return nullptr;
 
-      case TokenKind::datum_comment:
-        lex_.advance();
+      case TokenKind::datum_comment: {
+        tok_.advance();
         // Ignore the next datum.
-        if (!parseDatum())
-          return nullptr;
+        Frame *frame = push();
+        frame->kind = FrameKind::Comment;
+        frame->commentStart = context_.checkpoint();
+        frame->label = labels_;
+        continue;
+      }
+
+      case TokenKind::label_def:
+        openLabel();
         continue;
+      case TokenKind::label_ref:
+        datum = referenceLabel();
+        break;
 
       case TokenKind::number:
-        return makeSimpleNodeAndAdvance<ast::NumberNode>(
-            lex_.token.getNumber());
+        datum = makeSimpleNodeAndAdvance<ast::NumberNode>(tok_.getNumber());
+        break;
       case TokenKind::identifier:
-        return makeSimpleNodeAndAdvance<ast::SymbolNode>(
-            lex_.token.getIdentifier());
+        datum =
+            makeSimpleNodeAndAdvance<ast::SymbolNode>(tok_.getIdentifier());
+        break;
+      case TokenKind::character:
+        datum =
+            makeSimpleNodeAndAdvance<ast::CharacterNode>(tok_.getCharacter());
+        break;
+      case TokenKind::string:
+        datum = makeSimpleNodeAndAdvance<ast::StringNode>(tok_.getString());
+        break;
 
       case TokenKind::l_paren:
-        return parseList(TokenKind::r_paren);
+        openList(FrameKind::List, TokenKind::r_paren);
+        continue;
       case TokenKind::l_square:
-        return parseList(TokenKind::r_square);
+        openList(FrameKind::List, TokenKind::r_square);
+        continue;
+      case TokenKind::l_vector:
+        openList(FrameKind::Vector, TokenKind::r_paren);
+        continue;
+      case TokenKind::l_bytevector:
+        openList(FrameKind::Bytevector, TokenKind::r_paren);
+        continue;
+
+      case TokenKind::apostrophe:
+        openAbbreviation(shared_.quote);
+        continue;
+      case TokenKind::backtick:
+        openAbbreviation(shared_.quasiquote);
+        continue;
+      case TokenKind::comma:
+        openAbbreviation(shared_.unquote);
+        continue;
+      case TokenKind::comma_at:
+        openAbbreviation(shared_.unquoteSplicing);
+        continue;
 
       default:
-        lex_.error("unexpected token");
-        lex_.advance();
+        tok_.error("unexpected token");
+        tok_.advance();
         continue;
     }
-  }
-}
 
-bool DatumParser::skipDatumComments() {
-  while (lex_.token.getKind() == TokenKind::datum_comment) {
-    lex_.advance();
-    if (!parseDatum())
-      return fatal_;
+  haveDatum:
+    // Apply the prefixes waiting for this datum.
+    while (top_) {
+      if (top_->kind == FrameKind::Abbreviation)
+        datum = closeAbbreviation(datum);
+      else if (top_->kind == FrameKind::Label)
+        datum = closeLabel(datum);
+      else
+        break;
+    }
+    if (!top_) {
+      if (labels_)
+        finishLabels(datum);
+      return datum;
+    }
+    addDatum(datum);
   }
-
-  return false;
 }
 
-ast::Node *DatumParser::parseList(s2020::parser::TokenKind closingKind) {
-  CHECK_NESTING();
+template <typename TokenSource>
+void DatumParser<TokenSource>::openList(
+    FrameKind kind,
+    TokenKind closingKind) {
+  Frame *frame = push();
+  frame->kind = kind;
+  frame->state = ListState::Elements;
+  frame->closingKind = closingKind;
+  frame->startLoc = tok_.getStartLoc();
+  frame->base =
+      kind == FrameKind::Bytevector ? bytes_.size() : elements_.size();
+  tok_.advance();
+}
 
-  auto startLoc = lex_.token.getStartLoc();
-  lex_.advance();
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::closeList() {
+  Frame *frame = top_;
+  auto elements = llvm::makeArrayRef(elements_).slice(frame->base);
+  bool dotted = frame->state != ListState::Elements;
+  SMLoc startLoc = frame->startLoc;
+  size_t base = frame->base;
+  pop();
 
-  if (lex_.token.getKind() == closingKind) {
-    auto *empty = new (context_.allocateNode<ast::NullNode>()) ast::NullNode();
+  auto cp = startDatum();
+  if (elements.empty()) {
+    ast::Node *empty =
+        new (context_.allocateNode<ast::NullNode>()) ast::NullNode();
     empty->setStartLoc(startLoc);
-    empty->setEndLoc(lex_.token.getEndLoc());
-    lex_.advance();
+    empty->setEndLoc(tok_.getEndLoc());
+    empty = intern(empty, cp);
+    tok_.advance();
     return empty;
   }
 
-  ast::PairNode *head = nullptr;
-  ast::PairNode *tail = nullptr;
-  bool dotted = false;
+  ast::Node *tail = nullptr;
+  if (dotted) {
+    tail = elements.back();
+    elements = elements.drop_back();
+  }
+  auto *head = ast::PairNode::createList(context_, elements, tail);
+
+  // Every pair starts at its element, except the first one, and ends with the
+  // list.
+  ast::PairNode *pair = head;
+  for (size_t i = 0;; ++i) {
+    pair->setStartLoc(i ? elements[i]->getStartLoc() : startLoc);
+    pair->setEndLoc(tok_.getEndLoc());
+    if (i + 1 == elements.size())
+      break;
+    pair = cast<ast::PairNode>(pair->getCdr());
+  }
+  // If this wasn't a dotted list, the terminating Null node was allocated
+  // with the pairs.
+  if (!dotted)
+    pair->getCdr()->setSourceRange(tok_.getSourceRange());
 
-  auto *datum = parseDatum();
-  if (!datum)
-    goto reportUnterminated;
+  ast::Node *res = intern(head, cp);
+  elements_.resize(base);
+  tok_.advance();
+  return res;
+}
 
-  head = new (context_.allocateNode<ast::PairNode>())
-      ast::PairNode(datum, nullptr);
-  head->setStartLoc(startLoc);
-  tail = head;
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::closeVector() {
+  Frame *frame = top_;
+  auto cp = startDatum();
+  ast::Node *res;
+  if (frame->kind == FrameKind::Vector) {
+    res = ast::VectorNode::create(
+        context_, llvm::makeArrayRef(elements_).slice(frame->base));
+    elements_.resize(frame->base);
+  } else {
+    res = ast::BytevectorNode::create(
+        context_, llvm::makeArrayRef(bytes_).slice(frame->base));
+    bytes_.resize(frame->base);
+  }
+  res->setStartLoc(frame->startLoc);
+  res->setEndLoc(tok_.getEndLoc());
+  pop();
 
-  if (skipDatumComments())
-    return nullptr;
+  res = intern(res, cp);
+  tok_.advance();
+  return res;
+}
 
-  while (lex_.token.getKind() != closingKind) {
-    if (lex_.token.getKind() == TokenKind::period) {
-      dotted = true;
+template <typename TokenSource>
+void DatumParser<TokenSource>::addDatum(ast::Node *datum) {
+  Frame *frame = top_;
+  switch (frame->kind) {
+    case FrameKind::Comment:
+      // Nothing allocated since the comment started is referenced anymore,
+      // and neither are the labels defined in it.
+      undefineLabels(frame->label);
+      context_.rewindNodes(frame->commentStart);
+      pop();
+      return;
+    case FrameKind::Vector:
+      elements_.push_back(datum);
+      return;
+    case FrameKind::Bytevector:
+      // Numbers are added by addByte() without making a datum.
+      tok_.error(datum->getSourceRange(), "byte value expected");
+      return;
+    case FrameKind::List:
+      break;
+    case FrameKind::Abbreviation:
+    case FrameKind::Label:
+      llvm_unreachable("prefixes are applied before adding the datum");
+  }
 
-      lex_.advance();
-      datum = parseDatum();
-      if (!datum)
-        goto reportUnterminated;
+  switch (frame->state) {
+    case ListState::Elements:
+      elements_.push_back(datum);
+      break;
+    case ListState::Cdr:
+      elements_.push_back(datum);
+      frame->state = ListState::End;
+      break;
+    case ListState::End:
+    case ListState::Skip:
+      break;
+  }
+}
 
-      tail->setCdr(datum);
+template <typename TokenSource>
+void DatumParser<TokenSource>::addByte() {
+  const Number &num = tok_.getNumber();
+  if (num.isExact() && num.getExact() >= 0 && num.getExact() <= 255)
+    bytes_.push_back((uint8_t)num.getExact());
+  else
+    tok_.error("invalid byte value");
+  tok_.advance();
+}
 
-      if (skipDatumComments())
-        return nullptr;
+template <typename TokenSource>
+void DatumParser<TokenSource>::openAbbreviation(ast::Node *symbol) {
+  Frame *frame = push();
+  frame->kind = FrameKind::Abbreviation;
+  frame->state = ListState::Elements;
+  frame->startLoc = tok_.getStartLoc();
+  frame->symbol = symbol;
+  tok_.advance();
+}
 
-      if (lex_.token.getKind() != closingKind) {
-        lex_.error("list terminator expected");
-        context_.sm.note(startLoc, "list started here");
-        // Skip until the end of the list.
-        while (lex_.token.getKind() != TokenKind::eof &&
-               lex_.token.getKind() != closingKind) {
-          if (!parseDatum())
-            return nullptr;
-        }
-      }
-      break;
-    }
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::closeAbbreviation(ast::Node *datum) {
+  Frame *frame = top_;
+  auto cp = startDatum();
+  // Both pairs in one allocation, ending with the shared empty list.
+  ast::Node *elements[] = {frame->symbol, datum};
+  auto *outer = ast::PairNode::createList(context_, elements, shared_.null);
+  outer->getCdr()->setSourceRange(datum->getSourceRange());
+  outer->setStartLoc(frame->startLoc);
+  outer->setEndLoc(datum->getEndLoc());
+  pop();
+  return intern(outer, cp);
+}
+
+template <typename TokenSource>
+void DatumParser<TokenSource>::openLabel() {
+  uint32_t number = tok_.getLabel();
+  Label *label = freeLabels_;
+  if (label)
+    freeLabels_ = label->prev;
+  else
+    label = new (context_.allocator.template Allocate<Label>()) Label();
+  label->prev = labels_;
+  labels_ = label;
+  label->number = number;
+  label->datum = nullptr;
+
+  Label *&entry = labelMap_[number];
+  label->hidden = entry;
+  entry = label;
+  if (label->hidden)
+    tok_.error("datum label is already defined");
+
+  Frame *frame = push();
+  frame->kind = FrameKind::Label;
+  frame->state = ListState::Elements;
+  frame->startLoc = tok_.getStartLoc();
+  frame->label = label;
+  tok_.advance();
+}
 
-    datum = parseDatum();
-    if (!datum)
-      goto reportUnterminated;
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::closeLabel(ast::Node *datum) {
+  Frame *frame = top_;
+  Label *label = frame->label;
+  if (resolve(datum) == &label->placeholder) {
+    // Something like "#0=#0#", which has no datum to refer to.
+    tok_.error(
+        SMRange{frame->startLoc, frame->startLoc},
+        "datum label refers to itself");
+    datum = new (context_.allocateNode<ast::NullNode>()) ast::NullNode();
+  }
+  label->datum = datum;
+  pop();
+  return datum;
+}
 
-    auto *newTail = new (context_.allocateNode<ast::PairNode>())
-        ast::PairNode(datum, nullptr);
-    newTail->setStartLoc(datum->getStartLoc());
-    tail->setCdr(newTail);
-    tail = newTail;
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::referenceLabel() {
+  auto it = labelMap_.find(tok_.getLabel());
+  ast::Node *datum;
+  if (it == labelMap_.end()) {
+    tok_.error("undefined datum label");
+    datum = new (context_.allocateNode<ast::NullNode>()) ast::NullNode();
+    datum->setSourceRange(tok_.getSourceRange());
+  } else if (it->second->datum) {
+    datum = it->second->datum;
+  } else {
+    datum = &it->second->placeholder;
+    placeholders_[datum] = it->second;
+  }
+  tok_.advance();
+  return datum;
+}
 
-    if (skipDatumComments())
-      return nullptr;
+template <typename TokenSource>
+void DatumParser<TokenSource>::undefineLabels(Label *last) {
+  while (labels_ != last) {
+    Label *label = labels_;
+    labels_ = label->prev;
+    if (label->hidden)
+      labelMap_[label->number] = label->hidden;
+    else
+      labelMap_.erase(label->number);
+    placeholders_.erase(&label->placeholder);
+    label->prev = freeLabels_;
+    freeLabels_ = label;
   }
+}
 
-  // If this wasn't a dotted list, we must allocate the terminating Null node.
-  if (!dotted) {
-    auto *empty = new (context_.allocateNode<ast::NullNode>()) ast::NullNode();
-    empty->setSourceRange(lex_.token.getSourceRange());
-    tail->setCdr(empty);
+template <typename TokenSource>
+ast::Node *DatumParser<TokenSource>::resolve(ast::Node *node) {
+  for (;;) {
+    auto it = placeholders_.find(node);
+    if (it == placeholders_.end() || !it->second->datum)
+      return node;
+    node = it->second->datum;
   }
+}
 
-  // Now that we have reached the end of the list, set all end locations.
-  for (auto *cur = head;; cur = cast<ast::PairNode>(cur->getCdr())) {
-    cur->setEndLoc(lex_.token.getEndLoc());
-    if (cur == tail)
-      break;
+template <typename TokenSource>
+void DatumParser<TokenSource>::finishLabels(ast::Node *root) {
+  if (!placeholders_.empty()) {
+    // Visit every pair and vector once, since the datum may be cyclic.
+    llvm::DenseSet<ast::Node *> visited{};
+    llvm::SmallVector<ast::Node *, 32> work{root};
+    auto visit = [this, &visited, &work](ast::Node *node) -> ast::Node * {
+      node = resolve(node);
+      bool compound =
+          llvm::isa<ast::PairNode>(node) || llvm::isa<ast::VectorNode>(node);
+      if (compound && visited.insert(node).second)
+        work.push_back(node);
+      return node;
+    };
+    visited.insert(root);
+    while (!work.empty()) {
+      ast::Node *node = work.pop_back_val();
+      if (auto *pair = llvm::dyn_cast<ast::PairNode>(node)) {
+        pair->setCar(visit(pair->getCar()));
+        // A CDR-coded cdr is the next pair of a list, never a placeholder.
+        if (pair->isCdrCoded())
+          visit(pair->getCdr());
+        else
+          pair->setCdr(visit(pair->getCdr()));
+      } else if (auto *vec = llvm::dyn_cast<ast::VectorNode>(node)) {
+        for (size_t i = 0, e = vec->size(); i != e; ++i)
+          vec->setElement(i, visit(vec->getElement(i)));
+      }
+    }
   }
+  undefineLabels(nullptr);
+  placeholders_.clear();
+}
 
-  lex_.advance();
-  return head;
+template <typename TokenSource>
+void DatumParser<TokenSource>::reportUnterminated() {
+  // A datum comment just ends at EOF, and so does a list whose garbage is
+  // being skipped, since its error has been reported.
+  while (top_ &&
+         (top_->kind == FrameKind::Comment ||
+          top_->state == ListState::Skip))
+    pop();
+  if (top_) {
+    const char *name = frameName(top_->kind);
+    if (isPrefix(top_->kind))
+      tok_.error("datum expected");
+    else
+      tok_.error(llvm::Twine("unterminated ") + name);
+    tok_.note(top_->startLoc, llvm::Twine(name) + " started here");
+    while (top_)
+      pop();
+  }
+  elements_.clear();
+  bytes_.clear();
+  undefineLabels(nullptr);
+  placeholders_.clear();
+}
 
-reportUnterminated:
-  if (!fatal_) {
-    fatal_ = true;
-    lex_.error("unterminated list");
-    context_.sm.note(startLoc, "list started here");
+} // anonymous namespace
+
+class DatumReader::Impl {
+ public:
+  virtual ~Impl() = default;
+  virtual ast::Node *next() = 0;
+  virtual void rewind(
+      ast::ASTContext &context,
+      const ast::ASTContext::Checkpoint &cp) = 0;
+};
+
+namespace {
+
+/// Owns a token source and a parser reading from it.
+template <typename TokenSource>
+class DatumReaderImpl final : public DatumReader::Impl {
+ public:
+  template <typename Input>
+  DatumReaderImpl(ast::ASTContext &context, const Input &input)
+      : tokens_(context, input), parser_(context, tokens_) {}
+
+  ast::Node *next() override {
+    return parser_.parseDatum();
   }
-  return nullptr;
+
+  void rewind(ast::ASTContext &context, const ast::ASTContext::Checkpoint &cp)
+      override;
+
+ private:
+  TokenSource tokens_;
+  DatumParser<TokenSource> parser_;
+};
+
+template <>
+void DatumReaderImpl<LexerTokenSource>::rewind(
+    ast::ASTContext &context,
+    const ast::ASTContext::Checkpoint &cp) {
+  // The token after the last datum has already been lexed, and its strings
+  // are freed too, so it has to be interned again.
+  context.rewind(cp);
+  tokens_.relex();
+}
+
+template <>
+void DatumReaderImpl<TokenStream::Cursor>::rewind(
+    ast::ASTContext &context,
+    const ast::ASTContext::Checkpoint &cp) {
+  // The strings belong to the stream.
+  context.rewindNodes(cp);
 }
 
 } // anonymous namespace
 
+DatumReader::DatumReader(
+    ast::ASTContext &context,
+    const llvm::MemoryBuffer &input)
+    : context_(context),
+      startErrors_(context.sm.getErrorCount()),
+      impl_(new DatumReaderImpl<LexerTokenSource>(context, input)) {}
+
+DatumReader::DatumReader(ast::ASTContext &context, const TokenStream &stream)
+    : context_(context),
+      startErrors_(context.sm.getErrorCount()),
+      streamErrors_(stream.hasErrors()),
+      impl_(new DatumReaderImpl<TokenStream::Cursor>(context, stream)) {}
+
+DatumReader::~DatumReader() = default;
+
+ast::Node *DatumReader::next() {
+  if (context_.sm.isErrorLimitReached())
+    return nullptr;
+  return impl_->next();
+}
+
+void DatumReader::rewind(const ast::ASTContext::Checkpoint &cp) {
+  impl_->rewind(context_, cp);
+}
+
+bool DatumReader::hasErrors() const {
+  return streamErrors_ || context_.sm.getErrorCount() != startErrors_;
+}
+
+bool readDatums(
+    ast::ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    llvm::function_ref<bool(ast::Node *)> callback,
+    bool freeNodes) {
+  // Taken before the first token is lexed, so the strings of every datum can
+  // be freed too.
+  auto start = context.checkpoint();
+  DatumReader reader{context, input};
+  while (auto *datum = reader.next()) {
+    bool more = callback(datum);
+    if (freeNodes)
+      reader.rewind(start);
+    if (!more)
+      break;
+  }
+  return !reader.hasErrors();
+}
+
 llvm::Optional<std::vector<ast::Node *>> parseDatums(
     ast::ASTContext &context,
     const llvm::MemoryBuffer &input) {
-  DatumParser parser{context, input};
+  LexerTokenSource tokens{context, input};
+  DatumParser<LexerTokenSource> parser{context, tokens};
   return parser.parse();
 }
 
+llvm::Optional<std::vector<ast::Node *>> parseDatums(
+    ast::ASTContext &context,
+    const TokenStream &stream) {
+  TokenStream::Cursor tokens{context, stream};
+  DatumParser<TokenStream::Cursor> parser{context, tokens};
+  auto start = context.checkpoint();
+  auto res = parser.parse();
+  if (stream.hasErrors()) {
+    context.rewindNodes(start);
+    return llvm::None;
+  }
+  return res;
+}
+
+namespace {
+
+/// Regions are never smaller than this many tokens, so the per-region overhead
+/// stays negligible.
+constexpr uint32_t kMinRegionTokens = 16 * 1024;
+
+/// The number of regions per thread. More regions than threads balance the
+/// load when some regions are slower to parse than others.
+constexpr unsigned kRegionsPerThread = 4;
+
+/// Split the tokens of \p stream into about \p numRegions regions at the top
+/// level, where the parser would be between two datums.
+///
+/// This follows the frames of DatumParser::parseDatum() without building any
+/// nodes: a closing token only ends the innermost list or vector, and not
+/// right after the period of a list, and a datum comment, an abbreviation or a
+/// datum label swallows the next datum at any level. The two must be kept in
+/// sync. Datum labels are scoped to a top level datum, so they don't need to
+/// be tracked.
+/// \return the start of every region, followed by the index of the final eof.
+std::vector<uint32_t> splitRegions(
+    const TokenStream &stream,
+    uint32_t numRegions) {
+  struct Frame {
+    FrameKind kind;
+    ListState state;
+    bool hasHead;
+    TokenKind closingKind;
+  };
+
+  llvm::ArrayRef<TokenKind> kinds = stream.kinds();
+  uint32_t eofIndex = stream.size() - 1;
+  uint32_t target = eofIndex / numRegions;
+
+  std::vector<uint32_t> starts{0};
+  llvm::SmallVector<Frame, 32> frames{};
+
+  // A datum has been completed.
+  auto addDatum = [&frames]() {
+    // An abbreviation or a label turns the datum into another datum.
+    while (!frames.empty() &&
+           (frames.back().kind == FrameKind::Abbreviation ||
+            frames.back().kind == FrameKind::Label))
+      frames.pop_back();
+    if (frames.empty())
+      return;
+    Frame &top = frames.back();
+    if (top.kind == FrameKind::Comment) {
+      frames.pop_back();
+    } else if (top.state == ListState::Elements) {
+      top.hasHead = true;
+    } else if (top.state == ListState::Cdr) {
+      top.state = ListState::End;
+    }
+  };
+
+  for (uint32_t i = 0; i != eofIndex; ++i) {
+    if (frames.empty() && i - starts.back() >= target)
+      starts.push_back(i);
+
+    TokenKind kind = kinds[i];
+    if (!frames.empty() && !isPrefix(frames.back().kind) &&
+        kind != TokenKind::datum_comment) {
+      Frame &top = frames.back();
+      if (kind == top.closingKind && top.state != ListState::Cdr) {
+        frames.pop_back();
+        addDatum();
+        continue;
+      }
+      if (kind == TokenKind::period && top.kind == FrameKind::List &&
+          top.state == ListState::Elements && top.hasHead) {
+        top.state = ListState::Cdr;
+        continue;
+      }
+      if (top.state == ListState::End)
+        top.state = ListState::Skip;
+    }
+
+    switch (kind) {
+      case TokenKind::datum_comment:
+        frames.push_back(Frame{
+            FrameKind::Comment, ListState::Elements, false, TokenKind::eof});
+        break;
+      case TokenKind::apostrophe:
+      case TokenKind::backtick:
+      case TokenKind::comma:
+      case TokenKind::comma_at:
+        frames.push_back(Frame{
+            FrameKind::Abbreviation,
+            ListState::Elements,
+            false,
+            TokenKind::eof});
+        break;
+      case TokenKind::label_def:
+        frames.push_back(Frame{
+            FrameKind::Label, ListState::Elements, false, TokenKind::eof});
+        break;
+      case TokenKind::number:
+      case TokenKind::identifier:
+      case TokenKind::character:
+      case TokenKind::string:
+      case TokenKind::label_ref:
+        addDatum();
+        break;
+      case TokenKind::l_paren:
+        frames.push_back(Frame{
+            FrameKind::List, ListState::Elements, false, TokenKind::r_paren});
+        break;
+      case TokenKind::l_square:
+        frames.push_back(Frame{
+            FrameKind::List, ListState::Elements, false, TokenKind::r_square});
+        break;
+      case TokenKind::l_vector:
+        frames.push_back(Frame{
+            FrameKind::Vector, ListState::Elements, false, TokenKind::r_paren});
+        break;
+      case TokenKind::l_bytevector:
+        frames.push_back(Frame{
+            FrameKind::Bytevector,
+            ListState::Elements,
+            false,
+            TokenKind::r_paren});
+        break;
+      default:
+        break;
+    }
+  }
+
+  starts.push_back(eofIndex);
+  return starts;
+}
+
+} // anonymous namespace
+
+llvm::Optional<std::vector<ast::Node *>> parseDatumsParallel(
+    ast::ASTContext &context,
+    const TokenStream &stream,
+    unsigned numThreads) {
+  uint32_t numRegions = std::min<uint32_t>(
+      numThreads * kRegionsPerThread, (stream.size() - 1) / kMinRegionTokens);
+  // The interned nodes must be looked up in one table, so hash-consing is
+  // serial.
+  if (numThreads <= 1 || numRegions <= 1 || context.isHashConsing())
+    return parseDatums(context, stream);
+
+  if (context.sm.isErrorLimitReached())
+    return llvm::None;
+  auto numErrors = context.sm.getErrorCount();
+  auto start = context.checkpoint();
+
+  struct Region {
+    std::vector<ast::Node *> datums{};
+    std::vector<DeferredMessage> messages{};
+  };
+  std::vector<uint32_t> starts = splitRegions(stream, numRegions);
+  std::vector<Region> regions(starts.size() - 1);
+
+  // Every thread allocates nodes in a private context, since allocators are
+  // not thread safe. The identifiers come from the stream, so nothing is
+  // interned, and abbreviations use the shared nodes of the caller's context.
+  std::vector<std::unique_ptr<ast::ASTContext>> contexts{};
+  for (unsigned t = 0; t != numThreads; ++t)
+    contexts.emplace_back(new ast::ASTContext());
+
+  parallelFor(
+      numThreads,
+      regions.size(),
+      [&context, &stream, &starts, &regions, &contexts](
+          unsigned t, size_t i) {
+        Region &region = regions[i];
+        RegionTokenSource tokens{
+            stream, starts[i], starts[i + 1], region.messages};
+        DatumParser<RegionTokenSource> parser{
+            *contexts[t], tokens, context.getSharedNodes()};
+        while (auto *datum = parser.parseDatum())
+          region.datums.push_back(datum);
+      });
+
+  for (auto &threadContext : contexts)
+    context.adoptNodes(*threadContext);
+
+  // Report the messages in order, which also stops at the same point as
+  // parsing serially if the error limit is reached. The deferred errors of a
+  // token come before the messages reported while it is the current token,
+  // like when a lexer reports them while the parser advances to it.
+  auto lexerErrors = stream.deferredErrors();
+  auto lexerErrorTokens = stream.deferredErrorTokens();
+  size_t nextLexerError = 0;
+  auto reportLexerErrors = [&context,
+                            &lexerErrors,
+                            &lexerErrorTokens,
+                            &nextLexerError](uint32_t token) {
+    for (; nextLexerError != lexerErrors.size() &&
+         lexerErrorTokens[nextLexerError] <= token;
+         ++nextLexerError) {
+      const DeferredLexerError &err = lexerErrors[nextLexerError];
+      context.sm.error(err.loc, err.range, err.msg);
+    }
+  };
+
+  std::vector<ast::Node *> res{};
+  for (Region &region : regions) {
+    for (const DeferredMessage &msg : region.messages) {
+      reportLexerErrors(msg.token);
+      if (msg.isNote)
+        context.sm.note(msg.range.Start, msg.msg);
+      else
+        context.sm.error(msg.range, msg.msg);
+    }
+    res.insert(res.end(), region.datums.begin(), region.datums.end());
+  }
+  reportLexerErrors(stream.size());
+
+  if (stream.hasErrors() || numErrors != context.sm.getErrorCount()) {
+    context.rewindNodes(start);
+    return llvm::None;
+  }
+  return std::move(res);
+}
+
+llvm::Optional<std::vector<ast::Node *>> parseDatumsParallel(
+    ast::ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    unsigned numThreads) {
+  // The lexical errors are deferred, so they can be reported in between the
+  // syntax errors like by parseDatums().
+  TokenStream stream = tokenizeAllParallel(context, input, numThreads, true);
+  return parseDatumsParallel(context, stream, numThreads);
+}
+
 } // namespace parser
-} // namespace s2020
\ No newline at end of file
+} // namespace s2020
@@ -1,67 +1,53 @@
 #include "s2020/Parser/Lexer.h"
 
+#include "s2020/Parser/SIMDScan.h"
+#include "s2020/Support/Conversions.h"
+#include "s2020/Support/UTF8.h"
+
+#include "CharTab.h"
+
 #include "llvm/ADT/APInt.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cstdint>
+#include <cstring>
 
 namespace s2020 {
 namespace parser {
 
-struct CC {
-  enum {
-    // 0,1,2
-    ClassMask = 7,
-
-    WhitespaceClass = 1,
-    /// Initial identifier.
-    InitialClass = 2,
-    /// +, -, .
-    PeculiarIdentClass = 3,
-    /// 0-9
-    DigitClass = 4,
-    /// #
-    HashClass = 5,
-    /// UTF8
-    UTF8Class = 6,
-
-    // 3
-    /// Subsequent identifier.
-    Subsequent = (1 << 3),
-    // 4
-    SignSubsequent = (2 << 3),
-    // 5
-    DotSubsequent = (4 << 3),
-    // 6
-    Delimiter = (8 << 3)
-  };
-
-  using Flags = uint8_t;
-
-  static Flags getClass(Flags f) {
-    return f & ClassMask;
-  }
+namespace {
 
-  static bool testSubsequent(Flags f) {
-    return f & Subsequent;
-  }
-  static bool testSignSubsequent(Flags f) {
-    return f & SignSubsequent;
-  }
-  static bool testDotSubsequent(Flags f) {
-    return f & DotSubsequent;
-  }
-  static bool testDelimiter(Flags f) {
-    return f & Delimiter;
-  }
+/// An entry in the perfect hash table of character names.
+struct CharName {
+  const char *name;
+  unsigned length;
+  uint32_t code;
 };
 
-static const CC::Flags s_charTab[256] = {
-#include "./CharTab.inc"
-};
+#include "CharNames.inc"
 
-/// \return the character flags at the specified address.
-static inline CC::Flags getCharFlags(const char *p) {
-  return s_charTab[*(const unsigned char *)p];
+/// The perfect hash function of the character names. It must match
+/// hash_name() in genCharNames.py.
+inline unsigned charNameHash(StringRef name) {
+  return ((unsigned char)name.front() * kCharNameMulFirst +
+          (unsigned char)name.back() * kCharNameMulLast + name.size()) &
+      kCharNameMask;
 }
 
+/// Look up a named character like "newline".
+/// \return the code point, or -1 if the name is unknown.
+int32_t lookupCharName(StringRef name) {
+  assert(!name.empty() && "empty character name");
+  const CharName &entry = kCharNames[charNameHash(name)];
+  if (entry.length == name.size() &&
+      memcmp(entry.name, name.data(), name.size()) == 0) {
+    return entry.code;
+  }
+  return -1;
+}
+
+} // anonymous namespace
+
 const char *tokenKindStr(TokenKind kind) {
   static const char *tokenStr[] = {
 #define TOK(name, str) str,
@@ -73,17 +59,16 @@ const char *tokenKindStr(TokenKind kind) {
 }
 
 Lexer::Lexer(ASTContext &context, const llvm::MemoryBuffer &input)
-    : context_(context) {
+    : Lexer(context, input.getBufferStart(), input.getBufferEnd()) {
   assert(
       context_.sm.findBufferForLoc(
           SMLoc::getFromPointer(input.getBufferStart())) &&
       "input buffer must be registered with SourceErrorManager");
+}
 
-  bufferStart_ = input.getBufferStart();
-  bufferEnd_ = input.getBufferEnd();
-  assert(*bufferEnd_ == 0 && "input buffer is not zero terminated");
-
-  curCharPtr_ = bufferStart_;
+Lexer::Lexer(ASTContext &context, const char *start, const char *end)
+    : context_(context) {
+  setInput(start, end);
 }
 
 Lexer::~Lexer() = default;
@@ -96,22 +81,25 @@ void Lexer::advance() {
 
     switch (CC::getClass(chFlags)) {
       case CC::WhitespaceClass:
-        // Whitespaces frequently come in groups, so keep keep going.
-        do
-          chFlags = getCharFlags(++curCharPtr_);
-        while (CC::getClass(chFlags) == CC::WhitespaceClass);
+        // Whitespaces frequently come in groups, so keep keep going. Most runs
+        // are a single character, but if there is more than one, it is
+        // likely indentation, so switch to the vectorized scanner.
+        chFlags = getCharFlags(++curCharPtr_);
+        if (CC::getClass(chFlags) == CC::WhitespaceClass) {
+          curCharPtr_ = scanWhitespace(curCharPtr_ + 1, bufferEnd_);
+          chFlags = getCharFlags(curCharPtr_);
+        }
         break;
 
       case CC::InitialClass: {
         token.setStart(curCharPtr_);
-        const char *end = curCharPtr_;
-        do
-          ++end;
-        while (CC::testSubsequent(getCharFlags(end)));
+        const char *end = scanSubsequent(curCharPtr_ + 1, bufferEnd_);
+        StringRef name{curCharPtr_, (size_t)(end - curCharPtr_)};
 
         token.setEnd(end);
-        token.setIdentifier(
-            getIdentifier(StringRef(curCharPtr_, end - curCharPtr_)));
+        // Hash the name while it is still in L1. The hash reads whole words,
+        // which is cheaper than hashing a character at a time in the scan.
+        token.setIdentifier(getIdentifier(name, hashString(name)));
         curCharPtr_ = end;
 
         skipUntilDelimiter();
@@ -138,9 +126,7 @@ void Lexer::advance() {
             }
             return;
           }
-          do
-            ++end;
-          while (CC::testSubsequent(getCharFlags(end)));
+          end = scanSubsequent(end + 1, bufferEnd_);
         } else {
           // "+"/"-" something.
           assert((*end == '+' || *end == '-') && "invalid character flags");
@@ -158,14 +144,10 @@ void Lexer::advance() {
                 // TODO: is this really intended to be a valid identifier?
               }
             } else {
-              do
-                ++end;
-              while (CC::testSubsequent(getCharFlags(end)));
+              end = scanSubsequent(end + 1, bufferEnd_);
             }
           } else if (CC::testSignSubsequent(getCharFlags(end))) {
-            do
-              ++end;
-            while (CC::testSubsequent(getCharFlags(end)));
+            end = scanSubsequent(end + 1, bufferEnd_);
           } else if (*end >= '0' && *end <= '9') {
             // A number.
             parseNumberDigits(
@@ -199,6 +181,61 @@ void Lexer::advance() {
             token.setEnd(curCharPtr_);
             token.setKind(TokenKind::datum_comment);
             return;
+
+          case '\\':
+            parseCharacter(curCharPtr_ - 1);
+            return;
+
+          case '(':
+            ++curCharPtr_;
+            token.setEnd(curCharPtr_);
+            token.setKind(TokenKind::l_vector);
+            return;
+
+          case '0':
+          case '1':
+          case '2':
+          case '3':
+          case '4':
+          case '5':
+          case '6':
+          case '7':
+          case '8':
+          case '9':
+            if (parseDatumLabel(curCharPtr_ - 1))
+              return;
+            break;
+
+          case 'u':
+            // The buffer is zero terminated, so this stops at the end.
+            if (curCharPtr_[1] == '8' && curCharPtr_[2] == '(') {
+              curCharPtr_ += 3;
+              token.setEnd(curCharPtr_);
+              token.setKind(TokenKind::l_bytevector);
+              return;
+            }
+            break;
+
+          case '|':
+            skipBlockComment(curCharPtr_ - 1);
+            chFlags = getCharFlags(curCharPtr_);
+            continue;
+
+          // Number prefixes.
+          case 'b':
+          case 'B':
+          case 'o':
+          case 'O':
+          case 'd':
+          case 'D':
+          case 'x':
+          case 'X':
+          case 'e':
+          case 'E':
+          case 'i':
+          case 'I':
+            parseNumberPrefix(curCharPtr_ - 1);
+            return;
         }
         token.setEnd(curCharPtr_);
         error("invalid token");
@@ -207,9 +244,14 @@ void Lexer::advance() {
         continue;
 
       case CC::UTF8Class:
-        error(SMLoc::getFromPointer(curCharPtr_), "unsupported character");
+        if (!error(
+                SMLoc::getFromPointer(curCharPtr_), "unsupported character")) {
+          chFlags = getCharFlags(curCharPtr_);
+          break;
+        }
         // Skip all UTF8 characters.
-        while (CC::getClass(getCharFlags(++curCharPtr_)) == CC::UTF8Class) {
+        while (CC::getClass(chFlags = getCharFlags(++curCharPtr_)) ==
+               CC::UTF8Class) {
         }
         break;
 
@@ -252,15 +294,33 @@ void Lexer::advance() {
               token.setKind(TokenKind::eof);
               return;
             }
-            error(SMLoc::getFromPointer(curCharPtr_), "unsupported character");
-            ++curCharPtr_;
+            // Reaching the error limit moves us to EOF, so don't skip then.
+            if (error(
+                    SMLoc::getFromPointer(curCharPtr_),
+                    "unsupported character")) {
+              ++curCharPtr_;
+            }
+            chFlags = getCharFlags(curCharPtr_);
             break;
 
+          case '"':
+            parseString(curCharPtr_);
+            return;
+
           case ';': // Line comment.
             skipLineComment(curCharPtr_);
             chFlags = getCharFlags(curCharPtr_);
             break;
 
+          default:
+            if (error(
+                    SMLoc::getFromPointer(curCharPtr_),
+                    "unsupported character")) {
+              ++curCharPtr_;
+            }
+            chFlags = getCharFlags(curCharPtr_);
+            break;
+
 #undef CHTOK
         }
     }
@@ -280,8 +340,10 @@ void Lexer::_skipUntilDelimiterSlowPath(bool errorReported) {
     return;
 
   // Otherwise it is an error and we must skip until a delimiter.
-  if (!errorReported)
-    error(SMLoc::getFromPointer(curCharPtr_), "delimiter expected");
+  if (!errorReported &&
+      !error(SMLoc::getFromPointer(curCharPtr_), "delimiter expected")) {
+    return;
+  }
   ++curCharPtr_;
   while (!CC::testDelimiter(getCharFlags(curCharPtr_))) {
     if (!*curCharPtr_ && curCharPtr_ == bufferEnd_)
@@ -290,6 +352,154 @@ void Lexer::_skipUntilDelimiterSlowPath(bool errorReported) {
   }
 }
 
+void Lexer::parseNumberPrefix(const char *start) {
+  const char *ptr = start;
+  int radix = 0;
+  llvm::Optional<bool> exact;
+
+  // At most one radix and one exactness prefix, in any order.
+  while (*ptr == '#') {
+    bool valid;
+    switch (ptr[1] | 32) {
+      case 'b':
+        valid = !radix;
+        radix = 2;
+        break;
+      case 'o':
+        valid = !radix;
+        radix = 8;
+        break;
+      case 'd':
+        valid = !radix;
+        radix = 10;
+        break;
+      case 'x':
+        valid = !radix;
+        radix = 16;
+        break;
+      case 'e':
+        valid = !exact.hasValue();
+        exact = true;
+        break;
+      case 'i':
+        valid = !exact.hasValue();
+        exact = false;
+        break;
+      default:
+        valid = false;
+        break;
+    }
+    if (!valid) {
+      invalidNumber(ptr, "invalid number prefix");
+      return;
+    }
+    ptr += 2;
+  }
+  if (!radix)
+    radix = 10;
+
+  int sign = 1;
+  if (*ptr == '+' || *ptr == '-') {
+    if (*ptr == '-')
+      sign = -1;
+    ++ptr;
+  }
+
+  // There must be at least one digit.
+  if (getDigitValue(ptr) < (unsigned)radix ||
+      (radix == 10 && *ptr == '.' && getDigitValue(ptr + 1) < 10)) {
+    parseNumberDigits(ptr, exact, radix, sign);
+  } else {
+    invalidNumber(ptr, "invalid number: digit expected");
+  }
+}
+
+void Lexer::invalidNumber(const char *ptr, const char *msg) {
+  curCharPtr_ = ptr;
+  token.setEnd(ptr);
+  token.setNumber(context_.makeExactNumber(0));
+  error(SMLoc::getFromPointer(ptr), msg);
+  skipUntilDelimiter(true);
+}
+
+/// Scan the digits in radix \p Radix starting at \p ptr, accumulating their
+/// value modulo 2^64 in \p value.
+/// \param[in,out] overflow set to true if the value doesn't fit in 64 bits.
+/// \return a pointer to the first character which is not a digit.
+template <unsigned Radix>
+static inline const char *
+scanDigits(const char *ptr, uint64_t &value, bool &overflow) {
+  for (unsigned d; (d = getDigitValue(ptr)) < Radix; ++ptr) {
+    // Only check precisely for overflow when we are close to it.
+    if (LLVM_UNLIKELY(value >= UINT64_MAX / Radix) &&
+        value > (UINT64_MAX - d) / Radix) {
+      overflow = true;
+    }
+    value = value * Radix + d;
+  }
+  return ptr;
+}
+
+/// Convert the syntactically valid decimal real number \p str to an exact
+/// integer.
+/// \return false if the number is not an integer or doesn't fit in 64 bits.
+static bool decimalToExact(StringRef str, uint64_t &result) {
+  const char *ptr = str.begin();
+  const char *end = str.end();
+
+  // Find the end of the mantissa and the number of fraction digits.
+  const char *mantEnd = ptr;
+  const char *dot = nullptr;
+  for (; mantEnd != end && (*mantEnd | 32) != 'e'; ++mantEnd) {
+    if (*mantEnd == '.')
+      dot = mantEnd;
+  }
+  int64_t numDigits = mantEnd - ptr - (dot ? 1 : 0);
+  int64_t exp10 = dot ? -(mantEnd - dot - 1) : 0;
+
+  if (mantEnd != end) {
+    const char *e = mantEnd + 1;
+    bool negative = *e == '-';
+    if (*e == '+' || *e == '-')
+      ++e;
+    // Saturate, but only beyond what the digits can compensate for, so the
+    // result still overflows or is not an integer.
+    const int64_t maxExp = numDigits + 100000;
+    int64_t expValue = 0;
+    for (; e != end; ++e) {
+      if (expValue < maxExp)
+        expValue = expValue * 10 + (*e - '0');
+    }
+    exp10 += negative ? -expValue : expValue;
+  }
+
+  // A negative exponent drops trailing digits, which must all be zero.
+  int64_t keep = exp10 < 0 ? numDigits + exp10 : numDigits;
+  uint64_t value = 0;
+  bool overflow = false;
+  for (int64_t i = 0; ptr != mantEnd; ++ptr) {
+    if (*ptr == '.')
+      continue;
+    unsigned d = *ptr - '0';
+    if (i++ < keep) {
+      if (value > (UINT64_MAX - d) / 10)
+        overflow = true;
+      value = value * 10 + d;
+    } else if (d) {
+      return false;
+    }
+  }
+
+  for (; exp10 > 0 && value && !overflow; --exp10) {
+    if (value > UINT64_MAX / 10)
+      overflow = true;
+    value *= 10;
+  }
+
+  result = value;
+  return !overflow;
+}
+
 void Lexer::parseNumberDigits(
     const char *start,
     llvm::Optional<bool> exact,
@@ -299,10 +509,13 @@ void Lexer::parseNumberDigits(
 
   const char *ptr = start;
   bool real = false;
+  // The value of the leading integer digits modulo 2^64, accumulated while
+  // scanning them.
+  uint64_t intValue = 0;
+  bool overflow = false;
 
   if (LLVM_LIKELY(radix == 10)) {
-    while (*ptr >= '0' && *ptr <= '9')
-      ++ptr;
+    ptr = scanDigits<10>(ptr, intValue, overflow);
 
     if (*ptr == '.') {
       ++ptr;
@@ -348,9 +561,18 @@ void Lexer::parseNumberDigits(
     }
   end:;
   } else {
-    while ((*ptr >= '0' && *ptr <= '9' && *ptr < radix + '0') ||
-           (radix == 16 && (*ptr | 32) >= 'a' && (*ptr | 32) <= 'f')) {
-      ++ptr;
+    switch (radix) {
+      case 2:
+        ptr = scanDigits<2>(ptr, intValue, overflow);
+        break;
+      case 8:
+        ptr = scanDigits<8>(ptr, intValue, overflow);
+        break;
+      case 16:
+        ptr = scanDigits<16>(ptr, intValue, overflow);
+        break;
+      default:
+        llvm_unreachable("invalid radix");
     }
   }
 
@@ -364,35 +586,39 @@ void Lexer::parseNumberDigits(
     exact = !real;
 
   if (real && exact.getValue()) {
-    error("real number cannot be represented as exact");
-    number = context_.makeExactNumber(0);
+    // There are no rationals, so only integral reals can be made exact.
+    if (!decimalToExact(str, intValue)) {
+      error("real number cannot be represented as exact");
+      intValue = 0;
+    }
+    if (sign < 0)
+      intValue = 0 - intValue;
+    number = context_.makeExactNumber((ExactNumberT)intValue);
   } else if (!exact.getValue() && radix == 10) {
-    double inexactRes;
-    str.getAsDouble(inexactRes, true);
+    double inexactRes = parseDecimalDouble(str);
     if (sign < 0)
       inexactRes = -inexactRes;
     number = context_.makeInexactNumber(inexactRes);
+  } else if (exact.getValue()) {
+    if (overflow)
+      error("number overflows exact range");
+    // On overflow we keep the low 64 bits.
+    if (sign < 0)
+      intValue = 0 - intValue;
+    number = context_.makeExactNumber((ExactNumberT)intValue);
   } else {
-    llvm::APInt iresult{64, 0};
-    str.getAsInteger(radix, iresult);
-
-    if (exact.getValue()) {
-      ExactNumberT exactRes;
-      if (iresult.getActiveBits() <= 64) {
-        exactRes = iresult.getZExtValue();
-      } else {
-        error("number overflows exact range");
-        exactRes = iresult.getLoBits(64).getZExtValue();
-      }
-      if (sign < 0)
-        exactRes = -exactRes;
-      number = context_.makeExactNumber(exactRes);
+    double inexactRes;
+    if (LLVM_LIKELY(!overflow)) {
+      // The conversion is correctly rounded.
+      inexactRes = (double)intValue;
     } else {
-      auto aDouble = iresult.roundToDouble();
-      if (sign < 0)
-        aDouble = -aDouble;
-      number = context_.makeInexactNumber(aDouble);
+      llvm::APInt iresult{64, 0};
+      str.getAsInteger(radix, iresult);
+      inexactRes = iresult.roundToDouble();
     }
+    if (sign < 0)
+      inexactRes = -inexactRes;
+    number = context_.makeInexactNumber(inexactRes);
   }
 
   token.setNumber(number);
@@ -400,29 +626,295 @@ void Lexer::parseNumberDigits(
   skipUntilDelimiter();
 }
 
+void Lexer::parseCharacter(const char *start) {
+  assert(start[0] == '#' && start[1] == '\\' && "invalid character literal");
+  token.setStart(start);
+  const char *ptr = start + 2;
+
+  if (LLVM_UNLIKELY(ptr == bufferEnd_)) {
+    curCharPtr_ = ptr;
+    token.setEnd(ptr);
+    token.setCharacter(0);
+    error("character expected");
+    return;
+  }
+
+  const char *nameStart = ptr;
+  uint32_t ch;
+  if (LLVM_LIKELY(!isUTF8Start(*ptr))) {
+    ch = (unsigned char)*ptr++;
+  } else {
+    ch = decodeUTF8<false>(ptr, [this, nameStart](const llvm::Twine &msg) {
+      error(SMLoc::getFromPointer(nameStart), msg);
+    });
+  }
+
+  // The common case: a single character followed by a delimiter.
+  if (LLVM_LIKELY(CC::testDelimiter(getCharFlags(ptr)) || ptr == bufferEnd_)) {
+    curCharPtr_ = ptr;
+    token.setEnd(ptr);
+    token.setCharacter(ch);
+    return;
+  }
+
+  // A character name or a hex scalar value extend until the next delimiter.
+  const char *end = ptr;
+  while (!CC::testDelimiter(getCharFlags(end)) && end != bufferEnd_)
+    ++end;
+  StringRef name{nameStart, (size_t)(end - nameStart)};
+
+  curCharPtr_ = end;
+  token.setEnd(end);
+
+  if (ch == 'x' || ch == 'X') {
+    uint32_t cp = 0;
+    const char *p = nameStart + 1;
+    for (unsigned d; (d = getDigitValue(p)) < 16; ++p) {
+      if (cp <= UNICODE_MAX_VALUE)
+        cp = cp * 16 + d;
+    }
+    if (p == end) {
+      if (cp > UNICODE_MAX_VALUE ||
+          (cp >= UNICODE_SURROGATE_FIRST && cp <= UNICODE_SURROGATE_LAST)) {
+        error("invalid Unicode scalar value");
+        cp = UNICODE_REPLACEMENT_CHARACTER;
+      }
+      token.setCharacter(cp);
+      return;
+    }
+  }
+
+  int32_t code = lookupCharName(name);
+  if (code < 0) {
+    error("invalid character name");
+    code = ch;
+  }
+  token.setCharacter(code);
+}
+
+bool Lexer::parseDatumLabel(const char *start) {
+  assert(start[0] == '#' && start[1] >= '0' && start[1] <= '9');
+
+  // Labels are limited to 31 bits, so they never clash with the reserved
+  // keys of a hash table.
+  static constexpr uint32_t kMaxLabel = INT32_MAX;
+  const char *ptr = start + 1;
+  uint32_t label = 0;
+  bool tooLarge = false;
+  for (; *ptr >= '0' && *ptr <= '9'; ++ptr) {
+    if (label > (kMaxLabel - (*ptr - '0')) / 10)
+      tooLarge = true;
+    else
+      label = label * 10 + (*ptr - '0');
+  }
+  if (*ptr != '=' && *ptr != '#')
+    return false;
+
+  token.setLabel(
+      *ptr == '=' ? TokenKind::label_def : TokenKind::label_ref, label);
+  curCharPtr_ = ptr + 1;
+  token.setEnd(curCharPtr_);
+  if (tooLarge)
+    error("datum label is too large");
+  return true;
+}
+
+void Lexer::parseString(const char *start) {
+  assert(*start == '"' && "invalid string literal");
+  token.setStart(start);
+  ++start;
+
+  const char *ptr = scanQuoteOrBackslash(start, bufferEnd_);
+  if (LLVM_UNLIKELY(*ptr != '"')) {
+    _parseEscapedString(start, ptr);
+    return;
+  }
+
+  // No escapes, so intern the string directly from the source.
+  token.setString(getIdentifier(StringRef(start, ptr - start)));
+  curCharPtr_ = ptr + 1;
+  token.setEnd(curCharPtr_);
+}
+
+void Lexer::_parseEscapedString(const char *start, const char *esc) {
+  // Find the closing quote first, so we know how large the buffer must be. The
+  // decoded string is never longer than the source.
+  const char *strEnd = esc;
+  while (strEnd != bufferEnd_ && *strEnd != '"') {
+    // Skip the backslash and the escaped character.
+    if (strEnd + 1 != bufferEnd_)
+      ++strEnd;
+    strEnd = scanQuoteOrBackslash(strEnd + 1, bufferEnd_);
+  }
+
+  stringBuf_.resize(strEnd - start);
+  char *buf = stringBuf_.data();
+  char *dst = buf;
+  const char *ptr = start;
+  // Set when an error reaches the error limit and forces an EOF.
+  bool aborted = false;
+  for (;;) {
+    memcpy(dst, ptr, esc - ptr);
+    dst += esc - ptr;
+    ptr = esc;
+    if (ptr == strEnd)
+      break;
+
+    assert(*ptr == '\\' && "escape expected");
+    const char *escStart = ptr++;
+    switch (*ptr) {
+      case 'a':
+        *dst++ = '\a';
+        ++ptr;
+        break;
+      case 'b':
+        *dst++ = '\b';
+        ++ptr;
+        break;
+      case 't':
+        *dst++ = '\t';
+        ++ptr;
+        break;
+      case 'n':
+        *dst++ = '\n';
+        ++ptr;
+        break;
+      case 'r':
+        *dst++ = '\r';
+        ++ptr;
+        break;
+      case '"':
+      case '\\':
+      case '|':
+        *dst++ = *ptr++;
+        break;
+
+      case 'x':
+      case 'X': {
+        ++ptr;
+        uint32_t cp = 0;
+        bool valid = getDigitValue(ptr) < 16;
+        for (unsigned d; (d = getDigitValue(ptr)) < 16; ++ptr) {
+          if (cp <= UNICODE_MAX_VALUE)
+            cp = cp * 16 + d;
+        }
+        if (*ptr == ';')
+          ++ptr;
+        else
+          valid = false;
+        if (!valid) {
+          aborted = !error(
+              SMRange(
+                  SMLoc::getFromPointer(escStart), SMLoc::getFromPointer(ptr)),
+              "invalid hex escape");
+        } else if (
+            cp > UNICODE_MAX_VALUE ||
+            (cp >= UNICODE_SURROGATE_FIRST && cp <= UNICODE_SURROGATE_LAST)) {
+          aborted = !error(
+              SMRange(
+                  SMLoc::getFromPointer(escStart), SMLoc::getFromPointer(ptr)),
+              "invalid Unicode scalar value");
+        } else {
+          encodeUTF8(dst, cp);
+        }
+        break;
+      }
+
+      default: {
+        // A line continuation: \<intraline whitespace>*<line ending>
+        // <intraline whitespace>*.
+        const char *p = ptr;
+        while (*p == ' ' || *p == '\t')
+          ++p;
+        if (p != strEnd && (*p == '\n' || *p == '\r')) {
+          if (*p == '\r' && p[1] == '\n')
+            ++p;
+          ++p;
+          while (*p == ' ' || *p == '\t')
+            ++p;
+          ptr = p;
+        } else {
+          // Keep the escaped character.
+          aborted = !error(
+              SMLoc::getFromPointer(escStart), "invalid escape sequence");
+          if (ptr != strEnd)
+            *dst++ = *ptr++;
+        }
+        break;
+      }
+    }
+
+    // None of the escapes can consume the closing quote or the terminating
+    // zero.
+    assert(ptr <= strEnd && "escape consumed the end of the string");
+    if (LLVM_UNLIKELY(aborted))
+      break;
+    esc = scanQuoteOrBackslash(ptr, strEnd);
+  }
+
+  // Copy only when the string is new.
+  token.setString(getIdentifier(StringRef(buf, dst - buf)));
+  if (LLVM_UNLIKELY(aborted)) {
+    // Keep the EOF forced by error(), and end the token where decoding
+    // stopped.
+    token.setEnd(ptr);
+    return;
+  }
+  if (strEnd == bufferEnd_) {
+    error(token.getStartLoc(), "unterminated string");
+    curCharPtr_ = strEnd;
+  } else {
+    curCharPtr_ = strEnd + 1;
+  }
+  token.setEnd(curCharPtr_);
+}
+
 void Lexer::skipLineComment(const char *start) {
   assert(*start == ';' && "invalid line comment");
-  ++start;
+  const char *eol = scanLineEnd(start + 1, bufferEnd_);
+  // Consume the line terminator, unless we reached EOF.
+  curCharPtr_ = eol != bufferEnd_ ? eol + 1 : eol;
+}
+
+void Lexer::skipBlockComment(const char *start) {
+  assert(start[0] == '#' && start[1] == '|' && "invalid block comment");
+  const char *ptr = start + 2;
+  unsigned depth = 1;
+
+  // Only "|#" and "#|" matter, so jump from one '|' or '#' to the next. The
+  // input is zero terminated, so we can always look at the next character.
   for (;;) {
-    switch (*start) {
-      case '\r':
-      case '\n':
-        ++start;
-        goto endLoop;
-
-      case 0:
-        if (curCharPtr_ == bufferEnd_)
-          goto endLoop;
-        // fallthrough.
-      default:
-        ++start;
+    ptr = scanBarOrHash(ptr, bufferEnd_);
+    if (LLVM_UNLIKELY(ptr == bufferEnd_)) {
+      error(
+          SMRange(
+              SMLoc::getFromPointer(start), SMLoc::getFromPointer(start + 2)),
+          "unterminated block comment");
+      curCharPtr_ = ptr;
+      return;
+    }
+
+    if (*ptr == '|') {
+      if (ptr[1] == '#') {
+        ptr += 2;
+        if (--depth == 0)
+          break;
+        continue;
+      }
+    } else if (ptr[1] == '|') {
+      ptr += 2;
+      ++depth;
+      continue;
     }
+    ++ptr;
   }
-endLoop:
-  curCharPtr_ = start;
+
+  curCharPtr_ = ptr;
 }
 
 bool Lexer::error(llvm::SMLoc loc, const llvm::Twine &msg) {
+  if (LLVM_UNLIKELY(deferredErrors_))
+    return deferError(loc, SMRange{}, msg);
   context_.sm.error(loc, msg);
   if (!context_.sm.isErrorLimitReached())
     return true;
@@ -431,6 +923,8 @@ bool Lexer::error(llvm::SMLoc loc, const llvm::Twine &msg) {
 }
 
 bool Lexer::error(llvm::SMRange range, const llvm::Twine &msg) {
+  if (LLVM_UNLIKELY(deferredErrors_))
+    return deferError(range.Start, range, msg);
   context_.sm.error(range, msg);
   if (!context_.sm.isErrorLimitReached())
     return true;
@@ -442,6 +936,8 @@ bool Lexer::error(
     llvm::SMLoc loc,
     llvm::SMRange range,
     const llvm::Twine &msg) {
+  if (LLVM_UNLIKELY(deferredErrors_))
+    return deferError(loc, range, msg);
   context_.sm.error(loc, range, msg);
   if (!context_.sm.isErrorLimitReached())
     return true;
@@ -449,5 +945,14 @@ bool Lexer::error(
   return false;
 }
 
+bool Lexer::deferError(SMLoc loc, SMRange range, const llvm::Twine &msg) {
+  deferredErrors_->push_back({loc, range, msg.str()});
+  if (LLVM_LIKELY(
+          !deferredErrorLimit_ || ++numDeferredErrors_ != deferredErrorLimit_))
+    return true;
+  forceEOF();
+  return false;
+}
+
 } // namespace parser
 } // namespace s2020
\ No newline at end of file
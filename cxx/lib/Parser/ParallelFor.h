@@ -0,0 +1,34 @@
+#ifndef SCHEME2020_PARSER_PARALLELFOR_H
+#define SCHEME2020_PARSER_PARALLELFOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace s2020 {
+namespace parser {
+
+/// Call fn(thread, i) for every i in [0, count), distributing the calls
+/// between \p numThreads threads, including the calling one.
+template <typename F>
+void parallelFor(unsigned numThreads, size_t count, const F &fn) {
+  std::atomic<size_t> next{0};
+  auto work = [&next, count, &fn](unsigned thread) {
+    for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+      fn(thread, i);
+  };
+
+  numThreads = (unsigned)std::min<size_t>(numThreads, count);
+  std::vector<std::thread> threads{};
+  for (unsigned t = 1; t < numThreads; ++t)
+    threads.emplace_back(work, t);
+  work(0);
+  for (auto &thread : threads)
+    thread.join();
+}
+
+} // namespace parser
+} // namespace s2020
+
+#endif // SCHEME2020_PARSER_PARALLELFOR_H
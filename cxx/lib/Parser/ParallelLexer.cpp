@@ -0,0 +1,564 @@
+#include "s2020/Parser/ParallelLexer.h"
+
+#include "s2020/Parser/SIMDScan.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace s2020 {
+namespace parser {
+
+namespace {
+
+/// Chunks are never smaller than this, so the per-chunk overhead stays
+/// negligible.
+constexpr size_t kMinChunkSize = 64 * 1024;
+
+/// The number of chunks per thread. More chunks than threads balance the load
+/// when some chunks are slower to lex than others.
+constexpr unsigned kChunksPerThread = 4;
+
+} // anonymous namespace
+
+class ParallelLexer {
+ public:
+  explicit ParallelLexer(
+      ASTContext &context,
+      const llvm::MemoryBuffer &input,
+      unsigned numThreads,
+      bool deferErrors)
+      : context_(context),
+        input_(input),
+        bufferStart_(input.getBufferStart()),
+        size_((uint32_t)input.getBufferSize()),
+        numThreads_(numThreads),
+        deferErrors_(deferErrors) {}
+
+  TokenStream run();
+
+ private:
+  /// The tokens lexed from one starting position.
+  struct Run {
+    TokenStream tokens;
+    /// The offset where lexing started.
+    uint32_t start;
+    /// resume[i] is the offset where lexing continues after token i.
+    std::vector<uint32_t> resume{};
+    /// Errors reported while lexing, in order.
+    std::vector<DeferredLexerError> errors{};
+    /// errorTokens[i] is the index of the token which reported errors[i].
+    std::vector<uint32_t> errorTokens{};
+    /// Tokens of the catch-up lexer use the caller's context. Unless errors
+    /// are deferred, they have already reported their errors instead of
+    /// recording them.
+    bool native = false;
+    /// Whether an alternative run reached a position of the main run of its
+    /// chunk, after which the two would be identical.
+    bool joined = false;
+    /// If joined, the number of main run tokens preceding the join.
+    uint32_t joinIndex = 0;
+
+    explicit Run(const char *bufferStart, uint32_t start)
+        : tokens(bufferStart), start(start) {}
+
+    uint32_t size() const {
+      return (uint32_t)resume.size();
+    }
+
+    /// \return the offset after the first \p n tokens.
+    uint32_t position(uint32_t n) const {
+      return n ? resume[n - 1] : start;
+    }
+
+    /// \return n such that position(n) == pos, or -1 if there is none.
+    int64_t find(uint32_t pos) const {
+      if (pos == start)
+        return 0;
+      auto it = std::lower_bound(resume.begin(), resume.end(), pos);
+      if (it == resume.end() || *it != pos)
+        return -1;
+      return it - resume.begin() + 1;
+    }
+  };
+
+  struct Chunk {
+    uint32_t start;
+    uint32_t end;
+    /// Lexed from the start of the chunk.
+    std::unique_ptr<Run> main{};
+    /// Lexed from the end of a string or block comment open at the start.
+    std::vector<std::unique_ptr<Run>> alternatives{};
+  };
+
+  /// A range of tokens of a run which is part of the result.
+  struct Segment {
+    const Run *run;
+    uint32_t from;
+    uint32_t to;
+    /// The index of the first token, identifier and number in the result.
+    uint32_t outToken = 0;
+    uint32_t outIdent = 0;
+    uint32_t outNumber = 0;
+
+    Segment(const Run *run, uint32_t from, uint32_t to)
+        : run(run), from(from), to(to) {}
+  };
+
+  void splitChunks();
+
+  void lexChunk(ASTContext &context, Chunk &chunk);
+
+  /// Lex from \p start until the resume position reaches \p end or eof. If
+  /// \p main is not null, stop as soon as the run joins it.
+  std::unique_ptr<Run>
+  lexRun(ASTContext &context, uint32_t start, uint32_t end, const Run *main);
+
+  /// \return the offset after the string literal that would be open at
+  ///     \p start, or -1 if it doesn't end before \p end.
+  int64_t findStringEnd(uint32_t start, uint32_t end) const;
+
+  /// \return the offset after the block comment that would be open at
+  ///     \p start, or -1 if it doesn't end before \p end.
+  int64_t findBlockCommentEnd(uint32_t start, uint32_t end) const;
+
+  /// Pick the speculative runs that continue from the start of the buffer
+  /// and build the list of segments of the result.
+  void stitch();
+
+  /// Append tokens [from, to) of \p run to the result and replay or defer
+  /// their errors, updating pos_.
+  /// \return true if the result is complete.
+  bool append(const Run &run, uint32_t from, uint32_t to);
+
+  /// Lex serially from pos_ until reaching a position of \p main, \p end or
+  /// eof. On reaching a position of \p main, continue with it.
+  /// \return true if the result is complete.
+  bool catchUp(const Run *main, uint32_t end);
+
+  /// The error limit was reached while replaying the \p numErrors-th error of
+  /// the token at pos_. Lex it again, stopping at that error like the serial
+  /// lexer, and end the result with eof.
+  void finishAfterErrorLimit(unsigned numErrors);
+
+  /// Copy the segments into a TokenStream, moving identifiers and strings to
+  /// the caller's context.
+  TokenStream assemble();
+
+  Run *newNativeRun() {
+    catchUps_.emplace_back(new Run(bufferStart_, pos_));
+    catchUps_.back()->native = true;
+    return catchUps_.back().get();
+  }
+
+  SMLoc locAt(uint32_t offset) const {
+    return SMLoc::getFromPointer(bufferStart_ + offset);
+  }
+  uint32_t offsetOf(SMLoc loc) const {
+    return (uint32_t)(loc.getPointer() - bufferStart_);
+  }
+
+ private:
+  ASTContext &context_;
+  const llvm::MemoryBuffer &input_;
+  const char *const bufferStart_;
+  const uint32_t size_;
+  const unsigned numThreads_;
+  const bool deferErrors_;
+
+  std::vector<Chunk> chunks_{};
+  /// Runs lexed serially in the caller's context while stitching.
+  std::vector<std::unique_ptr<Run>> catchUps_{};
+  std::vector<Segment> segments_{};
+  /// The offset up to which the result has been stitched.
+  uint32_t pos_ = 0;
+  /// The number of tokens in segments_.
+  uint32_t numTokens_ = 0;
+  /// The deferred errors of the result and the indices of their tokens.
+  std::vector<DeferredLexerError> errors_{};
+  std::vector<uint32_t> errorTokens_{};
+};
+
+TokenStream ParallelLexer::run() {
+  auto numErrors = context_.sm.getErrorCount();
+
+  splitChunks();
+
+  // Every thread gets a private context, since string tables and allocators
+  // are not thread safe. The buffer is registered without copying it.
+  std::vector<std::unique_ptr<ASTContext>> contexts{};
+  for (unsigned t = 0; t != numThreads_; ++t) {
+    contexts.emplace_back(new ASTContext());
+    contexts.back()->sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+        input_.getBuffer(), input_.getBufferIdentifier(), true));
+  }
+
+  parallelFor(
+      numThreads_, chunks_.size(), [this, &contexts](unsigned t, size_t i) {
+        lexChunk(*contexts[t], chunks_[i]);
+      });
+
+  stitch();
+  TokenStream stream = assemble();
+  stream.hasErrors_ =
+      numErrors != context_.sm.getErrorCount() || !errors_.empty();
+  stream.errors_ = std::move(errors_);
+  stream.errorTokens_ = std::move(errorTokens_);
+  return stream;
+}
+
+void ParallelLexer::splitChunks() {
+  size_t numChunks = std::min<size_t>(
+      (size_t)numThreads_ * kChunksPerThread, size_ / kMinChunkSize);
+
+  uint32_t start = 0;
+  for (size_t i = 1; i < numChunks; ++i) {
+    uint32_t target = (uint32_t)((uint64_t)size_ * i / numChunks);
+    if (target <= start)
+      continue;
+    // A chunk starts after a newline, where no line comment can be open.
+    const void *nl = memchr(bufferStart_ + target, '\n', size_ - target);
+    if (!nl)
+      break;
+    uint32_t end = offsetOf(SMLoc::getFromPointer((const char *)nl + 1));
+    if (end >= size_)
+      break;
+    chunks_.emplace_back();
+    chunks_.back().start = start;
+    chunks_.back().end = end;
+    start = end;
+  }
+  chunks_.emplace_back();
+  chunks_.back().start = start;
+  chunks_.back().end = size_;
+}
+
+void ParallelLexer::lexChunk(ASTContext &context, Chunk &chunk) {
+  chunk.main = lexRun(context, chunk.start, chunk.end, nullptr);
+  // The first chunk always starts in the normal state.
+  if (chunk.start == 0)
+    return;
+
+  int64_t alt = findStringEnd(chunk.start, chunk.end);
+  if (alt >= 0)
+    chunk.alternatives.push_back(
+        lexRun(context, (uint32_t)alt, chunk.end, chunk.main.get()));
+  alt = findBlockCommentEnd(chunk.start, chunk.end);
+  if (alt >= 0)
+    chunk.alternatives.push_back(
+        lexRun(context, (uint32_t)alt, chunk.end, chunk.main.get()));
+}
+
+std::unique_ptr<ParallelLexer::Run> ParallelLexer::lexRun(
+    ASTContext &context,
+    uint32_t start,
+    uint32_t end,
+    const Run *main) {
+  std::unique_ptr<Run> run{new Run(bufferStart_, start)};
+  if (main) {
+    int64_t n = main->find(start);
+    if (n >= 0) {
+      run->joined = true;
+      run->joinIndex = (uint32_t)n;
+      return run;
+    }
+  }
+
+  Lexer lex{context, input_};
+  lex.seek(locAt(start));
+  lex.setDeferredErrors(&run->errors);
+
+  uint32_t mainIndex = 0;
+  for (;;) {
+    lex.advance();
+    uint32_t pos = offsetOf(lex.getCurLoc());
+    run->errorTokens.resize(run->errors.size(), run->size());
+    run->tokens.push(lex.token);
+    run->resume.push_back(pos);
+    if (lex.token.getKind() == TokenKind::eof || pos >= end)
+      break;
+
+    if (main) {
+      while (mainIndex < main->size() && main->resume[mainIndex] < pos)
+        ++mainIndex;
+      if (mainIndex < main->size() && main->resume[mainIndex] == pos) {
+        run->joined = true;
+        run->joinIndex = mainIndex + 1;
+        break;
+      }
+    }
+  }
+
+  return run;
+}
+
+int64_t ParallelLexer::findStringEnd(uint32_t start, uint32_t end) const {
+  const char *chunkEnd = bufferStart_ + end;
+  const char *ptr = bufferStart_ + start;
+  for (;;) {
+    ptr = scanQuoteOrBackslash(ptr, chunkEnd);
+    if (ptr == chunkEnd)
+      return -1;
+    if (*ptr == '"')
+      return ptr + 1 - bufferStart_;
+    // Skip the backslash and the escaped character.
+    ptr = std::min(ptr + 2, chunkEnd);
+  }
+}
+
+int64_t ParallelLexer::findBlockCommentEnd(uint32_t start, uint32_t end)
+    const {
+  const char *chunkEnd = bufferStart_ + end;
+  const char *ptr = bufferStart_ + start;
+  unsigned depth = 1;
+  // The same loop as Lexer::skipBlockComment(). The buffer is zero
+  // terminated, so looking one character past the chunk is safe.
+  for (;;) {
+    ptr = scanBarOrHash(ptr, chunkEnd);
+    if (ptr == chunkEnd)
+      return -1;
+    if (*ptr == '|') {
+      if (ptr[1] == '#') {
+        ptr += 2;
+        if (--depth == 0)
+          return ptr - bufferStart_;
+        continue;
+      }
+    } else if (ptr[1] == '|') {
+      ptr += 2;
+      ++depth;
+      continue;
+    }
+    ++ptr;
+  }
+}
+
+void ParallelLexer::stitch() {
+  bool done = false;
+  for (const Chunk &chunk : chunks_) {
+    if (done)
+      return;
+    // The chunk may be entirely covered by a token which started earlier.
+    if (pos_ >= chunk.end)
+      continue;
+
+    const Run &main = *chunk.main;
+    int64_t n = main.find(pos_);
+    if (n >= 0) {
+      done = append(main, (uint32_t)n, main.size());
+      continue;
+    }
+
+    bool found = false;
+    for (const auto &alt : chunk.alternatives) {
+      n = alt->find(pos_);
+      if (n < 0)
+        continue;
+      found = true;
+      done = append(*alt, (uint32_t)n, alt->size());
+      if (!done && alt->joined)
+        done = append(main, alt->joinIndex, main.size());
+      break;
+    }
+    if (!found)
+      done = catchUp(&main, chunk.end);
+  }
+
+  if (!done)
+    catchUp(nullptr, size_);
+}
+
+bool ParallelLexer::append(const Run &run, uint32_t from, uint32_t to) {
+  if (from == to)
+    return false;
+
+  // A native run only has errors here when they are deferred.
+  auto it =
+      std::lower_bound(run.errorTokens.begin(), run.errorTokens.end(), from);
+  for (; it != run.errorTokens.end() && *it < to; ++it) {
+    const DeferredLexerError &err = run.errors[it - run.errorTokens.begin()];
+    if (deferErrors_) {
+      errors_.push_back(err);
+      errorTokens_.push_back(numTokens_ + (*it - from));
+      continue;
+    }
+    context_.sm.error(err.loc, err.range, err.msg);
+    if (context_.sm.isErrorLimitReached()) {
+      if (*it != from)
+        segments_.emplace_back(&run, from, *it);
+      pos_ = run.position(*it);
+      auto first = std::lower_bound(
+          run.errorTokens.begin(), run.errorTokens.end(), *it);
+      finishAfterErrorLimit((unsigned)(it - first) + 1);
+      return true;
+    }
+  }
+
+  segments_.emplace_back(&run, from, to);
+  numTokens_ += to - from;
+  pos_ = run.position(to);
+  return run.tokens.getKind(to - 1) == TokenKind::eof;
+}
+
+bool ParallelLexer::catchUp(const Run *main, uint32_t end) {
+  Run *run = newNativeRun();
+  Lexer lex{context_, input_};
+  lex.seek(locAt(pos_));
+  if (deferErrors_)
+    lex.setDeferredErrors(&run->errors);
+
+  uint32_t mainIndex = 0;
+  for (;;) {
+    lex.advance();
+    uint32_t pos = offsetOf(lex.getCurLoc());
+    run->errorTokens.resize(run->errors.size(), run->size());
+    run->tokens.push(lex.token);
+    run->resume.push_back(pos);
+    if (lex.token.getKind() == TokenKind::eof || pos >= end)
+      return append(*run, 0, run->size());
+
+    if (main) {
+      while (mainIndex < main->size() && main->resume[mainIndex] < pos)
+        ++mainIndex;
+      if (mainIndex < main->size() && main->resume[mainIndex] == pos) {
+        append(*run, 0, run->size());
+        return append(*main, mainIndex + 1, main->size());
+      }
+    }
+  }
+}
+
+void ParallelLexer::finishAfterErrorLimit(unsigned numErrors) {
+  Run *run = newNativeRun();
+  Lexer lex{context_, input_};
+  lex.seek(locAt(pos_));
+
+  // The errors have already been reported. The caller's context is past the
+  // limit, so a reporting lexer would stop at the first error of the token
+  // instead of the one which reached the limit.
+  std::vector<DeferredLexerError> errors{};
+  lex.setDeferredErrors(&errors);
+  lex.setDeferredErrorLimit(numErrors);
+  do {
+    lex.advance();
+    run->tokens.push(lex.token);
+    run->resume.push_back(offsetOf(lex.getCurLoc()));
+  } while (lex.token.getKind() != TokenKind::eof);
+
+  segments_.emplace_back(run, 0, run->size());
+  pos_ = size_;
+}
+
+TokenStream ParallelLexer::assemble() {
+  // Count the identifiers and numbers of every segment, so every segment
+  // knows where its part of the result goes.
+  std::vector<std::pair<uint32_t, uint32_t>> counts(segments_.size());
+  parallelFor(
+      numThreads_, segments_.size(), [this, &counts](unsigned, size_t i) {
+        const Segment &seg = segments_[i];
+        uint32_t idents = 0, numbers = 0;
+        for (uint32_t t = seg.from; t != seg.to; ++t) {
+          TokenKind kind = seg.run->tokens.getKind(t);
+          idents += kind == TokenKind::identifier || kind == TokenKind::string;
+          numbers += kind == TokenKind::number;
+        }
+        counts[i] = {idents, numbers};
+      });
+
+  uint32_t numTokens = 0, numIdents = 0, numNumbers = 0;
+  for (size_t i = 0; i != segments_.size(); ++i) {
+    segments_[i].outToken = numTokens;
+    segments_[i].outIdent = numIdents;
+    segments_[i].outNumber = numNumbers;
+    numTokens += segments_[i].to - segments_[i].from;
+    numIdents += counts[i].first;
+    numNumbers += counts[i].second;
+  }
+
+  TokenStream stream{bufferStart_};
+  stream.kinds_.resize(numTokens);
+  stream.starts_.resize(numTokens);
+  stream.lengths_.resize(numTokens);
+  stream.payloads_.resize(numTokens);
+  stream.identifiers_.resize(numIdents);
+  stream.numbers_.resize(numNumbers);
+
+  // Identifiers from the private contexts are interned in the caller's one.
+  // Every thread remembers what it has already interned, so the lock is only
+  // taken once per distinct string and thread.
+  std::mutex stringTableLock{};
+  std::vector<llvm::DenseMap<UniqueString *, Identifier>> caches(numThreads_);
+
+  parallelFor(
+      numThreads_,
+      segments_.size(),
+      [this, &stream, &stringTableLock, &caches](unsigned thread, size_t i) {
+        const Segment &seg = segments_[i];
+        const TokenStream &src = seg.run->tokens;
+        auto &cache = caches[thread];
+
+        auto remap = [&seg, &stringTableLock, &cache, this](
+                         Identifier id) -> Identifier {
+          if (seg.run->native)
+            return id;
+          auto it = cache.find(id.getUnderlyingPointer());
+          if (it != cache.end())
+            return it->second;
+          Identifier res;
+          {
+            std::lock_guard<std::mutex> lock{stringTableLock};
+            res = context_.stringTable.getIdentifier(
+                id.str(), id.getUnderlyingPointer()->hash());
+          }
+          cache[id.getUnderlyingPointer()] = res;
+          return res;
+        };
+
+        uint32_t out = seg.outToken;
+        uint32_t outIdent = seg.outIdent;
+        uint32_t outNumber = seg.outNumber;
+        for (uint32_t t = seg.from; t != seg.to; ++t, ++out) {
+          TokenKind kind = src.kinds_[t];
+          uint32_t payload = src.payloads_[t];
+          stream.kinds_[out] = kind;
+          stream.starts_[out] = src.starts_[t];
+          stream.lengths_[out] = src.lengths_[t];
+
+          switch (kind) {
+            case TokenKind::identifier:
+            case TokenKind::string:
+              stream.identifiers_[outIdent] =
+                  remap(src.identifiers_[payload]);
+              payload = outIdent++;
+              break;
+            case TokenKind::number:
+              stream.numbers_[outNumber] = src.numbers_[payload];
+              payload = outNumber++;
+              break;
+            default:
+              break;
+          }
+          stream.payloads_[out] = payload;
+        }
+      });
+
+  return stream;
+}
+
+TokenStream tokenizeAllParallel(
+    ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    unsigned numThreads,
+    bool deferErrors) {
+  if (numThreads <= 1 || input.getBufferSize() < 2 * kMinChunkSize ||
+      input.getBufferSize() > UINT32_MAX) {
+    return tokenizeAll(context, input, deferErrors);
+  }
+  return ParallelLexer{context, input, numThreads, deferErrors}.run();
+}
+
+} // namespace parser
+} // namespace s2020
@@ -0,0 +1,391 @@
+#include "s2020/Parser/SIMDScan.h"
+
+#include "CharTab.h"
+
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define S2020_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// SSSE3 and AVX2 code is compiled with a per-function target attribute, so the
+// rest of the code doesn't require it. That is only possible with GCC
+// compatible compilers.
+#if defined(S2020_SCAN_X86) && defined(__GNUC__)
+#define S2020_SCAN_X86_EXT 1
+#define S2020_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define S2020_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace s2020 {
+namespace parser {
+
+namespace {
+
+/// The set of scanning routines for a particular ISA.
+struct ScanFunctions {
+  ScanISA isa;
+  const char *(*whitespace)(const char *ptr, const char *end);
+  const char *(*lineEnd)(const char *ptr, const char *end);
+  const char *(*subsequent)(const char *ptr, const char *end);
+  const char *(*quoteOrBackslash)(const char *ptr, const char *end);
+  const char *(*barOrHash)(const char *ptr, const char *end);
+};
+
+/// Nibble lookup tables for classifying "Subsequent" characters with a pair of
+/// byte shuffles, derived from \c charTab.
+///
+/// Only ASCII characters can be Subsequent, so there are only 8 possible
+/// high nibbles. Each of them gets assigned a bit; \c lo[n] has the bits of
+/// all high nibbles h for which the character (h << 4 | n) is Subsequent, and
+/// \c hi[h] has only the bit of h. A character c is Subsequent if and only if
+/// (lo[c & 15] & hi[c >> 4]) != 0.
+struct SubsequentNibbles {
+  alignas(16) uint8_t lo[16];
+  alignas(16) uint8_t hi[16];
+
+  SubsequentNibbles() {
+    for (unsigned n = 0; n != 16; ++n) {
+      lo[n] = 0;
+      hi[n] = n < 8 ? 1u << n : 0;
+    }
+    for (unsigned ch = 0; ch != 256; ++ch) {
+      if (CC::testSubsequent(charTab[ch])) {
+        assert(ch < 128 && "only ASCII characters can be Subsequent");
+        lo[ch & 15] |= 1u << (ch >> 4);
+      }
+    }
+  }
+};
+
+const SubsequentNibbles s_subsequentNibbles{};
+
+//===----------------------------------------------------------------------===//
+// Scalar
+
+const char *scalarWhitespace(const char *ptr, const char *end) {
+  // The terminating zero is not whitespace, so we don't need to check the end.
+  while (CC::getClass(getCharFlags(ptr)) == CC::WhitespaceClass)
+    ++ptr;
+  return ptr;
+}
+
+const char *scalarLineEnd(const char *ptr, const char *end) {
+  for (; ptr != end; ++ptr)
+    if (*ptr == '\n' || *ptr == '\r')
+      break;
+  return ptr;
+}
+
+const char *scalarSubsequent(const char *ptr, const char *end) {
+  // The terminating zero is not Subsequent.
+  while (CC::testSubsequent(getCharFlags(ptr)))
+    ++ptr;
+  return ptr;
+}
+
+const char *scalarQuoteOrBackslash(const char *ptr, const char *end) {
+  for (; ptr != end; ++ptr)
+    if (*ptr == '"' || *ptr == '\\')
+      break;
+  return ptr;
+}
+
+const char *scalarBarOrHash(const char *ptr, const char *end) {
+  for (; ptr != end; ++ptr)
+    if (*ptr == '|' || *ptr == '#')
+      break;
+  return ptr;
+}
+
+const ScanFunctions s_scalarFunctions = {
+    ScanISA::scalar,
+    scalarWhitespace,
+    scalarLineEnd,
+    scalarSubsequent,
+    scalarQuoteOrBackslash,
+    scalarBarOrHash,
+};
+
+#ifdef S2020_SCAN_X86
+//===----------------------------------------------------------------------===//
+// SSE2
+
+/// \return a mask with the whitespace bytes of \p v set to 0xFF.
+inline __m128i sse2WhitespaceMask(__m128i v) {
+  // '\t', '\n' and '\v' are consecutive, so they are checked with a single
+  // unsigned comparison: (v - '\t') <= 2.
+  __m128i tnv = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  tnv = _mm_cmpeq_epi8(_mm_min_epu8(tnv, _mm_set1_epi8(2)), tnv);
+  return _mm_or_si128(
+      tnv,
+      _mm_or_si128(
+          _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+          _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+}
+
+const char *sse2Whitespace(const char *ptr, const char *end) {
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(sse2WhitespaceMask(v)) &
+        0xFFFFu;
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 16;
+  }
+  return scalarWhitespace(ptr, end);
+}
+
+/// Find the first occurrence of either \p a or \p b in the range [ptr, end).
+/// \return a pointer to it, or \p end if there is none.
+inline const char *
+sse2FindEither(const char *ptr, const char *end, char a, char b) {
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 16;
+  }
+  for (; ptr != end; ++ptr)
+    if (*ptr == a || *ptr == b)
+      break;
+  return ptr;
+}
+
+const char *sse2LineEnd(const char *ptr, const char *end) {
+  return sse2FindEither(ptr, end, '\n', '\r');
+}
+
+const char *sse2QuoteOrBackslash(const char *ptr, const char *end) {
+  return sse2FindEither(ptr, end, '"', '\\');
+}
+
+const char *sse2BarOrHash(const char *ptr, const char *end) {
+  return sse2FindEither(ptr, end, '|', '#');
+}
+
+const ScanFunctions s_sse2Functions = {
+    ScanISA::sse2,
+    sse2Whitespace,
+    sse2LineEnd,
+    scalarSubsequent,
+    sse2QuoteOrBackslash,
+    sse2BarOrHash,
+};
+#endif // S2020_SCAN_X86
+
+#ifdef S2020_SCAN_X86_EXT
+//===----------------------------------------------------------------------===//
+// SSSE3
+
+S2020_TARGET_SSSE3 const char *ssse3Subsequent(
+    const char *ptr,
+    const char *end) {
+  const __m128i loTab = _mm_load_si128((const __m128i *)s_subsequentNibbles.lo);
+  const __m128i hiTab = _mm_load_si128((const __m128i *)s_subsequentNibbles.hi);
+  const __m128i nibble = _mm_set1_epi8(15);
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i lo = _mm_shuffle_epi8(loTab, _mm_and_si128(v, nibble));
+    __m128i hi = _mm_shuffle_epi8(
+        hiTab, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()));
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 16;
+  }
+  return scalarSubsequent(ptr, end);
+}
+
+const ScanFunctions s_ssse3Functions = {
+    ScanISA::ssse3,
+    sse2Whitespace,
+    sse2LineEnd,
+    ssse3Subsequent,
+    sse2QuoteOrBackslash,
+    sse2BarOrHash,
+};
+
+//===----------------------------------------------------------------------===//
+// AVX2
+
+S2020_TARGET_AVX2 inline __m256i avx2WhitespaceMask(__m256i v) {
+  __m256i tnv = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+  tnv = _mm256_cmpeq_epi8(_mm256_min_epu8(tnv, _mm256_set1_epi8(2)), tnv);
+  return _mm256_or_si256(
+      tnv,
+      _mm256_or_si256(
+          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+}
+
+S2020_TARGET_AVX2 const char *avx2Whitespace(const char *ptr, const char *end) {
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(avx2WhitespaceMask(v));
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 32;
+  }
+  return sse2Whitespace(ptr, end);
+}
+
+S2020_TARGET_AVX2 inline const char *
+avx2FindEither(const char *ptr, const char *end, char a, char b) {
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 32;
+  }
+  return sse2FindEither(ptr, end, a, b);
+}
+
+S2020_TARGET_AVX2 const char *avx2LineEnd(const char *ptr, const char *end) {
+  return avx2FindEither(ptr, end, '\n', '\r');
+}
+
+S2020_TARGET_AVX2 const char *avx2QuoteOrBackslash(
+    const char *ptr,
+    const char *end) {
+  return avx2FindEither(ptr, end, '"', '\\');
+}
+
+S2020_TARGET_AVX2 const char *avx2BarOrHash(const char *ptr, const char *end) {
+  return avx2FindEither(ptr, end, '|', '#');
+}
+
+S2020_TARGET_AVX2 const char *avx2Subsequent(const char *ptr, const char *end) {
+  const __m256i loTab = _mm256_broadcastsi128_si256(
+      _mm_load_si128((const __m128i *)s_subsequentNibbles.lo));
+  const __m256i hiTab = _mm256_broadcastsi128_si256(
+      _mm_load_si128((const __m128i *)s_subsequentNibbles.hi));
+  const __m256i nibble = _mm256_set1_epi8(15);
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    __m256i lo = _mm256_shuffle_epi8(loTab, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(
+        hiTab, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+    if (mask)
+      return ptr + llvm::countTrailingZeros(mask);
+    ptr += 32;
+  }
+  return ssse3Subsequent(ptr, end);
+}
+
+const ScanFunctions s_avx2Functions = {
+    ScanISA::avx2,
+    avx2Whitespace,
+    avx2LineEnd,
+    avx2Subsequent,
+    avx2QuoteOrBackslash,
+    avx2BarOrHash,
+};
+#endif // S2020_SCAN_X86_EXT
+
+const ScanFunctions *getFunctions(ScanISA isa) {
+  switch (isa) {
+#ifdef S2020_SCAN_X86_EXT
+    case ScanISA::avx2:
+      return &s_avx2Functions;
+    case ScanISA::ssse3:
+      return &s_ssse3Functions;
+#endif
+#ifdef S2020_SCAN_X86
+    case ScanISA::sse2:
+      return &s_sse2Functions;
+#endif
+    default:
+      return &s_scalarFunctions;
+  }
+}
+
+/// The currently selected routines.
+const ScanFunctions *s_functions = getFunctions(getBestScanISA());
+
+} // anonymous namespace
+
+const char *scanISAName(ScanISA isa) {
+  switch (isa) {
+    case ScanISA::scalar:
+      return "scalar";
+    case ScanISA::sse2:
+      return "sse2";
+    case ScanISA::ssse3:
+      return "ssse3";
+    case ScanISA::avx2:
+      return "avx2";
+  }
+  return "<invalid>";
+}
+
+ScanISA getBestScanISA() {
+#ifdef S2020_SCAN_X86_EXT
+  // Note that __builtin_cpu_supports() also verifies OS support for the AVX
+  // register state.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return ScanISA::avx2;
+  if (__builtin_cpu_supports("ssse3"))
+    return ScanISA::ssse3;
+#endif
+#ifdef S2020_SCAN_X86
+  // SSE2 is a part of the x86-64 baseline.
+  return ScanISA::sse2;
+#else
+  return ScanISA::scalar;
+#endif
+}
+
+ScanISA getScanISA() {
+  return s_functions->isa;
+}
+
+ScanISA setScanISA(ScanISA isa) {
+  ScanISA best = getBestScanISA();
+  s_functions = getFunctions(isa < best ? isa : best);
+  return s_functions->isa;
+}
+
+const char *scanWhitespace(const char *ptr, const char *end) {
+  assert(ptr <= end && "scanning past the end of input");
+  return s_functions->whitespace(ptr, end);
+}
+
+const char *scanLineEnd(const char *ptr, const char *end) {
+  assert(ptr <= end && "scanning past the end of input");
+  return s_functions->lineEnd(ptr, end);
+}
+
+const char *scanSubsequent(const char *ptr, const char *end) {
+  assert(ptr <= end && "scanning past the end of input");
+  return s_functions->subsequent(ptr, end);
+}
+
+const char *scanQuoteOrBackslash(const char *ptr, const char *end) {
+  assert(ptr <= end && "scanning past the end of input");
+  return s_functions->quoteOrBackslash(ptr, end);
+}
+
+const char *scanBarOrHash(const char *ptr, const char *end) {
+  assert(ptr <= end && "scanning past the end of input");
+  return s_functions->barOrHash(ptr, end);
+}
+
+} // namespace parser
+} // namespace s2020
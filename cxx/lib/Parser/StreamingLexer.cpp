@@ -0,0 +1,124 @@
+#include "s2020/Parser/StreamingLexer.h"
+
+#include <cstring>
+
+namespace s2020 {
+namespace parser {
+
+StreamingLexer::StreamingLexer(ASTContext &context, StringRef name)
+    : context_(context),
+      name_(name),
+      buf_(1, 0),
+      lex_(context, buf_.data(), buf_.data()) {
+  lex_.setDeferredErrors(&errors_);
+}
+
+void StreamingLexer::addInput(StringRef data) {
+  assert(!inputEnded_ && "input added after endInput()");
+  if (data.empty() || stopped_)
+    return;
+  if (!stopChar_ || memchr(data.data(), stopChar_, data.size()))
+    retrySize_ = 0;
+
+  // Discard the consumed input. Only the tail of an incomplete token is left,
+  // so this is cheap.
+  if (pos_) {
+    coord_ = coordAt(coord_, bufStart() + coordPos_, bufStart() + pos_);
+    coordPos_ = 0;
+    buf_.erase(buf_.begin(), buf_.begin() + pos_);
+    bufOffset_ += pos_;
+    pos_ = 0;
+  }
+  buf_.pop_back();
+  buf_.insert(buf_.end(), data.begin(), data.end());
+  buf_.push_back(0);
+}
+
+void StreamingLexer::endInput() {
+  inputEnded_ = true;
+}
+
+bool StreamingLexer::advance() {
+  if (stopped_) {
+    buf_.assign(1, 0);
+    pos_ = 0;
+    coordPos_ = 0;
+    lex_.setInput(bufEnd(), bufEnd());
+    lex_.advance();
+    return true;
+  }
+
+  size_t avail = getBufferedSize();
+  if (!inputEnded_ && (avail == 0 || avail < retrySize_))
+    return false;
+
+  const char *start = bufStart() + pos_;
+  errors_.clear();
+  lex_.setInput(start, bufEnd());
+  lex_.advance();
+
+  // The lexer looks at most one character past the token to find where it
+  // ends. If that was the terminator, the token might continue in the input
+  // which hasn't arrived yet.
+  const char *next = lex_.getCurLoc().getPointer();
+  if (!inputEnded_ && next == bufEnd()) {
+    // Only the closing quote or "|#" can complete an unterminated string or
+    // block comment, which is the last error. Any input can complete the
+    // other tokens, which are short.
+    stopChar_ = 0;
+    if (!errors_.empty()) {
+      const char *errStart = errors_.back().loc.getPointer();
+      if (errStart[0] == '"')
+        stopChar_ = '"';
+      else if (errStart[0] == '#' && errStart[1] == '|')
+        stopChar_ = '#';
+    }
+    retrySize_ = avail * 2;
+    return false;
+  }
+  retrySize_ = 0;
+
+  if (LLVM_UNLIKELY(!errors_.empty()))
+    reportErrors();
+  pos_ = next - bufStart();
+  return true;
+}
+
+const StreamingLexer::Coord &StreamingLexer::coordOfToken() {
+  const char *tokStart = lex_.token.getStartLoc().getPointer();
+  coord_ = coordAt(coord_, bufStart() + coordPos_, tokStart);
+  coordPos_ = tokStart - bufStart();
+  return coord_;
+}
+
+StreamingLexer::Coord
+StreamingLexer::coordAt(Coord coord, const char *from, const char *to) const {
+  while (const char *nl = (const char *)memchr(from, '\n', to - from)) {
+    ++coord.line;
+    from = nl + 1;
+    coord.lineStart = offsetOf(from);
+  }
+  return coord;
+}
+
+void StreamingLexer::reportErrors() {
+  // Errors may precede the token, but not the end of the previous one.
+  coord_ = coordAt(coord_, bufStart() + coordPos_, bufStart() + pos_);
+  coordPos_ = pos_;
+  for (const DeferredLexerError &err : errors_) {
+    const char *ptr = err.loc.getPointer();
+    Coord coord = coordAt(coord_, bufStart() + pos_, ptr);
+    context_.sm.error(
+        SMLoc{},
+        llvm::Twine(name_) + ":" + llvm::Twine(coord.line) + ":" +
+            llvm::Twine(offsetOf(ptr) - coord.lineStart + 1) + ": " +
+            err.msg);
+    if (context_.sm.isErrorLimitReached()) {
+      stopped_ = true;
+      return;
+    }
+  }
+}
+
+} // namespace parser
+} // namespace s2020
@@ -0,0 +1,110 @@
+#include "s2020/Parser/TokenStream.h"
+
+namespace s2020 {
+namespace parser {
+
+void TokenStream::push(const Token &tok) {
+  const char *start = tok.getStartLoc().getPointer();
+  const char *end = tok.getEndLoc().getPointer();
+
+  uint32_t payload = 0;
+  switch (tok.getKind()) {
+    case TokenKind::identifier:
+      payload = (uint32_t)identifiers_.size();
+      identifiers_.push_back(tok.getIdentifier());
+      break;
+    case TokenKind::string:
+      payload = (uint32_t)identifiers_.size();
+      identifiers_.push_back(tok.getString());
+      break;
+    case TokenKind::number:
+      payload = (uint32_t)numbers_.size();
+      numbers_.push_back(tok.getNumber());
+      break;
+    case TokenKind::character:
+      payload = tok.getCharacter();
+      break;
+    case TokenKind::label_def:
+    case TokenKind::label_ref:
+      payload = tok.getLabel();
+      break;
+    default:
+      break;
+  }
+
+  kinds_.push_back(tok.getKind());
+  starts_.push_back((uint32_t)(start - bufferStart_));
+  lengths_.push_back((uint32_t)(end - start));
+  payloads_.push_back(payload);
+}
+
+void TokenStream::Cursor::reportDeferredErrors() {
+  const auto &errors = stream_.errors_;
+  const auto &tokens = stream_.errorTokens_;
+  for (; nextError_ != errors.size() && tokens[nextError_] == index_;
+       ++nextError_) {
+    const DeferredLexerError &err = errors[nextError_];
+    context_.sm.error(err.loc, err.range, err.msg);
+    if (context_.sm.isErrorLimitReached()) {
+      forceEOF();
+      return;
+    }
+  }
+}
+
+bool TokenStream::Cursor::error(SMRange range, const llvm::Twine &msg) {
+  context_.sm.error(range, msg);
+  if (!context_.sm.isErrorLimitReached())
+    return true;
+  forceEOF();
+  return false;
+}
+
+TokenStream tokenizeAll(
+    ASTContext &context,
+    const llvm::MemoryBuffer &input,
+    bool deferErrors) {
+  TokenStream stream{input.getBufferStart()};
+
+  if (input.getBufferSize() > UINT32_MAX) {
+    SMLoc loc = SMLoc::getFromPointer(input.getBufferStart());
+    const char *msg = "input is too large to tokenize";
+    if (deferErrors) {
+      stream.errors_.push_back({loc, SMRange{}, msg});
+      stream.errorTokens_.push_back(0);
+    } else {
+      context.sm.error(loc, msg);
+    }
+    stream.kinds_.push_back(TokenKind::eof);
+    stream.starts_.push_back(0);
+    stream.lengths_.push_back(0);
+    stream.payloads_.push_back(0);
+    stream.hasErrors_ = true;
+    return stream;
+  }
+
+  // Typical source averages several bytes per token; reserving for that
+  // avoids most of the regrowth without grossly overallocating.
+  size_t estimate = input.getBufferSize() / 6 + 1;
+  stream.kinds_.reserve(estimate);
+  stream.starts_.reserve(estimate);
+  stream.lengths_.reserve(estimate);
+  stream.payloads_.reserve(estimate);
+
+  auto numErrors = context.sm.getErrorCount();
+  Lexer lex{context, input};
+  if (deferErrors)
+    lex.setDeferredErrors(&stream.errors_);
+  do {
+    lex.advance();
+    stream.errorTokens_.resize(stream.errors_.size(), stream.size());
+    stream.push(lex.token);
+  } while (lex.token.getKind() != TokenKind::eof);
+  stream.hasErrors_ =
+      numErrors != context.sm.getErrorCount() || !stream.errors_.empty();
+
+  return stream;
+}
+
+} // namespace parser
+} // namespace s2020
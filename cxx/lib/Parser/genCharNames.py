@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+
+# Generates a perfect hash table of the named characters in Characters.def.
+# Usage: genCharNames.py > CharNames.inc
+
+import os
+import re
+import sys
+
+DEF_PATH = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)),
+    "..",
+    "..",
+    "include",
+    "s2020",
+    "AST",
+    "Characters.def",
+)
+
+
+def read_characters(path):
+    chars = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r"\s*S2020_CHARACTER\((\w+),\s*(0x[0-9a-fA-F]+)\)", line)
+            if m:
+                chars.append((m.group(1), int(m.group(2), 16)))
+    return chars
+
+
+def hash_name(name, a, b, mask):
+    """ Must match charNameHash() in Lexer.cpp. """
+    return (ord(name[0]) * a + ord(name[-1]) * b + len(name)) & mask
+
+
+def find_hash(names):
+    size = 1
+    while size < len(names):
+        size *= 2
+    while True:
+        mask = size - 1
+        for a in range(1, 64):
+            for b in range(0, 64):
+                slots = set(hash_name(n, a, b, mask) for n in names)
+                if len(slots) == len(names):
+                    return size, a, b
+        size *= 2
+
+
+def main():
+    chars = read_characters(DEF_PATH)
+    if not chars:
+        sys.exit("no characters found in " + DEF_PATH)
+    names = [c[0] for c in chars]
+    size, a, b = find_hash(names)
+    mask = size - 1
+
+    table = [None] * size
+    for name, code in chars:
+        table[hash_name(name, a, b, mask)] = (name, code)
+
+    print("//")
+    print("// File generated by genCharNames.py from Characters.def")
+    print("// *** DO NOT EDIT BY HAND ***")
+    print("")
+    print("static constexpr unsigned kCharNameMulFirst = %d;" % a)
+    print("static constexpr unsigned kCharNameMulLast = %d;" % b)
+    print("static constexpr unsigned kCharNameMask = %d;" % mask)
+    print("")
+    print("static const CharName kCharNames[%d] = {" % size)
+    for entry in table:
+        if entry is None:
+            print('    {"", 0, 0},')
+        else:
+            name, code = entry
+            print('    {"%s", %d, 0x%02x},' % (name, len(name), code))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,14 @@
 #!/usr/bin/env python
 
+# Generates the lexer character tables.
+# Usage:
+#   genCharTab.py > CharTab.inc
+#   genCharTab.py --digits > DigitTab.inc
+
 from __future__ import print_function
 
+import sys
+
 tab = [[] for i in range(0, 256)]
 
 
@@ -55,6 +62,23 @@ def genTable():
         print(",")
 
 
+def genDigitTable():
+    """ The value of every character as a digit in radix up to 16, or 0xFF if
+        it is not a digit. """
+    for i in range(0, 256):
+        ch = chr(i)
+        if "0" <= ch <= "9":
+            value = i - ord("0")
+        elif "a" <= ch.lower() <= "f":
+            value = ord(ch.lower()) - ord("a") + 10
+        else:
+            value = 0xFF
+        if i < 32 or i >= 127:
+            print("  /* %3d, 0x%02x */ 0x%02x," % (i, i, value))
+        else:
+            print("  /* %3d, '%s'  */ 0x%02x," % (i, ch, value))
+
+
 SUBSEQUENT = "CC::Subsequent"
 DELIMITER = "CC::Delimiter"
 WHITESPACE = ("CC::WhitespaceClass", DELIMITER)
@@ -92,4 +116,7 @@ add(DELIMITER, '|', '(', ')', '[', ']', '{', '}', '"', ';')
 add(HASH, '#')
 addRange(UTF8, 128, 255)
 
-genTable()
+if len(sys.argv) > 1 and sys.argv[1] == "--digits":
+    genDigitTable()
+else:
+    genTable()
@@ -0,0 +1,85 @@
+#include "s2020/Support/Arena.h"
+
+#include "llvm/Support/MemAlloc.h"
+
+#include <cassert>
+#include <cstdlib>
+
+namespace s2020 {
+
+Arena::~Arena() {
+  for (char *slab : slabs_)
+    free(slab);
+  for (void *large : large_)
+    free(large);
+}
+
+void *Arena::allocateSlow(size_t size, size_t alignment) {
+  // Leave room for aligning the start.
+  size_t paddedSize = size + alignment - 1;
+
+  if (paddedSize > kLargeThreshold) {
+    void *mem = llvm::safe_malloc(paddedSize);
+    large_.push_back(mem);
+    return (void *)(((uintptr_t)mem + alignment - 1) &
+                    ~(uintptr_t)(alignment - 1));
+  }
+
+  // Move to the next slab, reusing a spare one if there is any.
+  if (numSlabs_ == slabs_.size())
+    slabs_.push_back((char *)llvm::safe_malloc(slabSize(numSlabs_)));
+  cur_ = slabs_[numSlabs_];
+  end_ = cur_ + slabSize(numSlabs_);
+  ++numSlabs_;
+
+  uintptr_t ptr =
+      ((uintptr_t)cur_ + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  cur_ = (char *)(ptr + size);
+  return (void *)ptr;
+}
+
+void Arena::rewind(const Checkpoint &cp) {
+  assert(cp.numSlabs <= numSlabs_ && "checkpoint is ahead of the arena");
+  assert(cp.numLarge <= large_.size() && "checkpoint is ahead of the arena");
+
+  while (large_.size() > cp.numLarge) {
+    free(large_.back());
+    large_.pop_back();
+  }
+
+  // Keep one spare slab.
+  while (slabs_.size() > cp.numSlabs + 1) {
+    free(slabs_.back());
+    slabs_.pop_back();
+  }
+
+  numSlabs_ = cp.numSlabs;
+  cur_ = cp.cur;
+  end_ = numSlabs_ ? slabs_[numSlabs_ - 1] + slabSize(numSlabs_ - 1) : nullptr;
+}
+
+void Arena::adopt(Arena &other) {
+  // The adopted slabs are treated like large allocations, which are freed
+  // when rewinding past them.
+  for (size_t i = 0; i != other.slabs_.size(); ++i) {
+    if (i < other.numSlabs_)
+      large_.push_back(other.slabs_[i]);
+    else
+      free(other.slabs_[i]);
+  }
+  large_.insert(large_.end(), other.large_.begin(), other.large_.end());
+
+  other.slabs_.clear();
+  other.large_.clear();
+  other.numSlabs_ = 0;
+  other.cur_ = other.end_ = nullptr;
+}
+
+size_t Arena::getTotalMemory() const {
+  size_t total = 0;
+  for (size_t i = 0; i != slabs_.size(); ++i)
+    total += slabSize(i);
+  return total;
+}
+
+} // namespace s2020
@@ -0,0 +1,428 @@
+#include "s2020/Support/Conversions.h"
+
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+
+namespace s2020 {
+
+namespace {
+
+#include "PowersOfFive.inc"
+
+/// The number of explicitly stored mantissa bits of a double.
+constexpr int kMantissaBits = 52;
+/// The biased exponent of infinity.
+constexpr int kInfinitePower = 0x7FF;
+/// The exponent of the smallest normal double, minus one.
+constexpr int kMinimumExponent = -1023;
+
+/// The largest number of decimal digits which always fits in 64 bits.
+constexpr unsigned kMaxFastDigits = 19;
+/// The number of significant digits used by the exact comparison. The halfway
+/// point between two adjacent doubles never has more than 767 significant
+/// digits, so the following ones can only break a tie.
+constexpr unsigned kMaxExactDigits = 800;
+
+/// Powers of ten which are exactly representable as doubles.
+const double kExactPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/// Scan the decimal number \p str and feed its first \p maxDigits significant
+/// digits to \p acc, which must have a method addDigit(unsigned).
+/// \param[out] exp10 the value of \p str is the number formed by the accepted
+///     digits multiplied by 10^exp10 (plus whatever was truncated).
+/// \return true if non-zero digits were dropped.
+template <typename Acc>
+bool scanDecimal(
+    llvm::StringRef str,
+    unsigned maxDigits,
+    Acc &acc,
+    int64_t &exp10) {
+  const char *ptr = str.begin();
+  const char *end = str.end();
+  unsigned numDigits = 0;
+  bool truncated = false;
+  int64_t exp = 0;
+
+  // Leading zeros are not significant.
+  while (ptr != end && *ptr == '0')
+    ++ptr;
+
+  for (; ptr != end && (unsigned)(*ptr - '0') < 10; ++ptr) {
+    if (LLVM_LIKELY(numDigits < maxDigits)) {
+      acc.addDigit(*ptr - '0');
+      ++numDigits;
+    } else {
+      ++exp;
+      truncated |= *ptr != '0';
+    }
+  }
+
+  if (ptr != end && *ptr == '.') {
+    ++ptr;
+    if (numDigits == 0) {
+      for (; ptr != end && *ptr == '0'; ++ptr)
+        --exp;
+    }
+    for (; ptr != end && (unsigned)(*ptr - '0') < 10; ++ptr) {
+      if (LLVM_LIKELY(numDigits < maxDigits)) {
+        acc.addDigit(*ptr - '0');
+        ++numDigits;
+        --exp;
+      } else {
+        truncated |= *ptr != '0';
+      }
+    }
+  }
+
+  if (ptr != end) {
+    assert((*ptr | 32) == 'e' && "invalid decimal number");
+    ++ptr;
+    bool negative = false;
+    if (*ptr == '+' || *ptr == '-') {
+      negative = *ptr == '-';
+      ++ptr;
+    }
+    assert(ptr != end && "missing exponent digits");
+    // The digits move the exponent by at most their number, so anything
+    // this large still overflows or underflows after that, and saturates.
+    const int64_t maxExp = (int64_t)str.size() + 100000;
+    int64_t e = 0;
+    for (; ptr != end; ++ptr) {
+      assert((unsigned)(*ptr - '0') < 10 && "invalid exponent");
+      if (e < maxExp)
+        e = e * 10 + (*ptr - '0');
+    }
+    exp += negative ? -e : e;
+  }
+
+  exp10 = exp;
+  return truncated;
+}
+
+/// Accumulates up to kMaxFastDigits digits in 64 bits.
+struct FastAccumulator {
+  uint64_t value = 0;
+
+  void addDigit(unsigned d) {
+    value = value * 10 + d;
+  }
+};
+
+/// A fixed capacity unsigned big integer. The capacity is enough for the
+/// largest numbers needed by the comparison in slowPath().
+class BigUInt {
+ public:
+  explicit BigUInt(uint64_t v) {
+    limbs_[0] = (uint32_t)v;
+    limbs_[1] = (uint32_t)(v >> 32);
+    size_ = limbs_[1] ? 2 : limbs_[0] ? 1 : 0;
+  }
+
+  /// this = this * m + a.
+  void mulAdd(uint32_t m, uint32_t a) {
+    uint64_t carry = a;
+    for (unsigned i = 0; i != size_; ++i) {
+      carry += (uint64_t)limbs_[i] * m;
+      limbs_[i] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    if (carry)
+      push((uint32_t)carry);
+  }
+
+  /// this = this * 5^n.
+  void mulPow5(uint64_t n) {
+    static const uint32_t smallPowers[] = {
+        1,
+        5,
+        25,
+        125,
+        625,
+        3125,
+        15625,
+        78125,
+        390625,
+        1953125,
+        9765625,
+        48828125,
+        244140625,
+        1220703125,
+    };
+    // 5^13 is the largest power of five that fits in 32 bits.
+    for (; n >= 13; n -= 13)
+      mulAdd(smallPowers[13], 0);
+    if (n)
+      mulAdd(smallPowers[n], 0);
+  }
+
+  /// this = this * 2^n.
+  void shiftLeft(uint64_t n) {
+    if (!size_)
+      return;
+    unsigned limbShift = n / 32;
+    unsigned bitShift = n % 32;
+    if (bitShift) {
+      uint32_t carry = 0;
+      for (unsigned i = 0; i != size_; ++i) {
+        uint32_t limb = limbs_[i];
+        limbs_[i] = (limb << bitShift) | carry;
+        carry = limb >> (32 - bitShift);
+      }
+      if (carry)
+        push(carry);
+    }
+    if (limbShift) {
+      assert(size_ + limbShift <= kMaxLimbs && "BigUInt overflow");
+      memmove(limbs_ + limbShift, limbs_, size_ * sizeof(uint32_t));
+      memset(limbs_, 0, limbShift * sizeof(uint32_t));
+      size_ += limbShift;
+    }
+  }
+
+  /// \return a negative number, zero or a positive number if this is less,
+  ///     equal or greater than \p other respectively.
+  int compare(const BigUInt &other) const {
+    if (size_ != other.size_)
+      return size_ < other.size_ ? -1 : 1;
+    for (unsigned i = size_; i-- != 0;) {
+      if (limbs_[i] != other.limbs_[i])
+        return limbs_[i] < other.limbs_[i] ? -1 : 1;
+    }
+    return 0;
+  }
+
+ private:
+  /// 4096 bits.
+  static constexpr unsigned kMaxLimbs = 128;
+
+  void push(uint32_t limb) {
+    assert(size_ < kMaxLimbs && "BigUInt overflow");
+    limbs_[size_++] = limb;
+  }
+
+  /// Little endian limbs. There are no leading zero limbs.
+  uint32_t limbs_[kMaxLimbs];
+  unsigned size_;
+};
+
+/// Accumulates decimal digits into a BigUInt, nine at a time.
+class BigUIntAccumulator {
+ public:
+  explicit BigUIntAccumulator(BigUInt &value) : value_(value) {}
+
+  void addDigit(unsigned d) {
+    pending_ = pending_ * 10 + d;
+    scale_ *= 10;
+    if (scale_ == 1000000000)
+      flush();
+  }
+
+  /// Add the pending digits to the value.
+  void flush() {
+    value_.mulAdd(scale_, pending_);
+    pending_ = 0;
+    scale_ = 1;
+  }
+
+ private:
+  BigUInt &value_;
+  uint32_t pending_ = 0;
+  uint32_t scale_ = 1;
+};
+
+/// A double in the process of being constructed.
+struct AdjustedMantissa {
+  /// The mantissa without the implicit bit.
+  uint64_t mantissa;
+  /// The biased exponent.
+  int32_t power2;
+
+  bool operator==(const AdjustedMantissa &other) const {
+    return mantissa == other.mantissa && power2 == other.power2;
+  }
+
+  double toDouble() const {
+    return llvm::BitsToDouble(mantissa | ((uint64_t)power2 << kMantissaBits));
+  }
+};
+
+/// Compute the full 128-bit product of \p a and \p b.
+inline void fullMultiply(uint64_t a, uint64_t b, uint64_t &hi, uint64_t &lo) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128)a * b;
+  lo = (uint64_t)r;
+  hi = (uint64_t)(r >> 64);
+#else
+  uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+  uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+  uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+  uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+  lo = (mid << 32) | (uint32_t)ll;
+  hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+/// \return floor(log2(10^q)) + 63.
+inline int32_t binaryPower(int32_t q) {
+  return (((152170 + 65536) * q) >> 16) + 63;
+}
+
+/// Compute w * 10^q correctly rounded to a double with the Eisel-Lemire
+/// algorithm. The result is exact as long as \p w is exact.
+AdjustedMantissa computeFloat(int64_t q, uint64_t w) {
+  AdjustedMantissa am;
+  if (w == 0 || q < kSmallestPowerOfFive) {
+    am.mantissa = 0;
+    am.power2 = 0;
+    return am;
+  }
+  if (q > kLargestPowerOfFive) {
+    am.mantissa = 0;
+    am.power2 = kInfinitePower;
+    return am;
+  }
+
+  int lz = llvm::countLeadingZeros(w);
+  w <<= lz;
+
+  // Multiply by the 128-bit approximation of 5^q. We need 55 valid bits: the
+  // mantissa, the rounding bit and a bit for the normalization. The second
+  // multiplication is only necessary if the truncated low bits could carry
+  // into them.
+  const uint64_t *pow5 = kPowersOfFive128[q - kSmallestPowerOfFive];
+  uint64_t hi, lo;
+  fullMultiply(w, pow5[0], hi, lo);
+  const uint64_t precisionMask = UINT64_MAX >> (kMantissaBits + 3);
+  if ((hi & precisionMask) == precisionMask) {
+    uint64_t hi2, lo2;
+    fullMultiply(w, pow5[1], hi2, lo2);
+    lo += hi2;
+    if (hi2 > lo)
+      ++hi;
+  }
+
+  int upperBit = (int)(hi >> 63);
+  int shift = upperBit + 64 - kMantissaBits - 3;
+  am.mantissa = hi >> shift;
+  am.power2 = binaryPower((int32_t)q) + upperBit - lz - kMinimumExponent;
+
+  if (am.power2 <= 0) {
+    // A subnormal number. Ties are impossible here, since they only happen
+    // for powers close to zero.
+    if (-am.power2 + 1 >= 64) {
+      am.mantissa = 0;
+      am.power2 = 0;
+      return am;
+    }
+    am.mantissa >>= -am.power2 + 1;
+    am.mantissa += am.mantissa & 1;
+    am.mantissa >>= 1;
+    // The rounding may have turned it into the smallest normal number.
+    am.power2 = am.mantissa < (uint64_t(1) << kMantissaBits) ? 0 : 1;
+    return am;
+  }
+
+  // We normally round up, but if the product is exact and exactly halfway,
+  // we must round to even. An exact product is only possible for small q.
+  if (lo <= 1 && q >= -4 && q <= 23 && (am.mantissa & 3) == 1 &&
+      (am.mantissa << shift) == hi) {
+    am.mantissa &= ~uint64_t(1);
+  }
+  am.mantissa += am.mantissa & 1;
+  am.mantissa >>= 1;
+  if (am.mantissa >= (uint64_t(2) << kMantissaBits)) {
+    am.mantissa = uint64_t(1) << kMantissaBits;
+    ++am.power2;
+  }
+  am.mantissa &= ~(uint64_t(1) << kMantissaBits);
+  if (am.power2 >= kInfinitePower) {
+    am.mantissa = 0;
+    am.power2 = kInfinitePower;
+  }
+  return am;
+}
+
+/// The correctly rounded value of \p str is either \p lower or the next
+/// double. Decide which one by comparing the exact decimal value with the
+/// halfway point between them.
+LLVM_ATTRIBUTE_NOINLINE double slowPath(
+    llvm::StringRef str,
+    AdjustedMantissa lower) {
+  BigUInt digits{0};
+  BigUIntAccumulator acc{digits};
+  int64_t exp10;
+  bool truncated = scanDecimal(str, kMaxExactDigits, acc, exp10);
+  acc.flush();
+
+  // The halfway point is (2m + 1) * 2^(e - 1), where m * 2^e is lower.
+  uint64_t m = lower.mantissa;
+  int64_t e = -1074;
+  if (lower.power2 != 0) {
+    m |= uint64_t(1) << kMantissaBits;
+    e = lower.power2 - 1075;
+  }
+  BigUInt halfway{2 * m + 1};
+
+  // Compare digits * 5^exp10 * 2^exp10 with halfway * 2^(e - 1). Divide both
+  // sides by 10^exp10 and cancel out the powers of two, so everything is an
+  // integer.
+  if (exp10 >= 0)
+    digits.mulPow5(exp10);
+  else
+    halfway.mulPow5(-exp10);
+  int64_t pow2 = e - 1 - exp10;
+  if (pow2 >= 0)
+    halfway.shiftLeft(pow2);
+  else
+    digits.shiftLeft(-pow2);
+
+  int cmp = digits.compare(halfway);
+  // Truncated digits make the value slightly larger.
+  if (cmp == 0 && truncated)
+    cmp = 1;
+
+  double res = lower.toDouble();
+  if (cmp > 0 || (cmp == 0 && (lower.mantissa & 1)))
+    res = llvm::BitsToDouble(llvm::DoubleToBits(res) + 1);
+  return res;
+}
+
+} // anonymous namespace
+
+double parseDecimalDouble(llvm::StringRef str) {
+  FastAccumulator acc{};
+  int64_t exp10;
+  bool truncated = scanDecimal(str, kMaxFastDigits, acc, exp10);
+  uint64_t w = acc.value;
+
+  if (w == 0)
+    return 0.0;
+
+#if FLT_EVAL_METHOD == 0
+  // Clinger's fast path: both w and 10^|exp10| are exact doubles, so a single
+  // correctly rounded IEEE operation gives the correctly rounded result.
+  if (!truncated && w <= (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+    double d = (double)w;
+    return exp10 < 0 ? d / kExactPowersOfTen[-exp10]
+                     : d * kExactPowersOfTen[exp10];
+  }
+#endif
+
+  AdjustedMantissa am = computeFloat(exp10, w);
+  if (LLVM_UNLIKELY(truncated)) {
+    // The real value is between w * 10^exp10 and (w + 1) * 10^exp10. If both
+    // round to the same double, we are done.
+    if (!(computeFloat(exp10, w + 1) == am))
+      return slowPath(str, am);
+  }
+  return am.toDouble();
+}
+
+} // namespace s2020
@@ -0,0 +1,161 @@
+#include "s2020/Support/MappedFile.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <cerrno>
+#include <string>
+
+#ifdef LLVM_ON_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace s2020 {
+
+#ifdef LLVM_ON_UNIX
+
+namespace {
+
+/// Files smaller than this many pages are read instead, since setting up and
+/// tearing down a mapping costs more than copying a few pages.
+constexpr size_t kMinMappedPages = 4;
+
+/// The alignment of a transparent huge page on the platforms which have them.
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+/// A read-only file mapping followed by at least one zero byte.
+class MappedFileBuffer final : public llvm::MemoryBuffer {
+ public:
+  MappedFileBuffer(
+      const llvm::Twine &name,
+      void *mapping,
+      size_t mappingSize,
+      size_t fileSize)
+      : name_(name.str()), mapping_(mapping), mappingSize_(mappingSize) {
+    const char *start = static_cast<const char *>(mapping);
+    init(start, start + fileSize, true);
+  }
+
+  ~MappedFileBuffer() override {
+    ::munmap(mapping_, mappingSize_);
+  }
+
+  llvm::StringRef getBufferIdentifier() const override {
+    return name_;
+  }
+
+  BufferKind getBufferKind() const override {
+    return MemoryBuffer_MMap;
+  }
+
+ private:
+  std::string name_;
+  void *mapping_;
+  size_t mappingSize_;
+};
+
+std::error_code errnoCode() {
+  return std::error_code(errno, std::generic_category());
+}
+
+/// Reserve \p size bytes of zero pages, aligned to \p align.
+/// \return the start of the reservation, or nullptr on failure.
+char *reserve(size_t size, size_t align, size_t pageSize) {
+  size_t extra = align > pageSize ? align : 0;
+  void *res = ::mmap(
+      nullptr,
+      size + extra,
+      PROT_READ,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (res == MAP_FAILED)
+    return nullptr;
+
+  char *start = static_cast<char *>(res);
+  if (!extra)
+    return start;
+  // Trim the reservation to the aligned part.
+  char *aligned = reinterpret_cast<char *>(
+      llvm::alignTo(reinterpret_cast<uintptr_t>(start), align));
+  if (aligned != start)
+    ::munmap(start, aligned - start);
+  if (size_t tail = extra - (aligned - start))
+    ::munmap(aligned + size, tail);
+  return aligned;
+}
+
+} // anonymous namespace
+
+llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mapSourceFile(
+    const llvm::Twine &path,
+    bool hugePages) {
+  llvm::SmallString<256> pathStorage;
+  const char *pathStr = path.toNullTerminatedStringRef(pathStorage).data();
+
+  int fd = ::open(pathStr, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errnoCode();
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    auto ec = errnoCode();
+    ::close(fd);
+    return ec;
+  }
+
+  size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+  size_t fileSize = (size_t)st.st_size;
+  if (!S_ISREG(st.st_mode) || fileSize < kMinMappedPages * pageSize) {
+    ::close(fd);
+    return llvm::MemoryBuffer::getFile(path);
+  }
+
+  // One more page than the file needs, for the terminator.
+  size_t mappingSize = llvm::alignTo(fileSize, pageSize) + pageSize;
+  char *start =
+      reserve(mappingSize, hugePages ? kHugePageSize : pageSize, pageSize);
+  if (!start) {
+    ::close(fd);
+    return llvm::MemoryBuffer::getFile(path);
+  }
+
+  void *res = ::mmap(
+      start,
+      fileSize,
+      PROT_READ,
+      MAP_PRIVATE | MAP_FIXED,
+      fd,
+      0);
+  ::close(fd);
+  if (res == MAP_FAILED) {
+    ::munmap(start, mappingSize);
+    return llvm::MemoryBuffer::getFile(path);
+  }
+
+  // These are only hints, so failures are ignored.
+  ::madvise(start, fileSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  if (hugePages)
+    ::madvise(start, fileSize, MADV_HUGEPAGE);
+#endif
+
+  return std::unique_ptr<llvm::MemoryBuffer>(
+      new MappedFileBuffer(path, start, mappingSize, fileSize));
+}
+
+#else
+
+llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mapSourceFile(
+    const llvm::Twine &path,
+    bool) {
+  return llvm::MemoryBuffer::getFile(path);
+}
+
+#endif
+
+} // namespace s2020
@@ -6,6 +6,7 @@
  */
 
 #include "s2020/Support/SourceErrorManager.h"
+#include "s2020/Support/MappedFile.h"
 #include "s2020/Support/UTF8.h"
 
 #include "llvm/ADT/DenseMap.h"
@@ -307,6 +308,15 @@ void SourceErrorManager::disableBuffering() {
   bufferedNotes_.clear();
 }
 
+llvm::ErrorOr<uint32_t> SourceErrorManager::addSourceFile(
+    const llvm::Twine &path,
+    bool hugePages) {
+  auto buf = mapSourceFile(path, hugePages);
+  if (!buf)
+    return buf.getError();
+  return addNewSourceBuffer(std::move(buf.get()));
+}
+
 uint32_t SourceErrorManager::addNewVirtualSourceBuffer(
     llvm::StringRef bufferName) {
   return addNewSourceBuffer(
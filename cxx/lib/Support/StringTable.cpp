@@ -10,6 +10,31 @@
 
 namespace s2020 {
 
+UniqueString *StringTable::getString(StringRef name, unsigned hash) {
+  assert(hash == hashString(name) && "invalid precomputed hash");
+  assert(name.size() < kTombstoneSize && "string is too long");
+  // Already in the map?
+  auto it = strMap_.find(Key{name.data(), (uint32_t)name.size(), hash});
+  if (it != strMap_.end())
+    return it->second;
+
+  // Allocate a zero-terminated copy of the string
+  auto *str = new (allocator_.Allocate<UniqueString>())
+      UniqueString(zeroTerminate(allocator_, name), hash);
+  strMap_.insert({Key{str->c_str(), (uint32_t)name.size(), hash}, str});
+  link(str);
+  return str;
+}
+
+void StringTable::truncate(size_t size) {
+  assert(size <= size_ && "table is smaller than the new size");
+  for (; size_ > size; --size_) {
+    UniqueString *str = newest_;
+    strMap_.erase(Key{str->c_str(), (uint32_t)str->str().size(), str->hash()});
+    newest_ = str->prev_;
+  }
+}
+
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, Identifier id) {
   return os << id.str();
 }
@@ -0,0 +1,680 @@
+#include "s2020/AST/ASTVisitor.h"
+#include "s2020/AST/CompactAST.h"
+#include "s2020/Parser/DatumParser.h"
+#include "s2020/Parser/Lexer.h"
+#include "s2020/Parser/ParallelLexer.h"
+#include "s2020/Parser/SIMDScan.h"
+#include "s2020/Parser/StreamingLexer.h"
+#include "s2020/Parser/TokenStream.h"
+#include "s2020/Support/MappedFile.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+using namespace s2020;
+using namespace s2020::parser;
+
+namespace cl = llvm::cl;
+
+static cl::opt<std::string> InputFilename(
+    cl::Positional,
+    cl::desc("<input file>"),
+    cl::init(""));
+
+static cl::opt<std::string> Bench(
+    "bench",
+    cl::desc("Benchmark to run: lex, parse, scaling, ast, image"),
+    cl::init("lex"));
+
+static cl::opt<std::string> Gen(
+    "gen",
+    cl::desc(
+        "Synthetic input to generate if no file is specified: code, numbers, "
+        "comments"),
+    cl::init("code"));
+
+static cl::opt<unsigned>
+    SizeMB("size-mb", cl::desc("Size of the synthetic input"), cl::init(16));
+
+static cl::opt<unsigned> Repeat(
+    "repeat",
+    cl::desc("Number of runs; the fastest one is reported"),
+    cl::init(5));
+
+static cl::opt<std::string> ISA(
+    "isa",
+    cl::desc("Scanning ISA: scalar, sse2, avx2 or all"),
+    cl::init("all"));
+
+static cl::opt<bool> HugePages(
+    "huge-pages",
+    cl::desc("Ask for transparent huge pages when mapping the input file"),
+    cl::init(false));
+
+static cl::opt<unsigned> Threads(
+    "threads",
+    cl::desc("Maximum number of threads for the scaling benchmark"),
+    cl::init(std::max(1u, std::thread::hardware_concurrency())));
+
+namespace {
+
+/// A tiny deterministic random number generator, so the synthetic input is
+/// the same on every run.
+class Rand {
+ public:
+  unsigned next(unsigned n) {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(state_ >> 33) % n;
+  }
+
+ private:
+  uint64_t state_ = 1;
+};
+
+/// Generate machine-generated looking Scheme code with long indentation runs
+/// and banner comments.
+std::string genCode(size_t size) {
+  static const char *const words[] = {
+      "define",
+      "let",
+      "lambda",
+      "if",
+      "call-with-current-continuation",
+      "%internal-frobnicate-vector!",
+      "accumulator-value",
+      "vector-ref",
+      "string->symbol",
+      "x",
+  };
+  const unsigned numWords = sizeof(words) / sizeof(words[0]);
+
+  Rand rand{};
+  std::string res;
+  res.reserve(size + 256);
+  while (res.size() < size) {
+    res.append(76, ';');
+    res += "\n;; Generated section ";
+    res += std::to_string(res.size());
+    res += "\n";
+    res.append(76, ';');
+    res += "\n(define (f";
+    res += std::to_string(rand.next(1000));
+    res += " a b)\n";
+    for (unsigned line = 0, e = 4 + rand.next(8); line != e; ++line) {
+      res.append(4 + rand.next(28), ' ');
+      res += '(';
+      for (unsigned i = 0, n = 1 + rand.next(4); i != n; ++i) {
+        res += words[rand.next(numWords)];
+        res += ' ';
+        res += std::to_string(rand.next(100000));
+        res += ' ';
+      }
+      res += ")  ; ";
+      res.append(10 + rand.next(40), '-');
+      res += '\n';
+    }
+    res += ")\n\n";
+  }
+  return res;
+}
+
+/// Generate a numeric data file: lists of reals with a varying number of
+/// digits and exponents, mixed with integers, similar to a sensor dump.
+std::string genNumbers(size_t size) {
+  Rand rand{};
+  std::string res;
+  res.reserve(size + 256);
+  char buf[64];
+  while (res.size() < size) {
+    res += '(';
+    for (unsigned i = 0; i != 8; ++i) {
+      if (i)
+        res += ' ';
+      switch (rand.next(4)) {
+        case 0: // Integer.
+          res += std::to_string(rand.next(1000000));
+          break;
+        case 1: // Fixed point with a few digits.
+          snprintf(
+              buf,
+              sizeof(buf),
+              "%s%u.%0*u",
+              rand.next(2) ? "-" : "",
+              rand.next(1000),
+              3,
+              rand.next(1000));
+          res += buf;
+          break;
+        case 2: // Full precision with an exponent.
+          snprintf(
+              buf,
+              sizeof(buf),
+              "%.17g",
+              (double)rand.next(1u << 30) / (rand.next(1u << 20) + 1) *
+                  std::pow(10.0, (int)rand.next(80) - 40));
+          res += buf;
+          break;
+        case 3: // Short with an exponent.
+          snprintf(
+              buf,
+              sizeof(buf),
+              "%u.%ue%d",
+              rand.next(10),
+              rand.next(100),
+              (int)rand.next(40) - 20);
+          res += buf;
+          break;
+      }
+    }
+    res += ")\n";
+  }
+  return res;
+}
+
+/// Generate code disabled by large block comments, with a nested comment in
+/// each of them.
+std::string genComments(size_t size) {
+  const size_t blockSize = 1024 * 1024;
+  std::string code = genCode(blockSize);
+  std::string res;
+  res.reserve(size + 2 * blockSize);
+  while (res.size() < size) {
+    res += "#|\n";
+    res.append(code, 0, code.size() / 2);
+    res += "#| nested |#\n";
+    res.append(code, code.size() / 2, std::string::npos);
+    res += "|#\n(define x 1)\n";
+  }
+  return res;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> getInput() {
+  if (!InputFilename.empty()) {
+    auto res = mapSourceFile(InputFilename, HugePages);
+    if (!res) {
+      llvm::errs() << InputFilename << ": " << res.getError().message()
+                   << "\n";
+      exit(1);
+    }
+    return std::move(res.get());
+  }
+
+  std::string str;
+  if (Gen == "code") {
+    str = genCode((size_t)SizeMB * 1024 * 1024);
+  } else if (Gen == "numbers") {
+    str = genNumbers((size_t)SizeMB * 1024 * 1024);
+  } else if (Gen == "comments") {
+    str = genComments((size_t)SizeMB * 1024 * 1024);
+  } else {
+    llvm::errs() << "Unknown input kind: " << Gen << "\n";
+    exit(1);
+  }
+  return llvm::MemoryBuffer::getMemBufferCopy(str, "<" + Gen + ">");
+}
+
+/// Run \p fn Repeat times and return the fastest time in seconds.
+template <typename F>
+double bestTime(F fn) {
+  double best = 0;
+  for (unsigned i = 0; i != Repeat; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    if (i == 0 || t.count() < best)
+      best = t.count();
+  }
+  return best;
+}
+
+void report(llvm::StringRef name, size_t bytes, double seconds) {
+  llvm::outs() << llvm::left_justify(name, 24) << " "
+               << llvm::format("%9.1f MB/s", bytes / seconds / 1e6) << "\n";
+}
+
+void benchLex(const llvm::MemoryBuffer &input) {
+  ASTContext context{};
+  context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+      input.getBuffer(), input.getBufferIdentifier(), true));
+  auto &buf = *context.sm.getSourceBuffer(1);
+
+  // The speed of light: the cost of touching every byte once.
+  double memchrTime = bestTime([&buf]() {
+    const void *volatile res =
+        memchr(buf.getBufferStart(), '\x01', buf.getBufferSize());
+    (void)res;
+  });
+  report("memchr", buf.getBufferSize(), memchrTime);
+
+  ScanISA saved = getScanISA();
+  for (unsigned i = 0; i <= (unsigned)ScanISA::avx2; ++i) {
+    auto isa = (ScanISA)i;
+    if (ISA != "all" && ISA != scanISAName(isa))
+      continue;
+    if (setScanISA(isa) != isa) {
+      llvm::outs() << "lex/" << scanISAName(isa) << ": not supported\n";
+      continue;
+    }
+
+    double t = bestTime([&context, &buf]() {
+      Lexer lex{context, buf};
+      do
+        lex.advance();
+      while (lex.token.getKind() != TokenKind::eof);
+    });
+    report(std::string("lex/") + scanISAName(isa), buf.getBufferSize(), t);
+  }
+  setScanISA(saved);
+
+  // The same input arriving in pieces the size of a pipe buffer.
+  double t = bestTime([&context, &buf]() {
+    static const size_t kPieceSize = 64 * 1024;
+    StreamingLexer lex{context, "stream"};
+    StringRef rest = buf.getBuffer();
+    for (;;) {
+      if (lex.advance()) {
+        if (lex.token().getKind() == TokenKind::eof)
+          break;
+      } else if (rest.empty()) {
+        lex.endInput();
+      } else {
+        lex.addInput(rest.take_front(kPieceSize));
+        rest = rest.substr(kPieceSize);
+      }
+    }
+  });
+  report("lex/stream", buf.getBufferSize(), t);
+}
+
+/// Compare parsing while lexing on demand, reading one datum at a time, and
+/// tokenizing the whole buffer first and parsing the token stream.
+void benchParse(const llvm::MemoryBuffer &input) {
+  auto addBuffer = [&input](ASTContext &context) -> const llvm::MemoryBuffer & {
+    context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+        input.getBuffer(), input.getBufferIdentifier(), true));
+    return *context.sm.getSourceBuffer(1);
+  };
+
+  double t = bestTime([&addBuffer]() {
+    ASTContext context{};
+    parseDatums(context, addBuffer(context));
+  });
+  report("parse/lexer", input.getBufferSize(), t);
+
+  // One datum at a time, freeing each after it has been read, so the nodes
+  // stay in cache.
+  t = bestTime([&addBuffer]() {
+    ASTContext context{};
+    readDatums(
+        context, addBuffer(context), [](ast::Node *) { return true; }, true);
+  });
+  report("parse/reader", input.getBufferSize(), t);
+
+  ASTContext context{};
+  const auto &buf = addBuffer(context);
+  t = bestTime([&context, &buf]() { tokenizeAll(context, buf); });
+  report("tokenize", input.getBufferSize(), t);
+
+  auto stream = tokenizeAll(context, buf);
+  t = bestTime([&context, &stream]() { parseDatums(context, stream); });
+  report("parse/stream", input.getBufferSize(), t);
+
+  llvm::outs() << stream.size() << " tokens, "
+               << llvm::format(
+                      "%.1f bytes/token\n",
+                      (double)input.getBufferSize() / stream.size());
+}
+
+/// Print a row of the scaling benchmark.
+void reportScaling(
+    const std::string &name,
+    size_t size,
+    double t,
+    double serial) {
+  llvm::outs() << llvm::left_justify(name, 24) << " "
+               << llvm::format(
+                      "%9.1f MB/s  %5.2fx", size / t / 1e6, serial / t)
+               << "\n";
+}
+
+/// Measure how parallel tokenization and parsing scale with the number of
+/// threads.
+void benchScaling(const llvm::MemoryBuffer &input) {
+  ASTContext context{};
+  context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+      input.getBuffer(), input.getBufferIdentifier(), true));
+  auto &buf = *context.sm.getSourceBuffer(1);
+  size_t size = buf.getBufferSize();
+
+  double serial = bestTime([&context, &buf]() { tokenizeAll(context, buf); });
+  report("tokenize", size, serial);
+
+  // 1, 2, 4, ... and finally the maximum.
+  unsigned maxThreads = Threads;
+  for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+    double t = bestTime([&context, &buf, threads]() {
+      tokenizeAllParallel(context, buf, threads);
+    });
+    reportScaling("tokenize/" + std::to_string(threads), size, t, serial);
+    if (threads >= maxThreads)
+      break;
+  }
+
+  auto stream = tokenizeAll(context, buf);
+  serial = bestTime([&context, &stream]() { parseDatums(context, stream); });
+  report("parse/stream", size, serial);
+
+  for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+    double t = bestTime([&context, &stream, threads]() {
+      parseDatumsParallel(context, stream, threads);
+    });
+    reportScaling("parse/" + std::to_string(threads), size, t, serial);
+    if (threads >= maxThreads)
+      break;
+  }
+}
+
+/// \return the number of nodes in \p node, counting shared nodes once for
+///     every reference. \p node must not be cyclic.
+size_t countNodes(const ast::Node *node) {
+  size_t count = 0;
+  llvm::SmallVector<const ast::Node *, 32> stack{node};
+  while (!stack.empty()) {
+    node = stack.pop_back_val();
+    ++count;
+    if (auto *pair = llvm::dyn_cast<ast::PairNode>(node)) {
+      stack.push_back(pair->getCdr());
+      stack.push_back(pair->getCar());
+    } else if (auto *vec = llvm::dyn_cast<ast::VectorNode>(node)) {
+      stack.append(vec->getElements().begin(), vec->getElements().end());
+    }
+  }
+  return count;
+}
+
+/// The same as countNodes() with a visitor, which should be as fast.
+class NodeCounter : public ast::ConstRecursiveASTVisitor<NodeCounter> {
+ public:
+  size_t count = 0;
+
+  bool visitNode(const ast::Node *) {
+    ++count;
+    return true;
+  }
+};
+
+/// The same as countNodes() for the compact encoding.
+size_t countNodes(
+    const ast::CompactAST &compact,
+    ast::CompactAST::NodeRef ref) {
+  size_t count = 0;
+  llvm::SmallVector<ast::CompactAST::NodeRef, 32> stack{ref};
+  while (!stack.empty()) {
+    ref = stack.pop_back_val();
+    ++count;
+    switch (compact.getKind(ref)) {
+      case ast::NodeKind::Pair:
+        stack.push_back(compact.getCdr(ref));
+        stack.push_back(compact.getCar(ref));
+        break;
+      case ast::NodeKind::Vector:
+        stack.append(
+            compact.getElements(ref).begin(), compact.getElements(ref).end());
+        break;
+      default:
+        break;
+    }
+  }
+  return count;
+}
+
+/// Compare the memory used by the AST nodes and their compact encoding, and
+/// the speed of walking them, and measure the traversals in the AST library.
+/// The input must not have cyclic data.
+void benchAST(const llvm::MemoryBuffer &input) {
+  ASTContext context{};
+  context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+      input.getBuffer(), input.getBufferIdentifier(), true));
+  auto &buf = *context.sm.getSourceBuffer(1);
+  size_t size = buf.getBufferSize();
+
+  auto parsed = parseDatums(context, buf);
+  if (!parsed) {
+    llvm::errs() << "Parsing failed\n";
+    exit(1);
+  }
+  const auto &datums = parsed.getValue();
+
+  ast::CompactAST compact{buf.getBufferStart()};
+  std::vector<ast::CompactAST::NodeRef> refs{};
+  for (const ast::Node *node : datums)
+    refs.push_back(compact.encode(node));
+
+  size_t numNodes = 0;
+  for (const ast::Node *node : datums)
+    numNodes += countNodes(node);
+  llvm::outs() << numNodes << " nodes, "
+               << llvm::format(
+                      "%.1f MB in nodes, %.1f MB compact (%.0f%%)\n",
+                      context.getNodeMemory() / 1e6,
+                      compact.getMemorySize() / 1e6,
+                      100.0 * compact.getMemorySize() /
+                          context.getNodeMemory());
+
+  double t = bestTime([&buf, &datums]() {
+    ast::CompactAST compact{buf.getBufferStart()};
+    for (const ast::Node *node : datums)
+      compact.encode(node);
+  });
+  report("ast/encode", size, t);
+
+  t = bestTime([&compact, &refs]() {
+    ASTContext context{};
+    for (ast::CompactAST::NodeRef ref : refs)
+      compact.decode(context, ref);
+  });
+  report("ast/decode", size, t);
+
+  t = bestTime([&datums]() {
+    size_t count = 0;
+    for (const ast::Node *node : datums)
+      count += countNodes(node);
+    volatile size_t res = count;
+    (void)res;
+  });
+  report("ast/walk-nodes", size, t);
+
+  t = bestTime([&datums]() {
+    NodeCounter counter{};
+    for (const ast::Node *node : datums)
+      counter.traverse(node);
+    volatile size_t res = counter.count;
+    (void)res;
+  });
+  report("ast/walk-visitor", size, t);
+
+  t = bestTime([&compact, &refs]() {
+    size_t count = 0;
+    for (ast::CompactAST::NodeRef ref : refs)
+      count += countNodes(compact, ref);
+    volatile size_t res = count;
+    (void)res;
+  });
+  report("ast/walk-compact", size, t);
+
+  // A second copy, so that deepEqual() compares every node.
+  auto copy = parseDatums(context, buf);
+  t = bestTime([&datums, &copy]() {
+    for (size_t i = 0, e = datums.size(); i != e; ++i) {
+      if (!ast::deepEqual(datums[i], (*copy)[i]))
+        llvm::report_fatal_error("the copy differs");
+    }
+  });
+  report("ast/deep-equal", size, t);
+
+  t = bestTime([&datums]() {
+    llvm::raw_null_ostream OS{};
+    for (const ast::Node *node : datums)
+      ast::dump(OS, node);
+  });
+  report("ast/dump", size, t);
+
+  t = bestTime([&datums]() {
+    unsigned hash = 0;
+    for (const ast::Node *node : datums)
+      hash ^= ast::hashDatum(node);
+    volatile unsigned res = hash;
+    (void)res;
+  });
+  report("ast/hash", size, t);
+
+  // Parse with and without hash-consing, in a fresh context every time.
+  for (bool hashConsing : {false, true}) {
+    size_t memory = 0;
+    t = bestTime([&buf, hashConsing, &memory]() {
+      ASTContext context{};
+      context.setHashConsing(hashConsing);
+      context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+          buf.getBuffer(), buf.getBufferIdentifier(), true));
+      if (!parseDatums(context, *context.sm.getSourceBuffer(1)))
+        llvm::report_fatal_error("parsing failed");
+      memory = context.getNodeMemory();
+    });
+    report(hashConsing ? "ast/parse-hash-consed" : "ast/parse", size, t);
+    llvm::outs() << llvm::format("  %.1f MB in nodes\n", memory / 1e6);
+  }
+}
+
+/// Map the image at \p path, load it for \p source and pass it to \p fn.
+template <typename F>
+void loadImage(llvm::StringRef path, const llvm::MemoryBuffer &source, F fn) {
+  auto file = mapSourceFile(path);
+  if (!file)
+    llvm::report_fatal_error("cannot map the image");
+  auto compact =
+      ast::CompactAST::load((*file)->getBuffer(), source.getBuffer());
+  if (!compact)
+    llvm::report_fatal_error("cannot load the image");
+  fn(*compact);
+}
+
+/// Compare a warm start from an image of the compact encoding, written to a
+/// cache file by an earlier run, with parsing the source again.
+void benchImage(const llvm::MemoryBuffer &input) {
+  ASTContext context{};
+  context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+      input.getBuffer(), input.getBufferIdentifier(), true));
+  auto &buf = *context.sm.getSourceBuffer(1);
+  size_t size = buf.getBufferSize();
+
+  auto parsed = parseDatums(context, buf);
+  if (!parsed) {
+    llvm::errs() << "Parsing failed\n";
+    exit(1);
+  }
+  const auto &datums = parsed.getValue();
+
+  double t = bestTime([&buf, &datums]() {
+    ast::CompactAST compact{buf.getBufferStart()};
+    for (const ast::Node *node : datums)
+      compact.encode(node);
+    llvm::raw_null_ostream OS{};
+    compact.write(OS, buf.getBuffer());
+  });
+  report("image/write", size, t);
+
+  llvm::SmallString<128> path;
+  int fd;
+  if (auto ec =
+          llvm::sys::fs::createTemporaryFile("s2020-bench", "ast", fd, path)) {
+    llvm::errs() << "Cannot create the image: " << ec.message() << "\n";
+    exit(1);
+  }
+  llvm::FileRemover remover{path};
+  {
+    llvm::raw_fd_ostream OS{fd, true};
+    ast::CompactAST compact{buf.getBufferStart()};
+    for (const ast::Node *node : datums)
+      compact.encode(node);
+    compact.write(OS, buf.getBuffer());
+    llvm::outs() << llvm::format(
+        "%.1f MB image, %.1f MB in nodes\n",
+        compact.getMemorySize() / 1e6,
+        context.getNodeMemory() / 1e6);
+  }
+
+  // Every warm start produces a usable AST from the source buffer, which is
+  // already in memory, and the image file, which is in the page cache.
+  t = bestTime([&buf]() {
+    ASTContext context{};
+    context.sm.addNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(
+        buf.getBuffer(), buf.getBufferIdentifier(), true));
+    if (!parseDatums(context, *context.sm.getSourceBuffer(1)))
+      llvm::report_fatal_error("parsing failed");
+  });
+  report("image/parse", size, t);
+
+  t = bestTime([&path, &buf]() {
+    loadImage(path, buf, [](const ast::CompactAST &) {});
+  });
+  report("image/load", size, t);
+
+  t = bestTime([&path, &buf]() {
+    loadImage(path, buf, [](const ast::CompactAST &compact) {
+      size_t count = 0;
+      for (ast::CompactAST::NodeRef ref : compact.getRoots())
+        count += countNodes(compact, ref);
+      volatile size_t res = count;
+      (void)res;
+    });
+  });
+  report("image/load-walk", size, t);
+
+  t = bestTime([&path, &buf]() {
+    loadImage(path, buf, [](const ast::CompactAST &compact) {
+      ASTContext context{};
+      for (ast::CompactAST::NodeRef ref : compact.getRoots())
+        compact.decode(context, ref);
+    });
+  });
+  report("image/load-decode", size, t);
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  llvm::InitLLVM initLLVM(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "Scheme 2020 front-end benchmarks\n");
+
+  auto input = getInput();
+  llvm::outs() << "input: " << input->getBufferIdentifier() << ", "
+               << input->getBufferSize() << " bytes\n";
+
+  if (Bench == "lex") {
+    benchLex(*input);
+  } else if (Bench == "parse") {
+    benchParse(*input);
+  } else if (Bench == "scaling") {
+    benchScaling(*input);
+  } else if (Bench == "ast") {
+    benchAST(*input);
+  } else if (Bench == "image") {
+    benchImage(*input);
+  } else {
+    llvm::errs() << "Unknown benchmark: " << Bench << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include "s2020/AST/ASTVisitor.h"
+
+#include "s2020/Parser/DatumParser.h"
+
+#include "llvm/ADT/DenseSet.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using namespace s2020;
+using namespace s2020::ast;
+
+namespace {
+
+class ASTVisitorTest : public ::testing::Test {
+ protected:
+  /// Parse \p str, which must be one datum free of errors.
+  Node *parse(const char *str) {
+    auto id = context_.sm.addNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(str, "input", true));
+    auto parsed =
+        parser::parseDatums(context_, *context_.sm.getSourceBuffer(id));
+    EXPECT_TRUE(parsed.hasValue() && parsed->size() == 1);
+    return parsed && parsed->size() == 1 ? parsed->front() : nullptr;
+  }
+
+ protected:
+  ASTContext context_{};
+};
+
+/// Describes a node, with a fallback for the kinds it doesn't handle.
+class Describer : public ConstASTVisitor<Describer, std::string, bool> {
+ public:
+  std::string visitSymbol(const SymbolNode *node, bool quoted) {
+    return (quoted ? "'" : "") + node->getValue().str().str();
+  }
+  std::string visitPair(const PairNode *, bool) {
+    return "pair";
+  }
+  std::string visitNode(const Node *node, bool) {
+    return nodeKindStr(node->getKind()).str();
+  }
+};
+
+TEST_F(ASTVisitorTest, DispatchTest) {
+  Node *node = parse("(a 1 #(b))");
+  Describer describer{};
+  EXPECT_EQ("pair", describer.visit(node, false));
+  EXPECT_EQ("'a", describer.visit(llvm::cast<PairNode>(node)->getCar(), true));
+  EXPECT_EQ(
+      nodeKindStr(NodeKind::Number),
+      describer.visit(
+          llvm::cast<PairNode>(llvm::cast<PairNode>(node)->getCdr())->getCar(),
+          false));
+}
+
+/// Records the walk in pre-order and post-order.
+class Recorder : public ConstRecursiveASTVisitor<Recorder> {
+ public:
+  std::string trace{};
+  /// Stop at this symbol, if it is not empty.
+  std::string stopAt{};
+
+  bool visitSymbol(const SymbolNode *node) {
+    trace += node->getValue().str().str() + " ";
+    return node->getValue().str() != stopAt;
+  }
+  bool visitPair(const PairNode *) {
+    trace += "( ";
+    return true;
+  }
+  bool visitVector(const VectorNode *) {
+    trace += "#( ";
+    return true;
+  }
+  bool visitNode(const Node *node) {
+    trace += nodeKindStr(node->getKind()).str() + " ";
+    return true;
+  }
+
+  bool shouldTraversePostOrder() const {
+    return true;
+  }
+  bool postVisit(const Node *) {
+    trace += ") ";
+    return true;
+  }
+};
+
+TEST_F(ASTVisitorTest, OrderTest) {
+  Node *node = parse("(a #(b c) . d)");
+  Recorder recorder{};
+  EXPECT_TRUE(recorder.traverse(node));
+  EXPECT_EQ("( a ( #( b c ) d ) ) ", recorder.trace);
+}
+
+TEST_F(ASTVisitorTest, EarlyExitTest) {
+  Node *node = parse("(a (b c) d)");
+  Recorder recorder{};
+  recorder.stopAt = "b";
+  EXPECT_FALSE(recorder.traverse(node));
+  EXPECT_EQ("( a ( ( b ", recorder.trace);
+}
+
+/// Counts the symbols, visiting every pair and vector once.
+class SymbolCounter : public ConstRecursiveASTVisitor<SymbolCounter> {
+ public:
+  unsigned count = 0;
+  llvm::DenseSet<const Node *> seen{};
+
+  bool shouldTraverse(const Node *node) {
+    return !(llvm::isa<PairNode>(node) || llvm::isa<VectorNode>(node)) ||
+        seen.insert(node).second;
+  }
+  bool visitSymbol(const SymbolNode *) {
+    ++count;
+    return true;
+  }
+};
+
+TEST_F(ASTVisitorTest, SharedTest) {
+  SymbolCounter counter{};
+  EXPECT_TRUE(counter.traverse(parse("#0=(a b . #0#)")));
+  EXPECT_EQ(2u, counter.count);
+
+  // Without skipping them, shared nodes are visited every time.
+  Recorder recorder{};
+  EXPECT_TRUE(recorder.traverse(parse("(#0=(x) #0#)")));
+  EXPECT_EQ(2u, std::count(recorder.trace.begin(), recorder.trace.end(), 'x'));
+}
+
+/// Replaces the symbol x with the symbol y in a tree.
+class Replacer : public RecursiveASTVisitor<Replacer> {
+ public:
+  Replacer(Node *x, Node *y) : x_(x), y_(y) {}
+
+  bool visitPair(PairNode *pair) {
+    if (deepEqual(pair->getCar(), x_))
+      pair->setCar(y_);
+    return true;
+  }
+
+ private:
+  Node *x_;
+  Node *y_;
+};
+
+TEST_F(ASTVisitorTest, MutableTest) {
+  Node *node = parse("(x (x . z) x)");
+  Node *y = parse("y");
+  Replacer replacer{parse("x"), y};
+  EXPECT_TRUE(replacer.traverse(node));
+  EXPECT_TRUE(deepEqual(node, parse("(y (y . z) y)")));
+}
+
+TEST_F(ASTVisitorTest, DeepTest) {
+  // The walk doesn't recurse.
+  constexpr unsigned kDepth = 100000;
+  std::string str(kDepth, '(');
+  str += "a";
+  str.append(kDepth, ')');
+  SymbolCounter counter{};
+  EXPECT_TRUE(counter.traverse(parse(str.c_str())));
+  EXPECT_EQ(1u, counter.count);
+}
+
+} // anonymous namespace
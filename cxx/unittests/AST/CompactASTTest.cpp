@@ -0,0 +1,332 @@
+#include "s2020/AST/CompactAST.h"
+
+#include "s2020/Parser/DatumParser.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::ast;
+
+namespace {
+
+class CompactASTTest : public ::testing::Test {
+ protected:
+  /// Parse \p str, which must be free of errors.
+  std::vector<Node *> parse(const char *str) {
+    auto id = context_.sm.addNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(str, "input", true));
+    buf_ = context_.sm.getSourceBuffer(id);
+    auto parsed = parser::parseDatums(context_, *buf_);
+    EXPECT_TRUE(parsed.hasValue());
+    return parsed ? std::move(*parsed) : std::vector<Node *>{};
+  }
+
+  /// Check that \p ref has the same kind and location as \p node, and the
+  /// same value for atoms.
+  void
+  checkNode(const CompactAST &compact, CompactAST::NodeRef ref, Node *node);
+
+  /// \return the image of \p compact, in words so that it is aligned.
+  std::vector<uint32_t> writeImage(const CompactAST &compact) {
+    std::string str{};
+    llvm::raw_string_ostream OS{str};
+    compact.write(OS, buf_->getBuffer());
+    OS.flush();
+    EXPECT_EQ(0u, str.size() % sizeof(uint32_t));
+    std::vector<uint32_t> image(str.size() / sizeof(uint32_t));
+    memcpy(image.data(), str.data(), str.size());
+    return image;
+  }
+
+  static llvm::StringRef toStringRef(const std::vector<uint32_t> &image) {
+    return {reinterpret_cast<const char *>(image.data()),
+            image.size() * sizeof(uint32_t)};
+  }
+
+ protected:
+  ASTContext context_{};
+  const llvm::MemoryBuffer *buf_ = nullptr;
+};
+
+void CompactASTTest::checkNode(
+    const CompactAST &compact,
+    CompactAST::NodeRef ref,
+    Node *node) {
+  ASSERT_EQ(node->getKind(), compact.getKind(ref));
+  EXPECT_EQ(node->getStartLoc(), compact.getSourceRange(ref).Start);
+  EXPECT_EQ(node->getEndLoc(), compact.getSourceRange(ref).End);
+  switch (node->getKind()) {
+    case NodeKind::Boolean:
+      EXPECT_EQ(
+          llvm::cast<BooleanNode>(node)->getValue(), compact.getBoolean(ref));
+      break;
+    case NodeKind::Character:
+      EXPECT_EQ(
+          llvm::cast<CharacterNode>(node)->getValue(),
+          compact.getCharacter(ref));
+      break;
+    case NodeKind::Number:
+      EXPECT_EQ(
+          llvm::cast<NumberNode>(node)->getValue(), compact.getNumber(ref));
+      break;
+    case NodeKind::String:
+      EXPECT_EQ(
+          llvm::cast<StringNode>(node)->getValue().str(),
+          compact.getString(ref));
+      break;
+    case NodeKind::Symbol:
+      EXPECT_EQ(
+          llvm::cast<SymbolNode>(node)->getValue().str(),
+          compact.getString(ref));
+      break;
+    case NodeKind::Bytevector:
+      EXPECT_EQ(
+          llvm::cast<BytevectorNode>(node)->getBytes(), compact.getBytes(ref));
+      break;
+    case NodeKind::Vector:
+      EXPECT_EQ(llvm::cast<VectorNode>(node)->size(), compact.getSize(ref));
+      break;
+    default:
+      break;
+  }
+}
+
+TEST_F(CompactASTTest, RoundTripTest) {
+  auto datums = parse(
+      "(define (f x) (+ x 1.5 -7 #xFF 12345678901))"
+      " [let ((a \"str\") (b #\\x3bb)) (a . b)]"
+      " #(1 #(a) \"str\") #u8() #u8(1 2 3 4 5)"
+      " 'a `(b ,c ,@d) ()");
+  // The parser doesn't read booleans yet.
+  datums.push_back(list(
+      context_,
+      new (context_) BooleanNode(true),
+      new (context_) BooleanNode(false)));
+  CompactAST compact{buf_->getBufferStart()};
+
+  for (Node *node : datums) {
+    CompactAST::NodeRef ref = compact.encode(node);
+    Node *decoded = compact.decode(context_, ref);
+    EXPECT_TRUE(deepEqual(node, decoded));
+
+    // Walk the original datum and the compact one together.
+    std::vector<std::pair<Node *, CompactAST::NodeRef>> stack{{node, ref}};
+    while (!stack.empty()) {
+      auto item = stack.back();
+      stack.pop_back();
+      checkNode(compact, item.second, item.first);
+      if (auto *pair = llvm::dyn_cast<PairNode>(item.first)) {
+        stack.emplace_back(pair->getCar(), compact.getCar(item.second));
+        stack.emplace_back(pair->getCdr(), compact.getCdr(item.second));
+      } else if (auto *vec = llvm::dyn_cast<VectorNode>(item.first)) {
+        for (size_t i = 0; i != vec->size(); ++i)
+          stack.emplace_back(
+              vec->getElement(i), compact.getElements(item.second)[i]);
+      }
+    }
+  }
+}
+
+TEST_F(CompactASTTest, NoLocationTest) {
+  // The nodes added by the abbreviation have no location.
+  auto datums = parse("'a");
+  CompactAST compact{buf_->getBufferStart()};
+  CompactAST::NodeRef ref = compact.encode(datums[0]);
+
+  EXPECT_TRUE(compact.getSourceRange(ref).isValid());
+  EXPECT_FALSE(compact.getSourceRange(compact.getCar(ref)).isValid());
+  Node *decoded = compact.decode(context_, ref);
+  EXPECT_FALSE(
+      llvm::cast<PairNode>(decoded)->getCar()->getSourceRange().isValid());
+}
+
+TEST_F(CompactASTTest, SharingTest) {
+  auto datums = parse("(#0=(a b) #0#) #0=(a . #0#) #1=#(x #1#) (a a)");
+  CompactAST compact{buf_->getBufferStart()};
+  std::vector<CompactAST::NodeRef> refs{};
+  for (Node *node : datums)
+    refs.push_back(compact.encode(node));
+
+  // Shared.
+  CompactAST::NodeRef ref = refs[0];
+  EXPECT_EQ(compact.getCar(ref), compact.getCar(compact.getCdr(ref)));
+  // Cyclic.
+  ref = refs[1];
+  EXPECT_EQ(ref, compact.getCdr(ref));
+  ref = refs[2];
+  EXPECT_EQ(ref, compact.getElements(ref)[1]);
+  // Equal identifiers are stored once, but not the nodes.
+  ref = refs[3];
+  EXPECT_NE(compact.getCar(ref), compact.getCar(compact.getCdr(ref)));
+  EXPECT_EQ(
+      compact.getIdentifier(compact.getCar(ref)),
+      compact.getIdentifier(compact.getCar(compact.getCdr(ref))));
+
+  for (size_t i = 0; i != datums.size(); ++i)
+    EXPECT_TRUE(deepEqual(datums[i], compact.decode(context_, refs[i])));
+  auto *pair = llvm::cast<PairNode>(compact.decode(context_, refs[0]));
+  EXPECT_EQ(pair->getCar(), llvm::cast<PairNode>(pair->getCdr())->getCar());
+  pair = llvm::cast<PairNode>(compact.decode(context_, refs[1]));
+  EXPECT_EQ(pair, pair->getCdr());
+  auto *vec = llvm::cast<VectorNode>(compact.decode(context_, refs[2]));
+  EXPECT_EQ(vec, vec->getElement(1));
+}
+
+TEST_F(CompactASTTest, DeepTest) {
+  // Encoding and decoding don't recurse.
+  constexpr unsigned kDepth = 100000;
+  std::string str(kDepth, '(');
+  str.append(kDepth, ')');
+  auto datums = parse(str.c_str());
+  CompactAST compact{buf_->getBufferStart()};
+  CompactAST::NodeRef ref = compact.encode(datums[0]);
+
+  Node *node = compact.decode(context_, ref);
+  for (unsigned i = 0; i != kDepth - 1; ++i) {
+    ASSERT_EQ(NodeKind::Pair, compact.getKind(ref));
+    ASSERT_EQ(NodeKind::Null, compact.getKind(compact.getCdr(ref)));
+    ref = compact.getCar(ref);
+    node = llvm::cast<PairNode>(node)->getCar();
+  }
+  EXPECT_EQ(NodeKind::Null, compact.getKind(ref));
+  EXPECT_EQ(NodeKind::Null, node->getKind());
+}
+
+TEST_F(CompactASTTest, MemoryTest) {
+  // A pair takes five words, against a pointer-sized kind, two locations and
+  // two pointers.
+  std::string str = "(";
+  for (unsigned i = 0; i != 10000; ++i)
+    str += "a ";
+  str += ")";
+  auto datums = parse(str.c_str());
+  CompactAST compact{buf_->getBufferStart()};
+  compact.encode(datums[0]);
+
+  size_t nodeSize =
+      10000 * (sizeof(PairNode) + sizeof(SymbolNode)) + sizeof(NullNode);
+  EXPECT_LE(compact.getMemorySize(), nodeSize * 2 / 3);
+}
+
+TEST_F(CompactASTTest, ImageTest) {
+  auto datums = parse(
+      "(define (f x) (+ x 1.5 -7 12345678901 -0.0))"
+      " [let ((a \"str\") (b #\\x3bb)) (a . b)]"
+      " #(1 #(a) \"\") #u8() #u8(1 2 3 4 5)"
+      " 'a (#0=(a b) #0#) #0=(a . #0#) ()");
+  datums.push_back(list(
+      context_,
+      new (context_) BooleanNode(true),
+      new (context_) BooleanNode(false)));
+  CompactAST compact{buf_->getBufferStart()};
+  for (Node *node : datums)
+    compact.encode(node);
+  std::vector<uint32_t> image = writeImage(compact);
+
+  auto loaded = CompactAST::load(toStringRef(image), buf_->getBuffer());
+  ASSERT_TRUE(bool(loaded));
+  ASSERT_EQ(datums.size(), loaded->getRoots().size());
+  EXPECT_EQ(image.size() * sizeof(uint32_t), loaded->getMemorySize());
+  for (size_t i = 0; i != datums.size(); ++i) {
+    CompactAST::NodeRef ref = loaded->getRoots()[i];
+    EXPECT_EQ(compact.getRoots()[i], ref);
+    EXPECT_TRUE(deepEqual(datums[i], loaded->decode(context_, ref)));
+  }
+
+  // The loaded image is used in place.
+  CompactAST::NodeRef ref = loaded->getRoots()[0];
+  checkNode(*loaded, ref, datums[0]);
+  Node *fx = llvm::cast<PairNode>(
+                 llvm::cast<PairNode>(datums[0])->getCdr())
+                 ->getCar();
+  CompactAST::NodeRef fxRef = loaded->getCar(loaded->getCdr(ref));
+  checkNode(*loaded, fxRef, fx);
+  checkNode(
+      *loaded,
+      loaded->getCar(fxRef),
+      llvm::cast<PairNode>(fx)->getCar());
+  EXPECT_EQ(0, loaded->getString(loaded->getCar(fxRef)).end()[0]);
+  CompactAST::NodeRef cyclic = loaded->getRoots()[7];
+  EXPECT_EQ(cyclic, loaded->getCdr(cyclic));
+
+  // Writing a loaded image copies it.
+  EXPECT_EQ(image, writeImage(*loaded));
+}
+
+TEST_F(CompactASTTest, ImageErrorTest) {
+  auto datums = parse("(a \"b\" 1.5)");
+  CompactAST compact{buf_->getBufferStart()};
+  compact.encode(datums[0]);
+  std::vector<uint32_t> image = writeImage(compact);
+  llvm::StringRef source = buf_->getBuffer();
+  ASSERT_TRUE(bool(CompactAST::load(toStringRef(image), source)));
+
+  // Another source.
+  EXPECT_EQ(
+      std::errc::invalid_argument,
+      CompactAST::load(toStringRef(image), source.drop_back()).getError());
+  std::string changed = source.str();
+  changed[1] = 'b';
+  EXPECT_EQ(
+      std::errc::invalid_argument,
+      CompactAST::load(toStringRef(image), changed).getError());
+
+  // Truncated.
+  EXPECT_EQ(
+      std::errc::illegal_byte_sequence,
+      CompactAST::load(toStringRef(image).drop_back(4), source).getError());
+  EXPECT_EQ(
+      std::errc::illegal_byte_sequence,
+      CompactAST::load(toStringRef(image).take_front(8), source).getError());
+
+  // Another version.
+  std::vector<uint32_t> other = image;
+  ++other[1];
+  EXPECT_EQ(
+      std::errc::not_supported,
+      CompactAST::load(toStringRef(other), source).getError());
+
+  // Not an image.
+  other = image;
+  other[0] = 0;
+  EXPECT_EQ(
+      std::errc::illegal_byte_sequence,
+      CompactAST::load(toStringRef(other), source).getError());
+
+  // Corrupted contents.
+  auto loaded = CompactAST::load(toStringRef(image), source);
+  CompactAST::NodeRef list = loaded->getRoots()[0];
+  CompactAST::NodeRef sym = loaded->getCar(list);
+  CompactAST::NodeRef str = loaded->getCar(loaded->getCdr(list));
+  const uint32_t numWords = image[4], numRoots = image[5];
+  const uint32_t numStrings = image[6];
+  ASSERT_EQ(2, numStrings);
+  // The words start after the header, and the string offsets after the roots.
+  const size_t words = 9, offsets = words + numWords + numRoots;
+  auto expectMalformed = [&](size_t index, uint32_t value) {
+    std::vector<uint32_t> other = image;
+    other[index] = value;
+    EXPECT_EQ(
+        std::errc::illegal_byte_sequence,
+        CompactAST::load(toStringRef(other), source).getError())
+        << "word " << index << " = " << value;
+  };
+  // An unknown kind.
+  expectMalformed(words + list, image[words + list] | 0xFF);
+  // References outside the nodes, or into the middle of a node.
+  expectMalformed(words + list + 3, numWords);
+  expectMalformed(words + list + 3, sym + 1);
+  // A string index out of range.
+  expectMalformed(words + str + 3, numStrings);
+  // A range outside the source.
+  expectMalformed(words + list + 2, (uint32_t)source.size() + 1);
+  expectMalformed(words + list + 1, (uint32_t)source.size() + 1);
+  // String offsets which do not increase, or past the strings.
+  expectMalformed(offsets + 1, image[offsets + 2]);
+  expectMalformed(offsets + 1, 0);
+  expectMalformed(offsets + 2, image[offsets + 2] + 4);
+}
+
+} // anonymous namespace
@@ -0,0 +1,120 @@
+#include "s2020/AST/AST.h"
+
+#include "s2020/Parser/DatumParser.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::ast;
+
+namespace {
+
+class HashConsTest : public ::testing::Test {
+ protected:
+  /// Parse \p str, which must be free of errors.
+  std::vector<Node *> parse(const char *str) {
+    auto id = context_.sm.addNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(str, "input", true));
+    buf_ = context_.sm.getSourceBuffer(id);
+    auto parsed = parser::parseDatums(context_, *buf_);
+    EXPECT_TRUE(parsed.hasValue());
+    return parsed ? std::move(*parsed) : std::vector<Node *>{};
+  }
+
+  /// \return element \p n of \p list.
+  static Node *nth(Node *list, unsigned n) {
+    for (; n; --n)
+      list = llvm::cast<PairNode>(list)->getCdr();
+    return llvm::cast<PairNode>(list)->getCar();
+  }
+
+  /// \return the offset of \p node in the last parsed buffer.
+  size_t offset(const Node *node) const {
+    return node->getStartLoc().getPointer() - buf_->getBufferStart();
+  }
+
+ protected:
+  ASTContext context_{};
+  const llvm::MemoryBuffer *buf_ = nullptr;
+};
+
+TEST_F(HashConsTest, HashTest) {
+  auto datums = parse(
+      "(a (b . c) #(1 \"s\") #u8(1 2) #\\x 2.5)"
+      " (a (b . c) #(1 \"s\") #u8(1 2) #\\x 2.5)"
+      " (a (b . c) #(1 \"s\") #u8(1 2) #\\x 2.6)"
+      " #0=(a . #0#) (a . #0=(a . #0#)) #0=(a a . #0#)");
+  EXPECT_TRUE(deepEqual(datums[0], datums[1]));
+  EXPECT_EQ(hashDatum(datums[0]), hashDatum(datums[1]));
+  EXPECT_NE(hashDatum(datums[0]), hashDatum(datums[2]));
+
+  // Cyclic datums which unfold to the same infinite list.
+  for (unsigned i = 4; i != 6; ++i) {
+    EXPECT_TRUE(deepEqual(datums[3], datums[i]));
+    EXPECT_EQ(hashDatum(datums[3]), hashDatum(datums[i])) << "datum " << i;
+  }
+}
+
+TEST_F(HashConsTest, DisabledTest) {
+  auto datums = parse("(a b) (a b)");
+  EXPECT_NE(datums[0], datums[1]);
+  EXPECT_EQ(0u, datums[0]->getInternedHash());
+}
+
+TEST_F(HashConsTest, InternTest) {
+  context_.setHashConsing(true);
+  auto datums = parse(
+      "(define (f x) (+ x 1.5 #(x \"s\" #u8(1)) 'a))"
+      " [define (f x) (+ x 1.5 #(x \"s\" #u8(1)) (quote a))]"
+      " (a b . c) (a . (b . c)) () ()");
+  EXPECT_EQ(datums[0], datums[1]);
+  EXPECT_EQ(datums[2], datums[3]);
+  EXPECT_EQ(datums[4], datums[5]);
+  EXPECT_EQ(context_.getSharedNodes().null, datums[4]);
+  // The location is that of the first one.
+  EXPECT_EQ(0u, offset(datums[1]));
+
+  // The parts are interned too.
+  Node *fx = nth(datums[0], 1);
+  Node *body = nth(datums[0], 2);
+  EXPECT_EQ(nth(fx, 1), nth(body, 1));
+  EXPECT_EQ(nth(fx, 1), llvm::cast<VectorNode>(nth(body, 3))->getElement(0));
+
+  for (Node *node : datums) {
+    EXPECT_NE(0u, node->getInternedHash());
+    EXPECT_EQ(hashDatum(node), node->getInternedHash());
+  }
+
+  // Only the first pair of a list is interned, not the rest of it.
+  Node *rest = llvm::cast<PairNode>(datums[0])->getCdr();
+  EXPECT_EQ(0u, rest->getInternedHash());
+  EXPECT_EQ(0u, llvm::cast<PairNode>(fx)->getCdr()->getInternedHash());
+}
+
+TEST_F(HashConsTest, CyclicTest) {
+  // Datums with labels are only interned if they have no references to
+  // labels which are still being defined.
+  context_.setHashConsing(true);
+  auto datums = parse("#0=(a . #0#) #0=(a . #0#) (#0=(b) #0#) ((b) (b))");
+  EXPECT_NE(datums[0], datums[1]);
+  EXPECT_TRUE(deepEqual(datums[0], datums[1]));
+  EXPECT_EQ(hashDatum(datums[0]), hashDatum(datums[1]));
+  EXPECT_EQ(datums[2], datums[3]);
+}
+
+TEST_F(HashConsTest, RewindTest) {
+  // The datums which are freed are no longer interned.
+  context_.setHashConsing(true);
+  auto datums = parse("#;(a (b)) (a (b)) (#;c d) (c d)");
+  EXPECT_EQ(10u, offset(datums[0]));
+  EXPECT_EQ(11u, offset(nth(datums[0], 0)));
+  EXPECT_EQ(27u, offset(nth(datums[2], 0)));
+
+  context_.freeNodes();
+  datums = parse("(a (b)) (quote x)");
+  EXPECT_EQ(0u, offset(datums[0]));
+  // The shared nodes stay interned.
+  EXPECT_EQ(context_.getSharedNodes().quote, nth(datums[1], 0));
+}
+
+} // anonymous namespace
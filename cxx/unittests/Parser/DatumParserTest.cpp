@@ -1,15 +1,26 @@
 #include "s2020/Parser/DatumParser.h"
 
+#include "s2020/Parser/TokenStream.h"
+
 #include "DiagContext.h"
 
 #include <gtest/gtest.h>
 
+#include <set>
+
 using namespace s2020;
 using namespace s2020::parser;
 using namespace s2020::ast;
 
 namespace {
 
+/// \return the element \p index of the list \p node.
+Node *nth(Node *node, unsigned index) {
+  for (; index; --index)
+    node = llvm::cast<PairNode>(node)->getCdr();
+  return llvm::cast<PairNode>(node)->getCar();
+}
+
 class DatumParserTest : public ::testing::Test {
  protected:
   const llvm::MemoryBuffer &makeBuf(const char *str) {
@@ -37,7 +48,9 @@ TEST_F(DatumParserTest, PrintTest) {
               " (a . b)"
               " (1 2 3 . 4)"
               " (10 . (20 . (30 . ())))"
-              " (if [> a 10] (display 1) (display a))"));
+              " (if [> a 10] (display 1) (display a))"
+              " (\"str\" \"a\\nb\")"
+              " (#\\a #\\space #\\x3bb)"));
   ASSERT_TRUE(res.hasValue());
 
   std::string str;
@@ -65,7 +78,12 @@ TEST_F(DatumParserTest, PrintTest) {
       "    (display\n"
       "        1)\n"
       "    (display\n"
-      "        a))\n",
+      "        a))\n"
+      "(\"str\"\n"
+      "    \"a\\nb\")\n"
+      "(#\\a\n"
+      "    #\\space\n"
+      "    #\\x3bb)\n",
       str);
 }
 
@@ -103,4 +121,531 @@ TEST_F(DatumParserTest, SmokeTest) {
   ASSERT_TRUE(deepEqual(parsed.getValue().at(0), l));
 }
 
+TEST_F(DatumParserTest, CdrCodingTest) {
+  const char *src = "(a b c) [a b . c]";
+  auto parsed = parseDatums(context_, makeBuf(src));
+  ASSERT_TRUE(parsed.hasValue());
+  const auto &datums = parsed.getValue();
+  ASSERT_EQ(2, datums.size());
+
+  // The pairs of a list are allocated together, followed by the empty list,
+  // and their cdrs are implied.
+  auto *pair = llvm::cast<PairNode>(datums[0]);
+  for (unsigned i = 0; i != 3; ++i) {
+    EXPECT_TRUE(pair->isCdrCoded());
+    EXPECT_EQ(reinterpret_cast<Node *>(pair + 1), pair->getCdr());
+    EXPECT_EQ(src + (i ? 1 + 2 * i : 0), pair->getStartLoc().getPointer());
+    EXPECT_EQ(src + 7, pair->getEndLoc().getPointer());
+    if (i != 2)
+      pair = llvm::cast<PairNode>(pair->getCdr());
+  }
+  ASSERT_TRUE(llvm::isa<NullNode>(pair->getCdr()));
+  EXPECT_EQ(src + 6, pair->getCdr()->getStartLoc().getPointer());
+
+  // The last pair of a dotted list stores its cdr, which can be changed.
+  pair = llvm::cast<PairNode>(datums[1]);
+  EXPECT_TRUE(pair->isCdrCoded());
+  pair = llvm::cast<PairNode>(pair->getCdr());
+  EXPECT_FALSE(pair->isCdrCoded());
+  pair->setCdr(Sym("d"));
+  EXPECT_TRUE(deepEqual(
+      datums[1],
+      cons(context_, Sym("a"), cons(context_, Sym("b"), Sym("d")))));
+
+  // And so do pairs made one at a time.
+  EXPECT_FALSE(cons(context_, Sym("a"), Sym("b"))->isCdrCoded());
+
+  // Cycles through the stored cdr are still found when comparing.
+  pair->setCdr(datums[1]);
+  auto cyclic = parseDatums(context_, makeBuf("#0=(a b a b . #0#)"));
+  ASSERT_TRUE(cyclic.hasValue());
+  EXPECT_TRUE(deepEqual(datums[1], cyclic->at(0)));
+  EXPECT_FALSE(deepEqual(datums[0], cyclic->at(0)));
+}
+
+TEST_F(DatumParserTest, MutateListTest) {
+  auto parsed = parseDatums(context_, makeBuf("(a b c)"));
+  ASSERT_TRUE(parsed.hasValue());
+  Node *list = parsed->at(0);
+
+  // The cars of a parsed list can be changed.
+  auto *pair = llvm::cast<PairNode>(list);
+  pair->setCar(Sym("x"));
+  pair = llvm::cast<PairNode>(pair->getCdr());
+  pair->setCar(Sym("y"));
+  EXPECT_TRUE(deepEqual(
+      list, ast::list(context_, Sym("x"), Sym("y"), Sym("c"))));
+
+  // Its cdrs are implied, so changing them stops instead of overwriting the
+  // next pair.
+  EXPECT_DEATH(pair->setCdr(Sym("d")), "CDR-coded");
+  EXPECT_TRUE(deepEqual(
+      list, ast::list(context_, Sym("x"), Sym("y"), Sym("c"))));
+}
+
+TEST_F(DatumParserTest, VectorTest) {
+  auto parsed = parseDatums(
+      context_,
+      makeBuf("#(1 a #(b) (c . d) #;e) #() #u8(0 #;1 7 255) #u8()"
+              " (x #(y) . #u8(2))"));
+  ASSERT_TRUE(parsed.hasValue());
+  const auto &datums = parsed.getValue();
+  ASSERT_EQ(5, datums.size());
+
+  auto *vec = llvm::dyn_cast<VectorNode>(datums[0]);
+  ASSERT_TRUE(vec);
+  ASSERT_EQ(4, vec->size());
+  EXPECT_TRUE(deepEqual(vec->getElement(0), Num(1)));
+  EXPECT_TRUE(deepEqual(vec->getElement(1), Sym("a")));
+  EXPECT_TRUE(deepEqual(
+      vec->getElement(2), VectorNode::create(context_, {Sym("b")})));
+  EXPECT_TRUE(
+      deepEqual(vec->getElement(3), cons(context_, Sym("c"), Sym("d"))));
+  EXPECT_EQ(
+      datums[0]->getStartLoc().getPointer() + 23,
+      datums[0]->getEndLoc().getPointer());
+
+  EXPECT_EQ(0, llvm::cast<VectorNode>(datums[1])->size());
+
+  auto *bytes = llvm::dyn_cast<BytevectorNode>(datums[2]);
+  ASSERT_TRUE(bytes);
+  EXPECT_EQ(std::vector<uint8_t>({0, 7, 255}), bytes->getBytes().vec());
+  EXPECT_EQ(0, llvm::cast<BytevectorNode>(datums[3])->size());
+
+  // Vectors compare by their elements.
+  EXPECT_TRUE(deepEqual(datums[0], datums[0]));
+  EXPECT_FALSE(deepEqual(datums[0], datums[1]));
+  EXPECT_FALSE(deepEqual(datums[2], datums[3]));
+  uint8_t two = 2;
+  EXPECT_TRUE(deepEqual(
+      datums[4],
+      cons(
+          context_,
+          Sym("x"),
+          cons(
+              context_,
+              VectorNode::create(context_, {Sym("y")}),
+              BytevectorNode::create(context_, two)))));
+
+  std::string str;
+  llvm::raw_string_ostream OS{str};
+  for (const auto *node : datums)
+    dump(OS, node);
+  OS.flush();
+  ASSERT_EQ(
+      "#(1\n"
+      "    a\n"
+      "    #(b)\n"
+      "    (c . d))\n"
+      "#()\n"
+      "#u8(0 7 255)\n"
+      "#u8()\n"
+      "(x\n"
+      "    #(y) . #u8(2))\n",
+      str);
+}
+
+TEST_F(DatumParserTest, AbbreviationTest) {
+  auto parsed = parseDatums(
+      context_, makeBuf("'a `(b ,c ,@d) '#;x y #(',z) ''a (a . 'b)"));
+  ASSERT_TRUE(parsed.hasValue());
+  const auto &datums = parsed.getValue();
+  ASSERT_EQ(6, datums.size());
+
+  auto Q = [this](const char *name, Node *datum) {
+    return list(context_, Sym(name), datum);
+  };
+  EXPECT_TRUE(deepEqual(datums[0], Q("quote", Sym("a"))));
+  EXPECT_TRUE(deepEqual(
+      datums[1],
+      Q("quasiquote",
+        list(
+            context_,
+            Sym("b"),
+            Q("unquote", Sym("c")),
+            Q("unquote-splicing", Sym("d"))))));
+  EXPECT_TRUE(deepEqual(datums[2], Q("quote", Sym("y"))));
+  EXPECT_TRUE(deepEqual(
+      datums[3],
+      VectorNode::create(context_, {Q("quote", Q("unquote", Sym("z")))})));
+  EXPECT_TRUE(deepEqual(datums[4], Q("quote", Q("quote", Sym("a")))));
+  EXPECT_TRUE(
+      deepEqual(datums[5], cons(context_, Sym("a"), Q("quote", Sym("b")))));
+
+  // The symbol and the end of the list are shared.
+  auto *pair = llvm::cast<PairNode>(datums[0]);
+  EXPECT_EQ(context_.getSharedNodes().quote, pair->getCar());
+  EXPECT_EQ(
+      context_.getSharedNodes().null,
+      llvm::cast<PairNode>(pair->getCdr())->getCdr());
+  // The list covers the abbreviation and the datum.
+  EXPECT_EQ(
+      datums[0]->getStartLoc().getPointer() + 2,
+      datums[0]->getEndLoc().getPointer());
+
+  std::string str;
+  llvm::raw_string_ostream OS{str};
+  dump(OS, datums[1]);
+  OS.flush();
+  ASSERT_EQ(
+      "(quasiquote\n"
+      "    (b\n"
+      "        (unquote\n"
+      "            c)\n"
+      "        (unquote-splicing\n"
+      "            d)))\n",
+      str);
+}
+
+TEST_F(DatumParserTest, DatumLabelTest) {
+  auto parsed = parseDatums(
+      context_,
+      makeBuf("(#0=(a b) #0#) #0=(a . #0#) #1=#(x #1#) #0=(#0# . #0#)"
+              " #0=(a a . #0#) (#0=x #;#1=y '#0#)"));
+  ASSERT_TRUE(parsed.hasValue());
+  const auto &datums = parsed.getValue();
+  ASSERT_EQ(6, datums.size());
+
+  // Shared.
+  auto *pair = llvm::cast<PairNode>(datums[0]);
+  EXPECT_EQ(pair->getCar(), nth(pair, 1));
+  EXPECT_TRUE(deepEqual(
+      datums[0],
+      list(
+          context_,
+          list(context_, Sym("a"), Sym("b")),
+          list(context_, Sym("a"), Sym("b")))));
+
+  // Cyclic through the cdr, a vector element and the car.
+  pair = llvm::cast<PairNode>(datums[1]);
+  EXPECT_EQ(pair, pair->getCdr());
+  auto *vec = llvm::cast<VectorNode>(datums[2]);
+  EXPECT_EQ(vec, vec->getElement(1));
+  pair = llvm::cast<PairNode>(datums[3]);
+  EXPECT_EQ(pair, pair->getCar());
+  EXPECT_EQ(pair, pair->getCdr());
+
+  // Cyclic data is equal if it unfolds to the same infinite tree.
+  EXPECT_TRUE(deepEqual(datums[1], datums[4]));
+  EXPECT_FALSE(deepEqual(datums[1], datums[3]));
+  EXPECT_TRUE(deepEqual(
+      datums[5],
+      list(context_, Sym("x"), list(context_, Sym("quote"), Sym("x")))));
+
+  std::string str;
+  llvm::raw_string_ostream OS{str};
+  for (const auto *node : datums)
+    dump(OS, node);
+  OS.flush();
+  ASSERT_EQ(
+      "(#0=(a\n"
+      "        b)\n"
+      "    #0#)\n"
+      "#0=(a . #0#)\n"
+      "#0=#(x\n"
+      "    #0#)\n"
+      "#0=(#0# . #0#)\n"
+      "#0=(a\n"
+      "    a . #0#)\n"
+      "(x\n"
+      "    (quote\n"
+      "        x))\n",
+      str);
+}
+
+TEST_F(DatumParserTest, SharedStructureTest) {
+  // Every level refers to the previous one twice, so the tree has 2^kDepth
+  // leaves, but the graph is linear.
+  static const unsigned kDepth = 200;
+  std::string str = "#0=(leaf)";
+  for (unsigned i = 1; i != kDepth; ++i) {
+    str = "#" + std::to_string(i) + "=(" + str + " #" + std::to_string(i - 1) +
+        "#)";
+  }
+  auto a = parseDatums(context_, makeBuf(str.c_str()));
+  auto b = parseDatums(context_, makeBuf(str.c_str()));
+  ASSERT_TRUE(a.hasValue() && b.hasValue());
+  EXPECT_TRUE(deepEqual(a->front(), b->front()));
+
+  std::string dumped;
+  llvm::raw_string_ostream OS{dumped};
+  dump(OS, a->front());
+  OS.flush();
+  // Only the indentation grows faster than the graph.
+  EXPECT_LT(dumped.size(), 4 * kDepth * kDepth);
+  EXPECT_TRUE(deepEqual(
+      parseDatums(context_, makeBuf(dumped.c_str()))->front(), a->front()));
+}
+
+TEST_F(DatumParserTest, DatumCommentTest) {
+  auto parsed = parseDatums(
+      context_,
+      makeBuf("#;skipped (#;a) (a #;b) (a #;(b #;c d) . #;e f #;g) #;#;h i"));
+  ASSERT_TRUE(parsed.hasValue());
+  ASSERT_EQ(3, parsed.getValue().size());
+
+  ASSERT_TRUE(deepEqual(parsed.getValue()[0], new (context_) NullNode()));
+  ASSERT_TRUE(deepEqual(parsed.getValue()[1], list(context_, Sym("a"))));
+  ASSERT_TRUE(
+      deepEqual(parsed.getValue()[2], cons(context_, Sym("a"), Sym("f"))));
+}
+
+TEST_F(DatumParserTest, ReleaseMemoryTest) {
+  // The nodes of a datum comment are freed as soon as it ends.
+  Num(0);
+  auto cp0 = context_.checkpoint();
+  ASSERT_TRUE(parseDatums(context_, makeBuf("(x y)")).hasValue());
+  auto cp1 = context_.checkpoint();
+  ASSERT_TRUE(parseDatums(context_, makeBuf("(x #;(a (b) c) y)")).hasValue());
+  auto cp2 = context_.checkpoint();
+  EXPECT_EQ(cp1.nodes.cur - cp0.nodes.cur, cp2.nodes.cur - cp1.nodes.cur);
+
+  // Everything allocated by a failed parse is freed, including new strings.
+  DiagContext diag{context_.sm};
+  EXPECT_FALSE(parseDatums(context_, makeBuf("(x (new-symbol \"str\") ]")));
+  auto cp3 = context_.checkpoint();
+  EXPECT_EQ(cp2.nodes.cur, cp3.nodes.cur);
+  EXPECT_EQ(cp2.strings.cur, cp3.strings.cur);
+  EXPECT_EQ(cp2.numStrings, cp3.numStrings);
+}
+
+TEST_F(DatumParserTest, ErrorTest) {
+  std::vector<std::string> errors{};
+  context_.sm.setDiagHandler(
+      [](const llvm::SMDiagnostic &msg, void *ctx) {
+        if (msg.getKind() == llvm::SourceMgr::DK_Error) {
+          static_cast<std::vector<std::string> *>(ctx)->push_back(
+              msg.getMessage().str());
+        }
+      },
+      &errors);
+
+  // Check that parsing \p str fails with exactly \p expected errors.
+  auto check = [this, &errors](
+                   const char *str, std::vector<std::string> expected) {
+    EXPECT_FALSE(parseDatums(context_, makeBuf(str)).hasValue()) << str;
+    EXPECT_EQ(expected, errors) << str;
+    errors.clear();
+  };
+
+  check(")", {"unexpected token"});
+  check("(a ]", {"unexpected token", "unterminated list"});
+  check("(a . b c)", {"list terminator expected"});
+  check("(. a)", {"unexpected token"});
+  check("(a . )", {"unexpected token", "unterminated list"});
+  check("(a . b . c)", {"list terminator expected", "unexpected token"});
+  check("(a (b (c) d)", {"unterminated list"});
+  check("(a . b", {"unterminated list"});
+  check("'", {"datum expected"});
+  check("(a ')", {"unexpected token", "datum expected"});
+  check("'#;a", {"datum expected"});
+  check("#0# #0=a", {"undefined datum label"});
+  check("#0=a #0#", {"undefined datum label"});
+  check("(#;#0=a #0#)", {"undefined datum label"});
+  check("(#0=a #0=b)", {"datum label is already defined"});
+  check("(#0=#0#)", {"datum label refers to itself"});
+  check("#0=", {"datum expected"});
+  check("#(a . b)", {"unexpected token"});
+  check("#(a", {"unterminated vector"});
+  check(
+      "#u8(1 256 -1 1.0 a (2) 3",
+      {"invalid byte value",
+       "invalid byte value",
+       "invalid byte value",
+       "byte value expected",
+       "byte value expected",
+       "unterminated bytevector"});
+}
+
+TEST_F(DatumParserTest, DeepNestingTest) {
+  static const unsigned kDepth = 200000;
+  std::string str(kDepth, '(');
+  str += "leaf";
+  str.append(kDepth, ')');
+  str += " (";
+  for (unsigned i = 0; i != kDepth; ++i)
+    str += "a . (";
+  str += ")";
+  str.append(kDepth, ')');
+
+  const llvm::MemoryBuffer &buf = makeBuf(str.c_str());
+  auto checkParsed = [](const std::vector<Node *> &datums) {
+    ASSERT_EQ(2, datums.size());
+
+    // Nested in the car.
+    const Node *node = datums[0];
+    for (unsigned i = 0; i != kDepth; ++i) {
+      auto *pair = llvm::dyn_cast<PairNode>(node);
+      ASSERT_TRUE(pair) << "depth " << i;
+      ASSERT_TRUE(llvm::isa<NullNode>(pair->getCdr())) << "depth " << i;
+      node = pair->getCar();
+    }
+    ASSERT_TRUE(llvm::isa<SymbolNode>(node));
+
+    // Nested in the cdr.
+    node = datums[1];
+    for (unsigned i = 0; i != kDepth; ++i) {
+      auto *pair = llvm::dyn_cast<PairNode>(node);
+      ASSERT_TRUE(pair) << "depth " << i;
+      node = pair->getCdr();
+    }
+    ASSERT_TRUE(llvm::isa<NullNode>(node));
+  };
+
+  auto parsed = parseDatums(context_, buf);
+  ASSERT_TRUE(parsed.hasValue());
+  checkParsed(parsed.getValue());
+
+  auto stream = tokenizeAll(context_, buf);
+  parsed = parseDatums(context_, stream);
+  ASSERT_TRUE(parsed.hasValue());
+  checkParsed(parsed.getValue());
+
+  // Unterminated, which is only reported once.
+  DiagContext diag{context_.sm};
+  str.resize(str.size() - 1);
+  EXPECT_FALSE(parseDatums(context_, makeBuf(str.c_str())).hasValue());
+  EXPECT_EQ(1, diag.getErrCount());
+}
+
+TEST_F(DatumParserTest, DeepEqualAndDumpTest) {
+  // Neither recurses, on the car or on the cdr.
+  static const unsigned kDepth = 200000;
+  static const unsigned kLength = 1000000;
+  std::string str(kDepth, '(');
+  str += "leaf";
+  str.append(kDepth, ')');
+  str += " (";
+  for (unsigned i = 0; i != kLength; ++i)
+    str += "a ";
+  str += ")";
+
+  auto a = parseDatums(context_, makeBuf(str.c_str()));
+  auto b = parseDatums(context_, makeBuf(str.c_str()));
+  ASSERT_TRUE(a.hasValue() && b.hasValue());
+  EXPECT_TRUE(deepEqual((*a)[0], (*b)[0]));
+  EXPECT_TRUE(deepEqual((*a)[1], (*b)[1]));
+
+  // A list whose cdrs are all stored, like the ones built at run time.
+  Node *consed = new (context_) NullNode();
+  for (unsigned i = 0; i != kLength; ++i)
+    consed = cons(context_, Sym("a"), consed);
+  EXPECT_TRUE(deepEqual((*a)[1], consed));
+  EXPECT_TRUE(deepEqual(consed, (*a)[1]));
+  llvm::cast<PairNode>(consed)->setCar(Sym("b"));
+  EXPECT_FALSE(deepEqual((*a)[1], consed));
+
+  for (Node *node : {(*a)[0], (*a)[1], consed}) {
+    std::string dumped;
+    llvm::raw_string_ostream OS{dumped};
+    dump(OS, node);
+    OS.flush();
+    auto parsed = parseDatums(context_, makeBuf(dumped.c_str()));
+    ASSERT_TRUE(parsed.hasValue());
+    EXPECT_TRUE(deepEqual(parsed->front(), node));
+  }
+}
+
+TEST_F(DatumParserTest, ReaderTest) {
+  const auto &buf = makeBuf("a (b . c) #;d [e f] 10");
+  auto all = parseDatums(context_, buf);
+  ASSERT_TRUE(all.hasValue());
+  ASSERT_EQ(4, all.getValue().size());
+
+  auto check = [&all](DatumReader &reader) {
+    for (auto *expected : all.getValue()) {
+      auto *datum = reader.next();
+      ASSERT_TRUE(datum);
+      ASSERT_TRUE(deepEqual(expected, datum));
+    }
+    ASSERT_EQ(nullptr, reader.next());
+    ASSERT_EQ(nullptr, reader.next());
+    ASSERT_FALSE(reader.hasErrors());
+  };
+
+  DatumReader lexerReader{context_, buf};
+  check(lexerReader);
+
+  auto stream = tokenizeAll(context_, buf);
+  DatumReader streamReader{context_, stream};
+  check(streamReader);
+}
+
+TEST_F(DatumParserTest, ReaderErrorTest) {
+  DiagContext diag{context_.sm};
+  DatumReader reader{context_, makeBuf("a ) b (c")};
+  // Reading continues after an error.
+  ASSERT_TRUE(reader.next());
+  EXPECT_FALSE(reader.hasErrors());
+  ASSERT_TRUE(reader.next());
+  EXPECT_TRUE(reader.hasErrors());
+  EXPECT_EQ(nullptr, reader.next());
+  EXPECT_EQ(2, diag.getErrCount());
+}
+
+TEST_F(DatumParserTest, ReadDatumsTest) {
+  std::string str;
+  for (unsigned i = 0; i != 10000; ++i)
+    str += "(record " + std::to_string(i) + " \"name\" (a b c))\n";
+  const auto &buf = makeBuf(str.c_str());
+
+  // Freeing the nodes after each datum reuses the same memory for all of
+  // them.
+  unsigned count = 0;
+  std::set<Node *> datums{};
+  EXPECT_TRUE(readDatums(
+      context_,
+      buf,
+      [this, &count, &datums](Node *datum) {
+        EXPECT_TRUE(deepEqual(
+            list(context_, Sym("a"), Sym("b"), Sym("c")),
+            nth(datum, 3)));
+        datums.insert(datum);
+        ++count;
+        return true;
+      },
+      true));
+  EXPECT_EQ(10000, count);
+  EXPECT_EQ(1, datums.size());
+
+  // The strings of every datum are freed too, so distinct symbols and strings
+  // don't accumulate.
+  str.clear();
+  for (unsigned i = 0; i != 10000; ++i) {
+    str += "(record id-" + std::to_string(i) + " \"msg\\t" +
+        std::to_string(i) + "\")\n";
+  }
+  size_t numStrings = context_.stringTable.size();
+  auto strings = context_.stringArena.checkpoint();
+  count = 0;
+  EXPECT_TRUE(readDatums(
+      context_,
+      makeBuf(str.c_str()),
+      [&count](Node *datum) {
+        EXPECT_EQ(
+            "id-" + std::to_string(count),
+            llvm::cast<SymbolNode>(nth(datum, 1))->getValue().str());
+        EXPECT_EQ(
+            "msg\t" + std::to_string(count),
+            llvm::cast<StringNode>(nth(datum, 2))->getValue().str());
+        ++count;
+        return true;
+      },
+      true));
+  EXPECT_EQ(10000, count);
+  EXPECT_GE(numStrings + 5, context_.stringTable.size());
+  EXPECT_EQ(strings.numSlabs, context_.stringArena.checkpoint().numSlabs);
+
+  // Stopping early.
+  count = 0;
+  EXPECT_TRUE(readDatums(context_, buf, [&count](Node *) {
+    return ++count != 10;
+  }));
+  EXPECT_EQ(10, count);
+
+  DiagContext diag{context_.sm};
+  EXPECT_FALSE(readDatums(
+      context_, makeBuf("a ) b"), [](Node *) { return true; }));
+}
+
 } // anonymous namespace
\ No newline at end of file
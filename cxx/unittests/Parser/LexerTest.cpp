@@ -1,9 +1,12 @@
 #include "s2020/Parser/Lexer.h"
+#include "s2020/Parser/SIMDScan.h"
 
 #include "DiagContext.h"
 
 #include <gtest/gtest.h>
 
+#include <cmath>
+
 using namespace s2020;
 using namespace s2020::parser;
 
@@ -120,6 +123,467 @@ TEST_F(LexerTest, BadDecimalNumberTest) {
   ASSERT_EQ(0, diag.getErrCount());
 }
 
+TEST_F(LexerTest, NumberRangeTest) {
+  Lexer lex{context_,
+            makeBuf(
+                "18446744073709551615 -9223372036854775808 "
+                "0000000000000000000000000042 18446744073709551617 "
+                "0.1 -123456789012345678901234567890.5 2.5e-400 1e400")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(-1));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(INT64_MIN));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(42));
+  ASSERT_EQ(0, diag.getErrCount());
+
+  // On overflow the low 64 bits are kept.
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(1));
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("number overflows exact range", diag.getMessage());
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(0.1));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(-1.2345678901234568e29));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(0));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(HUGE_VAL));
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, CompensatedExponentTest) {
+  // Exponents beyond any double, compensated by the number of digits.
+  std::string zeros(1000000, '0');
+  std::string src = "0." + zeros + "1e1000005 #e0." + zeros + "1e1000005 #e1" +
+      zeros + "e-1000000";
+  Lexer lex{context_, makeBuf(src.c_str())};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(1e4));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(10000));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(1));
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, NumberPrefixTest) {
+  Lexer lex{context_,
+            makeBuf(
+                "#x1F #XfF #b-101 #o777 #d10 #e10 #i10 #x#e-10 #e#x10 #i#b11 "
+                "#e1.5e1 #e-1e3 #E120e-1 #i.5 #d.25 #xFFFFFFFFFFFFFFFF")};
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(0x1F));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(0xFF));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(-5));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(0777));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(10));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(10));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(10));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(-16));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(16));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(3));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(15));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(-1000));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(12));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(0.5));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().inexactEquals(0.25));
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(-1));
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, BadNumberPrefixTest) {
+  Lexer lex{context_,
+            makeBuf("#x#x1 #e#i1 #b2 #x #e1.5 #e1e30 #o-8 #x10(")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::number, lex.token.getKind());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid number prefix", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid number prefix", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid number: digit expected", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid number: digit expected", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("real number cannot be represented as exact", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("real number cannot be represented as exact", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid number: digit expected", diag.getMessage());
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(16));
+  lex.advance();
+  ASSERT_EQ(TokenKind::l_paren, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, VectorTest) {
+  Lexer lex{context_, makeBuf("#(a) #u8(1) #u8 x #u8")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::l_vector, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(TokenKind::identifier, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(TokenKind::r_paren, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(TokenKind::l_bytevector, lex.token.getKind());
+  ASSERT_EQ(
+      lex.token.getStartLoc().getPointer() + 4,
+      lex.token.getEndLoc().getPointer());
+  lex.advance();
+  ASSERT_EQ(TokenKind::number, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(TokenKind::r_paren, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+
+  // "#u8" without a parenthesis, also at the end of the input.
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid token", diag.getMessage());
+  ASSERT_EQ(TokenKind::identifier, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+}
+
+TEST_F(LexerTest, DatumLabelTest) {
+  Lexer lex{context_, makeBuf("#0= #12#(#3 #99999999999= #2147483647#")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::label_def, lex.token.getKind());
+  ASSERT_EQ(0, lex.token.getLabel());
+  lex.advance();
+  ASSERT_EQ(TokenKind::label_ref, lex.token.getKind());
+  ASSERT_EQ(12, lex.token.getLabel());
+  lex.advance();
+  ASSERT_EQ(TokenKind::l_paren, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+
+  // "#3" is an invalid token, and the next label is too large.
+  lex.advance();
+  ASSERT_EQ(TokenKind::label_def, lex.token.getKind());
+  ASSERT_EQ(2, diag.getErrCountClear());
+  ASSERT_EQ("datum label is too large", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::label_ref, lex.token.getKind());
+  ASSERT_EQ(2147483647, lex.token.getLabel());
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, BlockCommentTest) {
+  Lexer lex{context_,
+            makeBuf(
+                "1 #| simple |# 2 #|#|#||##|nested|#|#|# 3 #||# 4"
+                " #| | # #a|b #; |# 5 #|x|# 6 #|\n (7) \n|#")};
+
+  for (int i = 1; i <= 6; ++i) {
+    lex.advance();
+    ASSERT_EQ(TokenKind::number, lex.token.getKind());
+    ASSERT_TRUE(lex.token.getNumber().exactEquals(i));
+  }
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, LongBlockCommentTest) {
+  // Comment delimiters at every position relative to the vector width,
+  // separated by lone '#' and '|' characters.
+  std::string input;
+  for (unsigned len = 0; len < 70; ++len) {
+    std::string filler = "a";
+    for (unsigned i = 0; i != len; ++i)
+      filler += i & 1 ? "|a" : "#a";
+    input += "#|" + filler + "#|" + filler + "|#" + filler + "|#";
+    input += std::to_string(len);
+    input += ' ';
+  }
+
+  ScanISA saved = getScanISA();
+  for (unsigned i = 0; i <= (unsigned)getBestScanISA(); ++i) {
+    setScanISA((ScanISA)i);
+    Lexer lex{context_, makeBuf(input.c_str())};
+    for (unsigned len = 0; len < 70; ++len) {
+      lex.advance();
+      ASSERT_EQ(TokenKind::number, lex.token.getKind())
+          << scanISAName((ScanISA)i);
+      ASSERT_TRUE(lex.token.getNumber().exactEquals(len));
+    }
+    lex.advance();
+    ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  }
+  setScanISA(saved);
+
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, UnterminatedBlockCommentTest) {
+  Lexer lex{context_, makeBuf("1 #| #| |# 2")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(1));
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("unterminated block comment", diag.getMessage());
+}
+
+TEST_F(LexerTest, CharacterTest) {
+  Lexer lex{context_,
+            makeBuf(
+                "#\\a #\\x #\\X #\\( #\\) #\\  #\\; #\\newline #\\space #\\delete"
+                " #\\x41 #\\x3bb #\\X1F600 #\\\xCE\xBB #\\null(#\\a)#\\tab")};
+
+  static const char32_t expected[] = {
+      'a', 'x', 'X', '(', ')', ' ', ';', '\n', ' ', 0x7f, 0x41, 0x3bb,
+      0x1F600, 0x3bb, 0};
+
+  for (char32_t ch : expected) {
+    lex.advance();
+    ASSERT_EQ(TokenKind::character, lex.token.getKind());
+    ASSERT_EQ(ch, lex.token.getCharacter());
+  }
+  lex.advance();
+  ASSERT_EQ(TokenKind::l_paren, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ('a', lex.token.getCharacter());
+  lex.advance();
+  ASSERT_EQ(TokenKind::r_paren, lex.token.getKind());
+  lex.advance();
+  ASSERT_EQ('\t', lex.token.getCharacter());
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, BadCharacterTest) {
+  Lexer lex{context_, makeBuf("#\\foo #\\Newline #\\xD800 #\\x110000 #\\")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::character, lex.token.getKind());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid character name", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid character name", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid Unicode scalar value", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid Unicode scalar value", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::character, lex.token.getKind());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("character expected", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, StringTest) {
+  Lexer lex{context_,
+            makeBuf(
+                "\"\" \"hello\" \"a\\tb\\\\c\\\"d\\|\" \"\\x41;\\x3bb;\\x1F600;\""
+                " \"multi\nline\" \"con\\   \n   tinued\" \"hello\"")};
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::string, lex.token.getKind());
+  ASSERT_EQ("", lex.token.getString().str());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::string, lex.token.getKind());
+  auto hello = lex.token.getString();
+  ASSERT_EQ("hello", hello.str());
+  ASSERT_EQ("\"hello\"", lex.token.inputStr());
+
+  lex.advance();
+  ASSERT_EQ("a\tb\\c\"d|", lex.token.getString().str());
+  lex.advance();
+  ASSERT_EQ("A\xCE\xBB\xF0\x9F\x98\x80", lex.token.getString().str());
+  lex.advance();
+  ASSERT_EQ("multi\nline", lex.token.getString().str());
+  lex.advance();
+  ASSERT_EQ("continued", lex.token.getString().str());
+
+  // Strings are uniqued.
+  lex.advance();
+  ASSERT_EQ(hello, lex.token.getString());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, LongStringTest) {
+  // Escapes at every position relative to the vector width.
+  std::string input;
+  std::vector<std::string> expected;
+  for (unsigned len = 0; len < 70; ++len) {
+    std::string body(len, 'a' + len % 26);
+    input += '"' + body + "\\n" + body + "\" ";
+    expected.push_back(body + '\n' + body);
+  }
+
+  ScanISA saved = getScanISA();
+  for (unsigned i = 0; i <= (unsigned)getBestScanISA(); ++i) {
+    setScanISA((ScanISA)i);
+    Lexer lex{context_, makeBuf(input.c_str())};
+    for (const auto &str : expected) {
+      lex.advance();
+      ASSERT_EQ(TokenKind::string, lex.token.getKind());
+      ASSERT_EQ(str, lex.token.getString().str()) << scanISAName((ScanISA)i);
+    }
+    lex.advance();
+    ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  }
+  setScanISA(saved);
+
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, RepeatedEscapedStringTest) {
+  // Decoding a string that is already interned allocates nothing.
+  std::string input;
+  for (unsigned i = 0; i < 1000; ++i)
+    input += "\"a\\tb\\x41;\" ";
+  Lexer lex{context_, makeBuf(input.c_str())};
+
+  lex.advance();
+  ASSERT_EQ("a\tbA", lex.token.getString().str());
+  auto cp = context_.stringArena.checkpoint();
+  for (unsigned i = 1; i < 1000; ++i) {
+    lex.advance();
+    ASSERT_EQ(TokenKind::string, lex.token.getKind());
+  }
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+
+  auto cp2 = context_.stringArena.checkpoint();
+  EXPECT_EQ(cp.numSlabs, cp2.numSlabs);
+  EXPECT_EQ(cp.cur, cp2.cur);
+  EXPECT_EQ(cp.numLarge, cp2.numLarge);
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, BadStringTest) {
+  Lexer lex{context_,
+            makeBuf("\"\\q\" \"\\x41\" \"\\xD800;\" \"\\x110000;\" \"abc")};
+  DiagContext diag{context_.sm};
+
+  lex.advance();
+  ASSERT_EQ("q", lex.token.getString().str());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid escape sequence", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid hex escape", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid Unicode scalar value", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("invalid Unicode scalar value", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::string, lex.token.getKind());
+  ASSERT_EQ("abc", lex.token.getString().str());
+  ASSERT_EQ(1, diag.getErrCountClear());
+  ASSERT_EQ("unterminated string", diag.getMessage());
+
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  ASSERT_EQ(0, diag.getErrCount());
+}
+
+TEST_F(LexerTest, StringErrorLimitTest) {
+  // Reaching the error limit in an escape stops the lexer, in the same string
+  // or in the next one.
+  for (const char *str : {"\"\\q \\q\" a", "\"\\q\" \"\\x;\" a"}) {
+    context_.sm.clearErrorLimitReached();
+    context_.sm.setErrorLimit(1);
+    Lexer lex{context_, makeBuf(str)};
+    DiagContext diag{context_.sm};
+
+    lex.advance();
+    ASSERT_EQ(TokenKind::string, lex.token.getKind());
+    ASSERT_EQ("q", lex.token.getString().str());
+    EXPECT_TRUE(context_.sm.isErrorLimitReached());
+    // The error and "too many errors emitted".
+    EXPECT_EQ(2, diag.getErrCountClear());
+
+    lex.advance();
+    EXPECT_EQ(TokenKind::eof, lex.token.getKind()) << str;
+    EXPECT_EQ(0, diag.getErrCount()) << str;
+  }
+}
+
 TEST_F(LexerTest, LineCommentTest) {
   Lexer lex{context_, makeBuf("1 ; kjh\n 2 ; 3 4 \r\n  5")};
 
@@ -133,4 +597,101 @@ TEST_F(LexerTest, LineCommentTest) {
   ASSERT_EQ(TokenKind::eof, lex.token.getKind());
 }
 
-} // anonymous namespace
\ No newline at end of file
+TEST_F(LexerTest, LineCommentAtEOFTest) {
+  Lexer lex{context_, makeBuf("1 ; no newline")};
+
+  lex.advance();
+  ASSERT_TRUE(lex.token.getNumber().exactEquals(1));
+  lex.advance();
+  ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+}
+
+TEST_F(LexerTest, LongWhitespaceAndCommentTest) {
+  // Runs of all lengths up to several vector widths, so the vectorized
+  // scanners see the end of a run at every possible position in a block.
+  std::string input;
+  for (unsigned len = 0; len < 100; ++len) {
+    input.append(len, len & 1 ? ' ' : '\t');
+    input += std::to_string(len);
+    input += "\n;";
+    input.append(len, ';');
+    input += len & 1 ? "\n" : "\r\n";
+  }
+  input += "end";
+  input.append(40, ' ');
+
+  ScanISA saved = getScanISA();
+  for (unsigned i = 0; i <= (unsigned)getBestScanISA(); ++i) {
+    ASSERT_EQ((ScanISA)i, setScanISA((ScanISA)i));
+
+    Lexer lex{context_, makeBuf(input.c_str())};
+    for (unsigned len = 0; len < 100; ++len) {
+      lex.advance();
+      ASSERT_EQ(TokenKind::number, lex.token.getKind())
+          << scanISAName((ScanISA)i);
+      ASSERT_TRUE(lex.token.getNumber().exactEquals(len))
+          << scanISAName((ScanISA)i);
+    }
+    lex.advance();
+    ASSERT_EQ(TokenKind::identifier, lex.token.getKind());
+    ASSERT_EQ("end", lex.token.getIdentifier().str());
+    lex.advance();
+    ASSERT_EQ(TokenKind::eof, lex.token.getKind());
+  }
+  setScanISA(saved);
+
+  ASSERT_EQ(0, context_.sm.getErrorCount());
+}
+
+TEST_F(LexerTest, IdentifierScanTest) {
+  // Identifiers of all lengths around the vector widths, terminated by every
+  // possible byte value, must be the same with every ISA.
+  static const char alphabet[] = "abz-AZ!$%&*/:<=>?^_~09+.@";
+  DiagContext diag{context_.sm};
+  // Many of the terminators are invalid.
+  context_.sm.setErrorLimit(0);
+
+  std::string input;
+  std::vector<size_t> lengths;
+  for (unsigned term = 1; term != 256; ++term) {
+    // A quote would start a string swallowing the following identifiers.
+    if (term == '"')
+      continue;
+    for (unsigned len = 1; len != 70; len += len < 12 ? 11 : 1) {
+      input += ' ';
+      for (unsigned i = 0; i != len; ++i)
+        input += alphabet[(i * 7 + term) % (sizeof(alphabet) - 1)];
+      // Make sure that the identifier starts with an initial character.
+      input[input.size() - len] = 'x';
+      input += (char)term;
+      input += '\n';
+      lengths.push_back(len);
+    }
+  }
+
+  ScanISA saved = getScanISA();
+  std::vector<std::string> expected{};
+  for (unsigned i = 0; i <= (unsigned)getBestScanISA(); ++i) {
+    ASSERT_EQ((ScanISA)i, setScanISA((ScanISA)i));
+
+    std::vector<std::string> idents{};
+    Lexer lex{context_, makeBuf(input.c_str())};
+    for (;;) {
+      lex.advance();
+      if (lex.token.getKind() == TokenKind::eof)
+        break;
+      if (lex.token.getKind() == TokenKind::identifier)
+        idents.push_back(lex.token.getIdentifier().str().str());
+    }
+
+    if (i == 0) {
+      expected = idents;
+      ASSERT_LE(lengths.size(), expected.size());
+    } else {
+      ASSERT_EQ(expected, idents) << scanISAName((ScanISA)i);
+    }
+  }
+  setScanISA(saved);
+}
+
+} // anonymous namespace
@@ -0,0 +1,187 @@
+#include "s2020/Parser/ParallelLexer.h"
+
+#include "TestHelpers.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::parser;
+
+namespace {
+
+class ParallelLexerTest : public ::testing::Test {
+ protected:
+  const llvm::MemoryBuffer &makeBuf(const std::string &str) {
+    auto id = context_.sm.addNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(str, "input"));
+    return *context_.sm.getSourceBuffer(id);
+  }
+
+  /// Tokenize \p str serially and in parallel and compare the token streams
+  /// and the reported diagnostics.
+  void checkSameAsSerial(const std::string &str, unsigned numThreads);
+
+ protected:
+  ASTContext context_{};
+  DiagRecorder diags_{context_.sm};
+};
+
+void ParallelLexerTest::checkSameAsSerial(
+    const std::string &str,
+    unsigned numThreads) {
+  const auto &buf = makeBuf(str);
+
+  diags_.clear();
+  auto serial = tokenizeAll(context_, buf);
+  auto serialDiags = diags_.take();
+  context_.sm.clearErrorLimitReached();
+
+  auto parallel = tokenizeAllParallel(context_, buf, numThreads);
+  context_.sm.clearErrorLimitReached();
+
+  ASSERT_EQ(serial.hasErrors(), parallel.hasErrors());
+  ASSERT_EQ(serialDiags, diags_.take());
+  ASSERT_EQ(serial.size(), parallel.size());
+  for (uint32_t i = 0; i != serial.size(); ++i) {
+    ASSERT_EQ(serial.getKind(i), parallel.getKind(i)) << "token " << i;
+    ASSERT_EQ(serial.getStartOffset(i), parallel.getStartOffset(i))
+        << "token " << i;
+    ASSERT_EQ(serial.getLength(i), parallel.getLength(i)) << "token " << i;
+    switch (serial.getKind(i)) {
+      case TokenKind::identifier:
+        ASSERT_EQ(serial.getIdentifier(i), parallel.getIdentifier(i));
+        break;
+      case TokenKind::string:
+        ASSERT_EQ(serial.getString(i), parallel.getString(i));
+        break;
+      case TokenKind::number:
+        ASSERT_TRUE(serial.getNumber(i).equals(parallel.getNumber(i)));
+        break;
+      case TokenKind::character:
+        ASSERT_EQ(serial.getCharacter(i), parallel.getCharacter(i));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/// Generate source where strings and block comments span many lines and
+/// contain each other's delimiters, so chunk boundaries often fall inside
+/// them.
+std::string genSource(size_t size, uint64_t seed, bool withErrors) {
+  SeededRandom next{seed};
+  auto lines = [&next](std::string &str, const char *text) {
+    for (unsigned i = 0, e = next(200); i != e; ++i) {
+      str += text;
+      str += '\n';
+    }
+  };
+
+  std::string str;
+  while (str.size() < size) {
+    switch (next(withErrors ? 12 : 10)) {
+      case 0:
+        str += "(define (f x) (+ x 1.5 #xFF)) ";
+        break;
+      case 1:
+        str += "\"";
+        lines(str, "a \\\" |# ; #| (");
+        str += "\" ";
+        break;
+      case 2:
+        str += "#|";
+        lines(str, "\" #| nested |# ; (b");
+        str += "|# ";
+        break;
+      case 3:
+        str += "; line \" comment #|\n";
+        break;
+      case 4:
+        str += "#\\\" #\\| #\\x41 #;(skipped) ";
+        break;
+      case 5:
+        str += "\"esc\\n\\x3bb;\" \"line \\\n   continued\" ";
+        break;
+      case 6:
+        str += "[vector-ref v 10]\n";
+        break;
+      case 7:
+        str += "#|#|deep|# x \"|#\n";
+        break;
+      case 8:
+        str += "\n      ";
+        break;
+      case 9:
+        str += "sym-";
+        str += std::to_string(next(1000));
+        str += ' ';
+        break;
+      case 10:
+        str += "#\\nosuchname ";
+        break;
+      case 11:
+        str += "\"bad \\q escape\" 12abc ";
+        break;
+    }
+  }
+  return str;
+}
+
+TEST_F(ParallelLexerTest, SmallInputTest) {
+  checkSameAsSerial("", 4);
+  checkSameAsSerial("(a \"b\" #\\c 1)", 4);
+}
+
+TEST_F(ParallelLexerTest, SameAsSerialTest) {
+  for (uint64_t seed = 1; seed != 6; ++seed)
+    for (unsigned threads : {2, 3, 8})
+      checkSameAsSerial(genSource(1 << 20, seed, false), threads);
+}
+
+TEST_F(ParallelLexerTest, ErrorsTest) {
+  for (uint64_t seed = 1; seed != 4; ++seed)
+    checkSameAsSerial(genSource(1 << 20, seed, true), 4);
+}
+
+TEST_F(ParallelLexerTest, ErrorLimitTest) {
+  context_.sm.setErrorLimit(50);
+  checkSameAsSerial(genSource(1 << 20, 1, true), 4);
+
+  // Tokens with several errors, so the limit is reached at the second error
+  // of a token, or at the first one with an odd limit.
+  std::string str = genSource(600 * 1024, 2, false);
+  for (unsigned i = 0; i != 100; ++i)
+    str += "\"a\\qb\\qc\" ";
+  for (unsigned limit : {50, 51}) {
+    context_.sm.setErrorLimit(limit);
+    checkSameAsSerial(str, 4);
+  }
+}
+
+TEST_F(ParallelLexerTest, LongTokensTest) {
+  std::string code;
+  for (unsigned i = 0; i != 5000; ++i)
+    code += "(display (list 1 2.5 #\\a))\n";
+  std::string text;
+  for (unsigned i = 0; i != 10000; ++i)
+    text += "  some text ( ; and a line comment\n";
+
+  // Chunks starting inside a string.
+  checkSameAsSerial(code + "\"" + text + "\"" + code, 4);
+  // Inside a block comment. Lexing from the start of the chunk would enter a
+  // string at the \" and never recover, and there is no string to end.
+  checkSameAsSerial(code + "#|" + text + "\\\"|#" + code, 4);
+  // Inside a nested block comment, which the speculation assumes to be only
+  // one level deep, so the lexer has to catch up serially.
+  checkSameAsSerial(code + "#|#|" + text + "|# \\\"|#" + code, 4);
+}
+
+TEST_F(ParallelLexerTest, UnterminatedTest) {
+  // A string and a block comment which run to the end of the input.
+  std::string str = genSource(1 << 19, 7, false);
+  checkSameAsSerial(str + "\"" + str, 4);
+  checkSameAsSerial(str + "#|" + str, 4);
+}
+
+} // anonymous namespace
@@ -0,0 +1,166 @@
+#include "s2020/Parser/DatumParser.h"
+#include "s2020/Parser/TokenStream.h"
+
+#include "TestHelpers.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::parser;
+
+namespace {
+
+class ParallelParserTest : public ::testing::Test {
+ protected:
+  /// Parse \p str serially and in parallel and compare the datums and the
+  /// reported diagnostics.
+  void checkSameAsSerial(const std::string &str, unsigned numThreads);
+
+  /// Parse \p str serially and in parallel from the buffer, so the lexical
+  /// errors are reported while parsing, and compare the reported diagnostics.
+  void checkBufferSameAsSerial(const std::string &str, unsigned numThreads);
+
+ protected:
+  ASTContext context_{};
+  DiagRecorder diags_{context_.sm};
+};
+
+void ParallelParserTest::checkSameAsSerial(
+    const std::string &str,
+    unsigned numThreads) {
+  auto id = context_.sm.addNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(str, "input"));
+  // Defer the lexical errors, so both parsers report them in between the
+  // syntax errors.
+  auto stream = tokenizeAll(context_, *context_.sm.getSourceBuffer(id), true);
+
+  diags_.clear();
+  auto serial = parseDatums(context_, stream);
+  auto serialDiags = diags_.take();
+  context_.sm.clearErrorLimitReached();
+
+  auto parallel = parseDatumsParallel(context_, stream, numThreads);
+  context_.sm.clearErrorLimitReached();
+
+  ASSERT_EQ(serialDiags, diags_.take());
+  ASSERT_EQ(serial.hasValue(), parallel.hasValue());
+  if (!serial)
+    return;
+  ASSERT_EQ(serial->size(), parallel->size());
+  for (size_t i = 0; i != serial->size(); ++i) {
+    ASSERT_TRUE(deepEqual((*serial)[i], (*parallel)[i])) << "datum " << i;
+    ASSERT_EQ(
+        (*serial)[i]->getStartLoc().getPointer(),
+        (*parallel)[i]->getStartLoc().getPointer())
+        << "datum " << i;
+    ASSERT_EQ(
+        (*serial)[i]->getEndLoc().getPointer(),
+        (*parallel)[i]->getEndLoc().getPointer())
+        << "datum " << i;
+  }
+}
+
+void ParallelParserTest::checkBufferSameAsSerial(
+    const std::string &str,
+    unsigned numThreads) {
+  auto id = context_.sm.addNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(str, "input"));
+  const auto &buf = *context_.sm.getSourceBuffer(id);
+
+  diags_.clear();
+  auto serial = parseDatums(context_, buf);
+  auto serialDiags = diags_.take();
+  context_.sm.clearErrorLimitReached();
+
+  auto parallel = parseDatumsParallel(context_, buf, numThreads);
+  context_.sm.clearErrorLimitReached();
+
+  ASSERT_EQ(serialDiags, diags_.take());
+  ASSERT_EQ(serial.hasValue(), parallel.hasValue());
+  if (serial) {
+    ASSERT_EQ(serial->size(), parallel->size());
+  }
+}
+
+/// Generate many top level datums, with datum comments at the top level and
+/// inside lists, and optionally syntax and lexical errors.
+std::string genSource(size_t size, uint64_t seed, bool withErrors) {
+  static const char *const fragments[] = {
+      "(define (f x) (+ x 1.5 #xFF))\n",
+      "[let ((a \"str\") (b #\\a)) (a . b)] ",
+      "#;(skipped (list)) ",
+      "#; #; a (b c) ",
+      "(a #;b [c #;(d)] . e) ",
+      "sym 10 \"top level\" ",
+      "((((((nested))))))\n",
+      "#;\n",
+      "(a . #;b c) ",
+      "#(1 #(a) [b . c] #;d) #u8(0 #;(1) 255) ",
+      "'a `(b ,c ,@(d)) '#;e f #;'g ''h ",
+      "#0=(a #0# . #1=(#1#)) #0=#(#0# '#0#) ",
+      // Errors.
+      ") ",
+      "(a ] b) ",
+      "(a . b c) ",
+      ". (x . ) ",
+      "(#;a . b) ",
+      "#(a . b) #u8(1 256 a) ",
+      "(a ') ",
+      "#7# ",
+      "#\\nosuchname ",
+      "(\"bad \\q \\q escapes\" . 12abc) ",
+  };
+
+  SeededRandom next{seed};
+
+  std::string str;
+  while (str.size() < size) {
+    unsigned i = next(withErrors ? 22 : 12);
+    // Keep the errors rare, so there are long runs without them.
+    if (i >= 12 && next(20))
+      continue;
+    str += fragments[i];
+  }
+  return str;
+}
+
+TEST_F(ParallelParserTest, SmallInputTest) {
+  checkSameAsSerial("", 4);
+  checkSameAsSerial("(a \"b\" #\\c 1)", 4);
+}
+
+TEST_F(ParallelParserTest, SameAsSerialTest) {
+  for (uint64_t seed = 1; seed != 4; ++seed)
+    for (unsigned threads : {2, 3, 8})
+      checkSameAsSerial(genSource(1 << 20, seed, false), threads);
+}
+
+TEST_F(ParallelParserTest, ErrorsTest) {
+  for (uint64_t seed = 1; seed != 4; ++seed)
+    checkSameAsSerial(genSource(1 << 20, seed, true), 4);
+}
+
+TEST_F(ParallelParserTest, ErrorLimitTest) {
+  context_.sm.setErrorLimit(20);
+  checkSameAsSerial(genSource(1 << 20, 1, true), 4);
+}
+
+TEST_F(ParallelParserTest, BufferTest) {
+  // A syntax error before a lexical error, whichever way the input is split.
+  checkBufferSameAsSerial(") a #\\nosuchname b", 4);
+  checkBufferSameAsSerial(genSource(1 << 20, 2, true), 4);
+  checkBufferSameAsSerial(genSource(1 << 20, 3, true) + "(a \"b", 4);
+  for (unsigned limit : {20, 21}) {
+    context_.sm.setErrorLimit(limit);
+    checkBufferSameAsSerial(genSource(1 << 20, 4, true), 4);
+  }
+}
+
+TEST_F(ParallelParserTest, UnterminatedTest) {
+  std::string str = genSource(1 << 20, 5, false);
+  checkSameAsSerial("(" + str, 4);
+  checkSameAsSerial(str + "(a (b c)", 4);
+  checkSameAsSerial(str + "#;", 4);
+}
+
+} // anonymous namespace
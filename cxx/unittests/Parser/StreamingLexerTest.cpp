@@ -0,0 +1,238 @@
+#include "s2020/Parser/StreamingLexer.h"
+#include "s2020/Parser/TokenStream.h"
+
+#include "TestHelpers.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::parser;
+
+namespace {
+
+class StreamingLexerTest : public ::testing::Test {
+ protected:
+  /// Lex \p str in pieces of \p pieceSize bytes and compare the tokens and
+  /// the reported errors with lexing it as a whole.
+  void checkSameAsWhole(const std::string &str, size_t pieceSize);
+
+ protected:
+  ASTContext context_{};
+  DiagRecorder diags_{context_.sm};
+};
+
+void StreamingLexerTest::checkSameAsWhole(
+    const std::string &str,
+    size_t pieceSize) {
+  auto id = context_.sm.addNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(str, "input"));
+  diags_.clear();
+  auto whole = tokenizeAll(context_, *context_.sm.getSourceBuffer(id));
+  auto wholeDiags = diags_.take();
+
+  StreamingLexer lex{context_, "input"};
+  size_t fed = 0;
+  if (str.empty())
+    lex.endInput();
+  for (uint32_t i = 0; i != whole.size(); ++i) {
+    while (!lex.advance()) {
+      ASSERT_LT(fed, str.size()) << "token " << i;
+      lex.addInput(StringRef(str).substr(fed, pieceSize));
+      fed += pieceSize;
+      if (fed >= str.size())
+        lex.endInput();
+    }
+
+    const Token &tok = lex.token();
+    ASSERT_EQ(whole.getKind(i), tok.getKind()) << "token " << i;
+    ASSERT_EQ(whole.getStartOffset(i), lex.getOffset()) << "token " << i;
+    ASSERT_EQ(whole.inputStr(i), tok.inputStr()) << "token " << i;
+
+    SourceErrorManager::SourceCoords coords;
+    ASSERT_TRUE(
+        context_.sm.findBufferLineAndLoc(whole.getStartLoc(i), coords));
+    ASSERT_EQ(coords.line, lex.getLine()) << "token " << i;
+    ASSERT_EQ(coords.col, lex.getColumn()) << "token " << i;
+
+    switch (tok.getKind()) {
+      case TokenKind::identifier:
+        ASSERT_EQ(whole.getIdentifier(i), tok.getIdentifier());
+        break;
+      case TokenKind::string:
+        ASSERT_EQ(whole.getString(i), tok.getString());
+        break;
+      case TokenKind::number:
+        ASSERT_TRUE(whole.getNumber(i).equals(tok.getNumber()));
+        break;
+      case TokenKind::character:
+        ASSERT_EQ(whole.getCharacter(i), tok.getCharacter());
+        break;
+      default:
+        break;
+    }
+  }
+  ASSERT_EQ(wholeDiags, diags_.take());
+}
+
+/// Generate source with every kind of token, including long ones and errors.
+std::string genSource(size_t size, uint64_t seed) {
+  static const char *const fragments[] = {
+      "(define (f x) (+ x 1.5 #xFF)) ",
+      "\"a string\\nwith \\\"escapes\\\"\"",
+      "#| block #| nested |# comment |#",
+      "; line comment\n",
+      "#\\a #\\space #\\x3bb ",
+      "#;(skipped) ",
+      "[vector-ref v 10]\n",
+      "... -> +.5 -1/2 . ",
+      "\n    ",
+      "long-identifier-with-many-characters ",
+      "#\\nosuchname ",
+      "\"bad \\q escape\" 12abc ",
+  };
+  static const unsigned numFragments =
+      sizeof(fragments) / sizeof(fragments[0]);
+
+  SeededRandom next{seed};
+
+  std::string str;
+  while (str.size() < size)
+    str += fragments[next(numFragments)];
+  return str;
+}
+
+TEST_F(StreamingLexerTest, SmokeTest) {
+  StreamingLexer lex{context_, "input"};
+  EXPECT_FALSE(lex.advance());
+
+  lex.addInput("(ab");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::l_paren, lex.token().getKind());
+  // "ab" could continue in the next piece.
+  EXPECT_FALSE(lex.advance());
+
+  lex.addInput("c\n 1");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::identifier, lex.token().getKind());
+  EXPECT_EQ("abc", lex.token().getIdentifier().str());
+  EXPECT_EQ(1, lex.getLine());
+  EXPECT_EQ(2, lex.getColumn());
+  EXPECT_FALSE(lex.advance());
+
+  lex.endInput();
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::number, lex.token().getKind());
+  EXPECT_EQ(2, lex.getLine());
+  EXPECT_EQ(2, lex.getColumn());
+  EXPECT_EQ(6, lex.getOffset());
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::eof, lex.token().getKind());
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::eof, lex.token().getKind());
+}
+
+TEST_F(StreamingLexerTest, SplitDatumTest) {
+  // A datum split at a token boundary is complete as soon as its end
+  // arrives, without waiting for more input.
+  StreamingLexer lex{context_, "input"};
+  lex.addInput("(foo");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::l_paren, lex.token().getKind());
+  EXPECT_FALSE(lex.advance());
+
+  lex.addInput(")\n");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::identifier, lex.token().getKind());
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::r_paren, lex.token().getKind());
+  EXPECT_FALSE(lex.advance());
+  EXPECT_EQ(1, lex.getBufferedSize());
+
+  // The same for a string and a block comment spanning several pieces.
+  lex.addInput("\"a long");
+  EXPECT_FALSE(lex.advance());
+  lex.addInput(" string");
+  EXPECT_FALSE(lex.advance());
+  lex.addInput("\" ");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::string, lex.token().getKind());
+  EXPECT_EQ("a long string", lex.token().getString().str());
+
+  lex.addInput("#| a long");
+  EXPECT_FALSE(lex.advance());
+  lex.addInput(" comment");
+  EXPECT_FALSE(lex.advance());
+  lex.addInput(" |# x ");
+  ASSERT_TRUE(lex.advance());
+  EXPECT_EQ(TokenKind::identifier, lex.token().getKind());
+  EXPECT_EQ("x", lex.token().getIdentifier().str());
+}
+
+TEST_F(StreamingLexerTest, SameAsWholeTest) {
+  checkSameAsWhole("", 1);
+  checkSameAsWhole("a", 1);
+  for (uint64_t seed = 1; seed != 4; ++seed)
+    for (size_t pieceSize : {1, 2, 3, 7, 64, 4096})
+      checkSameAsWhole(genSource(20000, seed), pieceSize);
+}
+
+TEST_F(StreamingLexerTest, LongTokensTest) {
+  std::string text;
+  for (unsigned i = 0; i != 10000; ++i)
+    text += "some text ( ; and a line\n";
+
+  checkSameAsWhole("(a \"" + text + "\" b)", 100);
+  checkSameAsWhole("(a #|" + text + "|# b)", 100);
+  checkSameAsWhole("(a ;" + text + " b)", 100);
+  // Unterminated at the end of the input.
+  checkSameAsWhole("(a \"" + text, 100);
+  checkSameAsWhole("(a #|" + text, 100);
+}
+
+TEST_F(StreamingLexerTest, BoundedMemoryTest) {
+  static const size_t kPieceSize = 4096;
+  std::string piece;
+  while (piece.size() < kPieceSize)
+    piece += "(define (f x) (+ x \"str\" 1.5)) ";
+
+  StreamingLexer lex{context_, "input"};
+  size_t maxBuffered = 0;
+  unsigned numTokens = 0;
+  for (unsigned i = 0; i != 500; ++i) {
+    lex.addInput(piece);
+    maxBuffered = std::max(maxBuffered, lex.getBufferedSize());
+    while (lex.advance())
+      ++numTokens;
+  }
+  lex.endInput();
+  do {
+    ASSERT_TRUE(lex.advance());
+    ++numTokens;
+  } while (lex.token().getKind() != TokenKind::eof);
+
+  EXPECT_LT(maxBuffered, 2 * piece.size());
+  EXPECT_EQ(500 * 13 * (piece.size() / 31) + 1, numTokens);
+}
+
+TEST_F(StreamingLexerTest, ErrorLimitTest) {
+  context_.sm.setErrorLimit(3);
+  StreamingLexer lex{context_, "input"};
+  lex.addInput("#\\bad1 #\\bad2\n #\\bad3 #\\bad4 a b c");
+  lex.endInput();
+
+  unsigned numTokens = 0;
+  do {
+    ASSERT_TRUE(lex.advance());
+    ++numTokens;
+  } while (lex.token().getKind() != TokenKind::eof);
+
+  // The token reporting the last allowed error is still produced.
+  EXPECT_EQ(4, numTokens);
+  auto diags = diags_.take();
+  ASSERT_EQ(4, diags.size());
+  EXPECT_EQ(0, diags[0].find("input:1:1: "));
+  EXPECT_EQ(0, diags[2].find("input:2:2: "));
+  EXPECT_EQ("too many errors emitted", diags[3]);
+}
+
+} // anonymous namespace
@@ -0,0 +1,77 @@
+#ifndef S2020_TEST_PARSER_TESTHELPERS_H
+#define S2020_TEST_PARSER_TESTHELPERS_H
+
+#include "s2020/Support/SourceErrorManager.h"
+
+#include "llvm/ADT/Twine.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace s2020 {
+
+/// A seeded pseudo-random number generator, so that randomized tests generate
+/// the same input every time.
+class SeededRandom {
+ public:
+  explicit SeededRandom(uint64_t seed) : state_(seed) {}
+
+  /// \return the next 64 random bits.
+  uint64_t next() {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state_;
+  }
+
+  /// \return a random number in [0, n).
+  unsigned operator()(unsigned n) {
+    return (unsigned)(next() >> 33) % n;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+/// Remembers every diagnostic reported by a SourceErrorManager as
+/// "name:line:col: message", so the diagnostics of two ways of doing the same
+/// thing can be compared, even if they report them at different addresses.
+/// This is also how the streaming lexer formats the errors it reports without
+/// a location.
+class DiagRecorder {
+ public:
+  explicit DiagRecorder(SourceErrorManager &sm) {
+    sm.setDiagHandler(handler, this);
+  }
+
+  void clear() {
+    diags_.clear();
+  }
+
+  /// \return the diagnostics recorded since the last call, and forget them.
+  std::vector<std::string> take() {
+    std::vector<std::string> res = std::move(diags_);
+    diags_.clear();
+    return res;
+  }
+
+ private:
+  static void handler(const llvm::SMDiagnostic &msg, void *ctx) {
+    auto &diags = static_cast<DiagRecorder *>(ctx)->diags_;
+    if (msg.getLoc().isValid()) {
+      diags.push_back(
+          (llvm::Twine(msg.getFilename()) + ":" +
+           llvm::Twine(msg.getLineNo()) + ":" +
+           llvm::Twine(msg.getColumnNo() + 1) + ": " + msg.getMessage())
+              .str());
+    } else {
+      diags.push_back(msg.getMessage().str());
+    }
+  }
+
+ private:
+  std::vector<std::string> diags_{};
+};
+
+} // namespace s2020
+
+#endif // S2020_TEST_PARSER_TESTHELPERS_H
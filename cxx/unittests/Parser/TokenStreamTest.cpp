@@ -0,0 +1,119 @@
+#include "s2020/Parser/TokenStream.h"
+#include "s2020/Parser/DatumParser.h"
+
+#include "DiagContext.h"
+
+#include <gtest/gtest.h>
+
+using namespace s2020;
+using namespace s2020::parser;
+
+namespace {
+
+class TokenStreamTest : public ::testing::Test {
+ protected:
+  const llvm::MemoryBuffer &makeBuf(const char *str) {
+    auto id = context_.sm.addNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBuffer(str, "input", true));
+    return *context_.sm.getSourceBuffer(id);
+  }
+
+  std::string dumpAll(const std::vector<ast::Node *> &nodes) {
+    std::string str;
+    llvm::raw_string_ostream OS{str};
+    for (const auto *node : nodes)
+      dump(OS, node);
+    OS.flush();
+    return str;
+  }
+
+ protected:
+  ASTContext context_{};
+};
+
+TEST_F(TokenStreamTest, SmokeTest) {
+  const auto &buf = makeBuf(" (+\t#;a 10 \"s\" #\\x 1.5)\n ");
+  auto stream = tokenizeAll(context_, buf);
+  ASSERT_FALSE(stream.hasErrors());
+  ASSERT_EQ(10, stream.size());
+
+  static const TokenKind kinds[] = {
+      TokenKind::l_paren,
+      TokenKind::identifier,
+      TokenKind::datum_comment,
+      TokenKind::identifier,
+      TokenKind::number,
+      TokenKind::string,
+      TokenKind::character,
+      TokenKind::number,
+      TokenKind::r_paren,
+      TokenKind::eof,
+  };
+  for (uint32_t i = 0; i != stream.size(); ++i)
+    EXPECT_EQ(kinds[i], stream.getKind(i)) << "token " << i;
+
+  EXPECT_EQ(1, stream.getStartOffset(0));
+  EXPECT_EQ("+", stream.inputStr(1));
+  EXPECT_EQ("+", stream.getIdentifier(1).str());
+  EXPECT_EQ("a", stream.getIdentifier(3).str());
+  EXPECT_TRUE(stream.getNumber(4).exactEquals(10));
+  EXPECT_EQ("\"s\"", stream.inputStr(5));
+  EXPECT_EQ("s", stream.getString(5).str());
+  EXPECT_EQ(U'x', stream.getCharacter(6));
+  EXPECT_EQ(1.5, stream.getNumber(7).getInexact());
+  EXPECT_EQ(buf.getBufferSize(), stream.getStartOffset(9));
+  EXPECT_EQ(0, stream.getLength(9));
+
+  // The cursor stops at eof.
+  TokenStream::Cursor cur{context_, stream};
+  for (unsigned i = 0; i != stream.size() + 2; ++i)
+    cur.advance();
+  EXPECT_EQ(TokenKind::eof, cur.getKind());
+  EXPECT_EQ(stream.size() - 1, cur.getIndex());
+}
+
+TEST_F(TokenStreamTest, EmptyTest) {
+  auto stream = tokenizeAll(context_, makeBuf(""));
+  ASSERT_EQ(1, stream.size());
+  ASSERT_EQ(TokenKind::eof, stream.getKind(0));
+}
+
+TEST_F(TokenStreamTest, ParseTest) {
+  static const char *const input =
+      "hello 10"
+      " (list -10 more)"
+      " (a . b)"
+      " (1 2 3 . 4)"
+      " (10 . (20 . (30 . ())))"
+      " (if [> a 10] #;(ignored) (display 1) (display a))"
+      " (\"str\" \"a\\nb\")"
+      " (#\\a #\\space #\\x3bb)";
+
+  auto fromLexer = parseDatums(context_, makeBuf(input));
+  ASSERT_TRUE(fromLexer.hasValue());
+
+  auto stream = tokenizeAll(context_, makeBuf(input));
+  auto fromStream = parseDatums(context_, stream);
+  ASSERT_TRUE(fromStream.hasValue());
+
+  ASSERT_EQ(dumpAll(fromLexer.getValue()), dumpAll(fromStream.getValue()));
+}
+
+TEST_F(TokenStreamTest, ErrorTest) {
+  DiagContext diag{context_.sm};
+
+  // A lexical error fails the parse even though the syntax is valid.
+  auto stream = tokenizeAll(context_, makeBuf("(a #\\nosuchname)"));
+  EXPECT_TRUE(stream.hasErrors());
+  EXPECT_EQ(1, diag.getErrCountClear());
+  EXPECT_FALSE(parseDatums(context_, stream).hasValue());
+  EXPECT_EQ(0, diag.getErrCountClear());
+
+  // Syntax errors are still reported.
+  auto stream2 = tokenizeAll(context_, makeBuf("(a . b c)"));
+  EXPECT_FALSE(stream2.hasErrors());
+  EXPECT_FALSE(parseDatums(context_, stream2).hasValue());
+  EXPECT_EQ(1, diag.getErrCountClear());
+}
+
+} // anonymous namespace
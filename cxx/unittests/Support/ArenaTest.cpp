@@ -0,0 +1,79 @@
+#include "s2020/Support/Arena.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+using namespace s2020;
+
+namespace {
+
+TEST(ArenaTest, AllocateTest) {
+  Arena arena{};
+  char *prev = nullptr;
+  for (size_t size : {1, 3, 8, 100, 4000, 5000, 100000, 7}) {
+    for (size_t align : {1, 2, 8, 16, 64}) {
+      char *mem = (char *)arena.Allocate(size, align);
+      EXPECT_EQ(0, (uintptr_t)mem % align) << size << " " << align;
+      memset(mem, 0xAB, size);
+      // The previous allocation hasn't been overwritten.
+      if (prev) {
+        EXPECT_EQ((char)0xAB, *prev);
+      }
+      prev = mem + size - 1;
+    }
+  }
+
+  uint64_t *arr = arena.Allocate<uint64_t>(10);
+  EXPECT_EQ(0, (uintptr_t)arr % alignof(uint64_t));
+}
+
+TEST(ArenaTest, RewindTest) {
+  Arena arena{};
+  arena.Allocate(10, 1);
+  auto cp = arena.checkpoint();
+  void *first = arena.Allocate(10, 1);
+
+  for (unsigned i = 0; i != 5; ++i) {
+    arena.rewind(cp);
+    // The same memory is allocated again after rewinding.
+    EXPECT_EQ(first, arena.Allocate(10, 1));
+    // Enough to need many slabs and large allocations.
+    for (unsigned j = 0; j != 1000; ++j)
+      arena.Allocate(100, 8);
+    arena.Allocate(100000, 8);
+  }
+
+  // Only one spare slab is kept after rewinding.
+  size_t before = arena.getTotalMemory();
+  arena.rewind(cp);
+  EXPECT_LT(arena.getTotalMemory(), before);
+  EXPECT_LE(arena.getTotalMemory(), 2 * 4096);
+
+  arena.reset();
+  EXPECT_LE(arena.getTotalMemory(), 4096);
+  EXPECT_TRUE(arena.Allocate(10, 1));
+}
+
+TEST(ArenaTest, AdoptTest) {
+  Arena arena{};
+  auto cp = arena.checkpoint();
+  Arena other{};
+  char *small = (char *)other.Allocate(10, 1);
+  char *large = (char *)other.Allocate(100000, 1);
+  memset(small, 1, 10);
+  memset(large, 2, 100000);
+
+  arena.adopt(other);
+  EXPECT_EQ(0u, other.getTotalMemory());
+  // The adopted memory is still valid after the other arena is gone, and
+  // the other arena can be used again.
+  EXPECT_TRUE(other.Allocate(10, 1));
+  other.reset();
+  EXPECT_EQ(1, small[9]);
+  EXPECT_EQ(2, large[99999]);
+
+  arena.rewind(cp);
+}
+
+} // anonymous namespace
@@ -0,0 +1,145 @@
+#include "s2020/Support/Conversions.h"
+
+#include "../Parser/TestHelpers.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace s2020;
+
+namespace {
+
+/// Compare the bit patterns of the result of parseDecimalDouble() and strtod(),
+/// which is correctly rounded in all supported C libraries.
+::testing::AssertionResult sameAsStrtod(const std::string &str) {
+  uint64_t expected = llvm::DoubleToBits(strtod(str.c_str(), nullptr));
+  uint64_t actual = llvm::DoubleToBits(parseDecimalDouble(str));
+  if (expected == actual)
+    return ::testing::AssertionSuccess();
+  return ::testing::AssertionFailure()
+      << str << ": expected 0x" << std::hex << expected << ", got 0x" << actual;
+}
+
+TEST(ConversionsTest, SimpleTest) {
+  EXPECT_EQ(0.0, parseDecimalDouble("0"));
+  EXPECT_EQ(0.0, parseDecimalDouble("0000.000e100000000"));
+  EXPECT_EQ(1.0, parseDecimalDouble("1"));
+  EXPECT_EQ(0.5, parseDecimalDouble(".5"));
+  EXPECT_EQ(5.0, parseDecimalDouble("5."));
+  EXPECT_EQ(1.25, parseDecimalDouble("125e-2"));
+  EXPECT_EQ(1e23, parseDecimalDouble("1E+23"));
+  EXPECT_EQ(123456.789, parseDecimalDouble("000123456.78900000"));
+  EXPECT_EQ(HUGE_VAL, parseDecimalDouble("1e309"));
+  EXPECT_EQ(HUGE_VAL, parseDecimalDouble("1e99999999999"));
+  EXPECT_EQ(0.0, parseDecimalDouble("1e-99999999999"));
+
+  // Exponents compensated by many leading or trailing zeros.
+  std::string zeros(1000000, '0');
+  EXPECT_EQ(1e4, parseDecimalDouble("0." + zeros + "1e1000005"));
+  EXPECT_EQ(1e-4, parseDecimalDouble("1" + zeros + "e-1000004"));
+}
+
+TEST(ConversionsTest, HardCasesTest) {
+  static const char *const cases[] = {
+      // Smallest and largest normal and subnormal numbers and their
+      // neighborhoods.
+      "2.2250738585072011e-308",
+      "2.2250738585072012e-308",
+      "2.2250738585072014e-308",
+      "4.9406564584124654e-324",
+      "2.4703282292062327e-324",
+      "2.4703282292062328e-324",
+      "1.7976931348623157e308",
+      "1.7976931348623158e308",
+      "1.7976931348623159e308",
+      // Ties between 2^53 and its neighbors.
+      "9007199254740993",
+      "9007199254740995",
+      "9007199254740993.0000000000000000000000000001",
+      "9007199254740992.9999999999999999999999999999",
+      // Exactly halfway between 1 and the next double, with and without
+      // trailing digits.
+      "1.00000000000000011102230246251565404236316680908203125",
+      "1.000000000000000111022302462515654042363166809082031250000000001",
+      "1.00000000000000011102230246251565404236316680908203124999999999",
+      // Outside of the Clinger fast path.
+      "123456789012345678",
+      "1e-23",
+      "7e22",
+      "8.98846567431158e307",
+      "2.4e-320",
+      "0.000000000000000000000000000000000000000000001e-300",
+  };
+  for (const char *str : cases)
+    EXPECT_TRUE(sameAsStrtod(str));
+
+  // Halfway between the largest finite double and 2^1024, which rounds to
+  // infinity.
+  std::string maxHalf =
+      "179769313486231580793728971405303415079934132710037826936173"
+      "778980444968292764750946649017977587207096330286416692887910"
+      "946555547851940402630657488671505820681908902000708383676273"
+      "854845817711531764475730270069855571366959622842914819860834"
+      "936475292719074168444365510704342711559699508093042880177904"
+      "174497792";
+  EXPECT_TRUE(sameAsStrtod(maxHalf));
+  // Just below it.
+  maxHalf.back() = '1';
+  EXPECT_TRUE(sameAsStrtod(maxHalf));
+}
+
+TEST(ConversionsTest, RandomTest) {
+  SeededRandom next{1};
+
+  for (unsigned i = 0; i != 20000; ++i) {
+    std::string str;
+    unsigned intDigits = next(4) == 0 ? next(40) : next(8);
+    unsigned fracDigits = next(3) == 0 ? next(40) : next(8);
+    if (intDigits + fracDigits == 0)
+      intDigits = 1;
+    for (unsigned j = 0; j != intDigits; ++j)
+      str += (char)('0' + next(10));
+    if (fracDigits || next(2)) {
+      str += '.';
+      for (unsigned j = 0; j != fracDigits; ++j)
+        str += (char)('0' + next(10));
+      if (!intDigits && !fracDigits)
+        str += '0';
+    }
+    if (next(2)) {
+      str += next(2) ? 'e' : 'E';
+      str += "+-"[next(2)];
+      str += std::to_string(next(340));
+    }
+    EXPECT_TRUE(sameAsStrtod(str));
+  }
+}
+
+/// Numbers with many digits that are very close to halfway points exercise
+/// the exact comparison.
+TEST(ConversionsTest, NearHalfwayTest) {
+  SeededRandom random{7};
+
+  char buf[64];
+  for (unsigned i = 0; i != 2000; ++i) {
+    // A random finite double and its successor.
+    uint64_t bits = random.next() % 0x7FEFFFFFFFFFFFFFULL;
+    double lo = llvm::BitsToDouble(bits);
+    double hi = llvm::BitsToDouble(bits + 1);
+    // The midpoint is exact if long double has a wider mantissa. Printing it
+    // with fewer digits lands on either side of it.
+    long double mid = ((long double)lo + (long double)hi) / 2;
+    snprintf(buf, sizeof(buf), "%.40Le", mid);
+    EXPECT_TRUE(sameAsStrtod(buf));
+    snprintf(buf, sizeof(buf), "%.25Le", mid);
+    EXPECT_TRUE(sameAsStrtod(buf));
+  }
+}
+
+} // anonymous namespace
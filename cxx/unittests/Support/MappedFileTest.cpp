@@ -0,0 +1,87 @@
+#include "s2020/Support/MappedFile.h"
+#include "s2020/Support/SourceErrorManager.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace s2020;
+
+namespace {
+
+class MappedFileTest : public ::testing::Test {
+ protected:
+  ~MappedFileTest() override {
+    for (const auto &path : paths_)
+      llvm::sys::fs::remove(path);
+  }
+
+  /// Write \p contents to a new temporary file.
+  /// \return the path of the file.
+  std::string makeFile(const std::string &contents) {
+    int fd;
+    llvm::SmallString<128> path;
+    EXPECT_FALSE(llvm::sys::fs::createTemporaryFile("mapped", "scm", fd, path));
+    llvm::raw_fd_ostream OS{fd, true};
+    OS << contents;
+    paths_.push_back(path.str().str());
+    return paths_.back();
+  }
+
+  /// Check that \p contents is loaded intact and zero terminated.
+  void checkLoad(const std::string &contents, bool hugePages) {
+    auto buf = mapSourceFile(makeFile(contents), hugePages);
+    ASSERT_TRUE(bool(buf));
+    ASSERT_EQ(contents.size(), buf.get()->getBufferSize());
+    ASSERT_TRUE(buf.get()->getBuffer() == contents);
+    ASSERT_EQ(0, *buf.get()->getBufferEnd());
+  }
+
+ private:
+  std::vector<std::string> paths_{};
+};
+
+TEST_F(MappedFileTest, SizesTest) {
+  size_t page = llvm::sys::Process::getPageSizeEstimate();
+  checkLoad("", false);
+  checkLoad("(a b c)", false);
+  for (size_t size : {page * 8 - 1, page * 8, page * 8 + 1, page * 100}) {
+    std::string contents;
+    while (contents.size() < size)
+      contents += "(define (f x) (+ x 1))\n";
+    contents.resize(size);
+    checkLoad(contents, false);
+    checkLoad(contents, true);
+  }
+}
+
+TEST_F(MappedFileTest, MissingFileTest) {
+  auto buf = mapSourceFile("/nonexistent/file.scm");
+  ASSERT_FALSE(bool(buf));
+  EXPECT_EQ(std::errc::no_such_file_or_directory, buf.getError());
+}
+
+TEST_F(MappedFileTest, AddSourceFileTest) {
+  SourceErrorManager sm{};
+  std::string contents(100000, 'a');
+  contents += "\nb";
+  auto path = makeFile(contents);
+
+  auto id = sm.addSourceFile(path);
+  ASSERT_TRUE(bool(id));
+  const llvm::MemoryBuffer *buf = sm.getSourceBuffer(id.get());
+  EXPECT_EQ(path, buf->getBufferIdentifier());
+  EXPECT_EQ(contents.size(), buf->getBufferSize());
+
+  SourceErrorManager::SourceCoords coords;
+  ASSERT_TRUE(sm.findBufferLineAndLoc(
+      SMLoc::getFromPointer(buf->getBufferEnd() - 1), coords));
+  EXPECT_EQ(2, coords.line);
+  EXPECT_EQ(1, coords.col);
+
+  EXPECT_FALSE(bool(sm.addSourceFile("/nonexistent/file.scm")));
+}
+
+} // anonymous namespace
@@ -0,0 +1,106 @@
+#include "s2020/Support/StringTable.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace s2020;
+
+namespace {
+
+TEST(StringTableTest, UniqueTest) {
+  Arena allocator{};
+  StringTable table{allocator};
+
+  // Strings of every length handled by a different part of the hash and the
+  // comparison, differing only in their first or last character.
+  std::vector<std::string> strs{};
+  for (size_t len = 0; len != 40; ++len) {
+    std::string str(len, 'a');
+    strs.push_back(str);
+    if (len) {
+      str.front() = 'b';
+      strs.push_back(str);
+      str.back() = 'c';
+      strs.push_back(str);
+    }
+  }
+  // Enough to grow the table several times.
+  for (unsigned i = 0; i != 5000; ++i)
+    strs.push_back("sym-" + std::to_string(i));
+
+  std::vector<UniqueString *> uniq{};
+  for (const auto &str : strs) {
+    UniqueString *ustr = table.getString(str);
+    EXPECT_EQ(str, ustr->str());
+    EXPECT_EQ(0, ustr->c_str()[str.size()]);
+    EXPECT_EQ(hashString(str), ustr->hash());
+    uniq.push_back(ustr);
+  }
+
+  // The same strings, copied so they have different addresses, are found
+  // with and without a precomputed hash.
+  for (size_t i = 0; i != strs.size(); ++i) {
+    std::string copy = strs[i];
+    EXPECT_EQ(uniq[i], table.getString(copy)) << strs[i];
+    EXPECT_EQ(uniq[i], table.getString(copy, hashString(copy))) << strs[i];
+  }
+
+  // All of them are distinct.
+  std::sort(uniq.begin(), uniq.end());
+  EXPECT_EQ(uniq.end(), std::unique(uniq.begin(), uniq.end()));
+}
+
+TEST(StringTableTest, EmptyTest) {
+  Arena allocator{};
+  StringTable table{allocator};
+
+  // A null StringRef() has the hash and size of the empty string.
+  UniqueString *empty = table.getString(StringRef());
+  EXPECT_EQ("", empty->str());
+  EXPECT_EQ(0, empty->c_str()[0]);
+  EXPECT_EQ(empty, table.getString(""));
+  EXPECT_EQ(empty, table.getString(StringRef(), hashString(StringRef())));
+  EXPECT_EQ(1u, table.size());
+
+  table.truncate(0);
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ("", table.getString("")->str());
+  EXPECT_EQ(1u, table.size());
+}
+
+TEST(StringTableTest, NoCopyTest) {
+  Arena allocator{};
+  StringTable table{allocator};
+
+  static const char str[] = "no-copy";
+  UniqueString *ustr = table.getStringNoCopy(str);
+  EXPECT_EQ(str, ustr->c_str());
+  EXPECT_EQ(ustr, table.getString(std::string(str)));
+}
+
+TEST(StringTableTest, TruncateTest) {
+  Arena allocator{};
+  StringTable table{allocator};
+
+  UniqueString *a = table.getString("a");
+  size_t size = table.size();
+  auto cp = allocator.checkpoint();
+  table.getString("b");
+  table.getStringNoCopy("c");
+  EXPECT_EQ(size + 2, table.size());
+
+  table.truncate(size);
+  allocator.rewind(cp);
+  EXPECT_EQ(size, table.size());
+  EXPECT_EQ(a, table.getString("a"));
+  // Added again, in the memory which was released.
+  UniqueString *b = table.getString("b");
+  EXPECT_EQ("b", b->str());
+  EXPECT_EQ(b, table.getString("b"));
+  EXPECT_EQ(size + 1, table.size());
+}
+
+} // anonymous namespace
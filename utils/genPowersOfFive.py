@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+# Generates the table of 128-bit truncated powers of five used by the
+# Eisel-Lemire decimal to double conversion.
+# Usage: genPowersOfFive.py > cxx/lib/Support/PowersOfFive.inc
+
+SMALLEST_POWER = -342
+LARGEST_POWER = 308
+
+
+def split(value):
+    """ Print a 128-bit value as a pair of 64-bit halves. """
+    print("    {0x%016x, 0x%016x}," % (value >> 64, value & ((1 << 64) - 1)))
+
+
+def main():
+    print("//")
+    print("// File generated by genPowersOfFive.py")
+    print("// *** DO NOT EDIT BY HAND ***")
+    print("")
+    print("/// The smallest and largest decimal exponent in the table.")
+    print("static constexpr int kSmallestPowerOfFive = %d;" % SMALLEST_POWER)
+    print("static constexpr int kLargestPowerOfFive = %d;" % LARGEST_POWER)
+    print("")
+    print("/// 5^q for every q in [kSmallestPowerOfFive, kLargestPowerOfFive],")
+    print("/// normalized so the most significant bit of the 128-bit value is set,")
+    print("/// stored as {high 64 bits, low 64 bits}.")
+    print("static const uint64_t kPowersOfFive128[][2] = {")
+
+    for q in range(SMALLEST_POWER, 0):
+        power5 = 5 ** -q
+        z = 0
+        while (1 << z) < power5:
+            z += 1
+        if q >= -27:
+            b = z + 127
+            c = 2 ** b // power5 + 1
+        else:
+            b = 2 * z + 2 * 64
+            c = 2 ** b // power5 + 1
+            while c >= (1 << 128):
+                c //= 2
+        split(c)
+
+    for q in range(0, LARGEST_POWER + 1):
+        power5 = 5 ** q
+        while power5 < (1 << 127):
+            power5 *= 2
+        while power5 >= (1 << 128):
+            power5 //= 2
+        split(power5)
+
+    print("};")
+
+
+if __name__ == "__main__":
+    main()